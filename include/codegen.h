@@ -25,6 +25,7 @@ typedef struct _GeneratedFunction {
   int32_t structBufferOffset;
   int32_t returnStructAddressOffset;
   int32_t savedRegOffset;
+  unsigned savedRegCount; // callee-saved registers which hold promoted locals
 
   int32_t stackOffset;
 
@@ -33,6 +34,11 @@ typedef struct _GeneratedFunction {
   Section *section;
   ptrdiff_t sectionOffset;
 
+  struct LabelJump *jumps; // every jump of the body, newest first, for relaxation
+  struct LabelRef *labelRefs;
+
+  struct PeepholeInstr peephole[2]; // last emitted instructions, newest first
+
   struct _Symbol *symbol;
 
   struct _GenerationContext *context;
@@ -51,6 +57,11 @@ typedef struct _GeneratedVariable {
 
   int32_t baseOffset;
 
+  int32_t useWeight; // accesses weighted by loop depth
+  int32_t reg; // valid for promoted locals only
+  unsigned isPromoted : 1; // local lives in a register rather than in a stack slot
+  unsigned isEscaped : 1; // address of local is taken so it has to stay in memory
+
   struct _Symbol *symbol;
 
   struct _GeneratedVariable *next;
@@ -73,12 +84,25 @@ struct CaseLabel {
   struct Label label;
 };
 
+typedef struct _SwitchCase {
+  uint64_t key; // case value biased so that unsigned order of keys is the order of values
+  int64_t value;
+  struct Label *label;
+} SwitchCase;
+
+enum SwitchStrategy {
+  SS_LINEAR, // chain of compares
+  SS_TABLE, // bounds check and indirect jump through a table
+  SS_SPLIT // one compare which splits cases into two halves
+};
+
 typedef struct _GenerationContext {
   ParserContext *parserContext;
 
   GeneratedFile *file;
 
   Arena *codegenArena;
+  Arena *scratchArena; // labels and jump fixups which are dead once a function is emitted
 
   Relocation *relocations;
 
@@ -100,6 +124,7 @@ typedef struct _GenerationContext {
   struct CaseLabel *caseLabels;
 
   Symbol *memsetSymbol;
+  Symbol *memcpySymbol;
 
   Section *bss;
   Section *rodata;
@@ -134,13 +159,39 @@ typedef union {
 void initConstCache(GenerationContext *ctx);
 void releaseConstCache(GenerationContext *ctx);
 
-void buildElfFile(GenerationContext *ctx, AstFile *astFile, GeneratedFile *genFile, ElfFile *elfFile);
+void buildElfFile(GenerationContext *ctx, const char *fileName, GeneratedFile *genFile, ElfFile *elfFile);
 
 typedef struct _ArchCodegen {
   GeneratedFunction *(*generateFunction)(GenerationContext *, AstFunctionDefinition *);
   GeneratedVariable *(*generateVaribale)(GenerationContext *, AstValueDeclaration *);
 } ArchCodegen;
 
+typedef struct _FileCodegen {
+  GenerationContext context;
+  ArchCodegen *archCodegen;
+  const char *fileName;
+
+  ElfFile elfFile;
+
+  struct {
+    Section nullSection;
+    Section text, reText;
+    Section data;
+    Section bss;
+    Section rodata;
+    Section dataLocal, reDataLocal;
+    Section roDataLocal, reRoDataLocal;
+    Section symtab;
+    Section strtab;
+    Section shstrtab;
+  } sections;
+} FileCodegen;
+
+/** Units could be fed in several portions, in pipeline mode every function goes right after it is parsed */
+FileCodegen *startFileCodegen(struct _ParserContext *ctx, ArchCodegen *archCodegen, const char *fileName);
+void generateUnits(FileCodegen *codegen, AstTranslationUnit *units);
+void finishFileCodegen(FileCodegen *codegen, Boolean writeObject);
+
 GeneratedFile *generateCodeForFile(struct _ParserContext *ctx, ArchCodegen *archCodegen, AstFile *astFile);
 
 void initArchCodegen_x86_64(ArchCodegen *cg);
@@ -159,6 +210,10 @@ void emitQuadOrDouble(GeneratedFunction *f, uint64_t w);
 
 ptrdiff_t emitStringWithEscaping(GenerationContext *ctx, Section *section, AstConst *_const);
 
+void sortSwitchCases(SwitchCase *cases, struct CaseLabel *labels, unsigned count, TypeId tid);
+enum SwitchStrategy selectSwitchStrategy(const SwitchCase *cases, unsigned count);
+unsigned splitSwitchCases(const SwitchCase *cases, unsigned count);
+
 Boolean hasRelocationsInit(AstInitializer *init);
 size_t fillInitializer(GenerationContext *ctx, Section *section, AstInitializer *init, int32_t startOffset, size_t size);
 
@@ -36,7 +36,7 @@
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, ILLEGAL_INIT_ONLY_VARS, "illegal initializer (only variables can be initialized)"), \
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, TOO_FEW_ARGS, "too few arguments to function call"), \
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, TOO_MANY_ARGS, "too many arguments to function call"), \
-  DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, DUPLICATE_CASE_VALUE, "duplicate case value '%d'"), \
+  DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, DUPLICATE_CASE_VALUE, "duplicate case value '%ld'"), \
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, MULTIPLE_DEFAULT_LABELS, "multiple default labels in one switch"), \
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, UNDECLARED_LABEL, "use of undeclared label '%s'"), \
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, FUN_CONFLICTING_TYPES, "conflicting types for '%s'"), \
@@ -151,6 +151,8 @@
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, NON_VAR_IN_FOR, "non-variable declaration in 'for' loop"), \
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, NON_LOCAL_IN_FOR, "declaration of non-local variable in 'for' loop"), \
   DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, VOID_NOT_IGNORED, "void value not ignored as it ought to be"), \
+  DIAGNOSTIC_DEF(ERROR, SEMANTHICAL, PCH_UNSUPPORTED_DECLARATION, "'%s' cannot be precompiled, only declarations are allowed in precompiled header"), \
+  DIAGNOSTIC_DEF(WARNING, SEMANTHICAL, CONST_EXPR_OVERFLOW, "overflow in expression; result is '%ld' with type '%tr'"), \
   DIAGNOSTIC_DEF(ERROR, PP, PP_INVALID_PP_DIRECTIVE, "invalid preprocessor directive %tk"), \
   DIAGNOSTIC_DEF(ERROR, PP, PP_EXPECTED_FILENAME, "expected \"FILENAME\" or <FILENAME>"), \
   DIAGNOSTIC_DEF(ERROR, PP, PP_INCLUDE_FILE_NOT_FOUND, "'%s' file not found"), \
@@ -178,5 +180,6 @@
   DIAGNOSTIC_DEF(ERROR, PP, PP_EXPECTED_VALUE_IN_EXPRESSION, "expected value in expression"), \
   DIAGNOSTIC_DEF(ERROR, PP, PP_AFTER_ELSE, "#%s after #else"), \
   DIAGNOSTIC_DEF(ERROR, PP, PP_INVALID_FILE_LINE, "invalid filename for #line directive"), \
-  DIAGNOSTIC_DEF(ERROR, PP, PP_UNSUPPORTED_DIRECTIVE, "unsupported preprocessor directive '%s'")
+  DIAGNOSTIC_DEF(ERROR, PP, PP_UNSUPPORTED_DIRECTIVE, "unsupported preprocessor directive '%s'"), \
+  DIAGNOSTIC_DEF(ERROR, PP, PP_FLOAT_IN_EXPRESSION, "floating point value in preprocessor expression")
 
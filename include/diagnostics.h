@@ -64,6 +64,7 @@ typedef struct _Diagnostic {
 
 typedef struct _Diagnostics {
   unsigned count;
+  unsigned errorCount;
   Diagnostic *head, *tail;
 } Diagnostics;
 
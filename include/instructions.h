@@ -43,13 +43,38 @@ typedef struct _Relocation {
 
 struct LabelJump {
   ptrdiff_t instruction_cp;
+  ptrdiff_t target_cp; // -1 until the label is bound
   size_t instSize;
   struct LabelJump *next;
+  struct LabelJump *nextInFunction;
 };
 
 struct LabelRef {
   ptrdiff_t offset_cp;
+  ptrdiff_t origin_cp; // the stored value is label minus origin
+  ptrdiff_t target_cp; // -1 until the label is bound
   struct LabelRef *next;
+  struct LabelRef *nextInFunction;
+};
+
+enum PeepholeKind {
+  PH_NONE = 0,
+  PH_PUSH,
+  PH_POP,
+  PH_STORE, // mov [rbp + imm], src
+  PH_LOAD,  // mov dst, [rbp + imm]
+  PH_MOVE_RR,
+  PH_LOGIC, // and/or/xor into dst
+  PH_TEST
+};
+
+struct PeepholeInstr {
+  enum PeepholeKind kind;
+  ptrdiff_t start_cp;
+  ptrdiff_t end_cp;
+  int src, dst;
+  int32_t imm;
+  size_t size;
 };
 
 struct Label {
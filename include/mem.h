@@ -24,6 +24,8 @@ void releaseHeap(void *);
 Arena *createArena(const char *name, size_t chuckSize);
 void *areanAllocate(Arena *arena, size_t size);
 void releaseArena(Arena *arena);
+// drops everything allocated so far but keeps the chunks for reuse
+void resetArena(Arena *arena);
 
 void printArenaStatistic(FILE *output, Arena *arena);
 
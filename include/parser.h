@@ -30,6 +30,8 @@ typedef struct _Configuration {
   const char *canonDumpFileName;
   const char *irDumpFileName;
   const char *outputFile;
+  const char *pchOutput; // -emit-pch
+  const char *pchInput; // -include-pch
 
   IncludePath *includePath;
   StringList *macroses;
@@ -47,40 +49,48 @@ typedef struct _Configuration {
   unsigned objOutput : 1;
 
   unsigned experimental : 1;
+
+  unsigned pipeline : 1; // -pipeline
 } Configuration;
 
 
 struct _Hideset;
 
 
+// string literal payload, lives in string arena right before the literal text
+typedef struct _TokenText {
+  const char *v; // holds _cleared_ string literal
+  size_t l;
+} TokenText;
+
 typedef struct _Token {
     struct _LocationInfo *locInfo;
 
-    int code;    // gets promoted later in parser if applicable into language key word like 'for', 'int', 'if', etc
-    int rawCode; // actual lexed token code
-
     const char *pos; // startOffset = pos - coords->buffer
-    size_t length;   // endOffset = startOffset + length
 
-    const char *id;  // needs for strcmp checks
+    const char *id;  // interned identifier, compare it by pointer
 
+    // literals which do not fit into 8 bytes are kept aside in string arena
     union {
       uint64_t iv; // holds integer const
-      long double ldv; // holds long double const (yes it's different from double)
-      struct {
-        const char *v; // holds _cleared_ string literal
-        size_t l;
-      } text;
+      const long double *ldv; // holds long double const (yes it's different from double)
+      const TokenText *text;
     } value;
 
+    struct _Token *expanded;
+    struct _Token *next;
+
+    int16_t code;    // gets promoted later in parser if applicable into language key word like 'for', 'int', 'if', etc
+    int16_t rawCode; // actual lexed token code
+
+    uint32_t length; // endOffset = startOffset + length
+
     unsigned hasLeadingSpace: 1;
     unsigned startOfLine: 1;
     unsigned macroStringitize: 1;
     unsigned isMacroParam : 1;
     unsigned disabledExpansion : 1;
-
-    struct _Token *expanded;
-    struct _Token *next;
+    unsigned pinned : 1; // persistent copy of original token referenced from AST, see pinToken
 } Token;
 
 
@@ -116,9 +126,16 @@ typedef struct _LineChunk {
   const char *overrideFileName;
   unsigned overrideLineNumber;
   unsigned posLineNumber;
-  struct _LineChunk *next;
 } LineChunk;
 
+// starts of lines in file buffer, discovered lazily by lexer and shared by all inclusions of the file
+typedef struct _LineTable {
+  unsigned *positions;
+  unsigned count;
+  unsigned capacity;
+  unsigned lastHit; // result of the last lookup, see lineTableLookup
+} LineTable;
+
 typedef struct _LocationInfo {
   const char *buffer;
   size_t bufferSize;
@@ -126,10 +143,14 @@ typedef struct _LocationInfo {
 
   struct {
     const char *fileName;
-    unsigned *linesPos;
-    unsigned lineno;
-    unsigned lineCount;
-    struct _LineChunk *chunks; // required for #line PP directive support
+    LineTable *lines;
+    unsigned lineno; // line of lexer position
+    // required for #line PP directive support, ordered by posLineNumber
+    struct {
+      LineChunk *items;
+      unsigned count;
+      unsigned capacity;
+    } chunks;
   } fileInfo;
 
   struct _LocationInfo *next;
@@ -140,11 +161,16 @@ enum LexState {
   LS_FILE
 };
 
+// expansion is a cursor over definition body, which is shared by all expansions of the macro
 typedef struct _MacroState {
   MacroDefinition *definition;
-  Token *trigger; // token which is being expanded
-  Token *bodyStart;  // macro body with replaced params
+  Token *trigger; // token which is being expanded, origin of every token of the expansion
+  struct _MacroArg *args;
   Token *bodyPtr;
+  Token *argPtr;  // cursor into argument substituted for parameter
+  Token *argSite; // parameter whose argument is not started yet
+  Token *pending; // tokens built by '#' and '##'
+  unsigned isStarted : 1;
 } MacroState;
 
 enum PPConditionState {
@@ -162,6 +188,14 @@ typedef struct _PPConditionFrame {
 
 } PPConditionFrame;
 
+// detection of '#ifndef X #define X ... #endif' include guard around whole file
+enum IncludeGuardState {
+  IGS_START,        // nothing but comments and new lines seen so far
+  IGS_IN_GUARD,     // inside of the top-level '#ifndef X'
+  IGS_AFTER_GUARD,  // guard closed by its '#endif', nothing significant seen after it
+  IGS_INVALID       // file is not guarded
+};
+
 typedef struct _LexerState {
   enum LexState state;
 
@@ -178,6 +212,10 @@ typedef struct _LexerState {
       PPConditionFrame *conditionStack;
 
       unsigned atLineStart;
+
+      enum IncludeGuardState guardState;
+      const char *guardMacro;
+      PPConditionFrame *guardFrame;
     } fileContext;
 
     MacroState macroContext;
@@ -193,13 +231,20 @@ typedef struct _ParserContext {
     struct _Scope* rootScope;
     struct _Scope* currentScope;
 
-    struct _Scope* scopeList; // used to release scope memory
-
     LexerState *lexerState;
 
     Token *firstToken;
     Token *token;
 
+    // tokens handed to parser are recycled between external declarations, see recycleTokenWindow
+    struct {
+      Token *freeList;
+      Coordinates **retained; // AST coordinates created since last recycling
+      unsigned retainedCount;
+      unsigned retainedCapacity;
+      unsigned isOpen : 1;
+    } tokenWindow;
+
     struct {
       Arena *tokenArena;
       Arena *macroArena;
@@ -208,6 +253,8 @@ typedef struct _ParserContext {
       Arena *stringArena;
       Arena *diagnosticsArena;
       Arena *codegenArena;
+      Arena *functionArena; // pipeline mode only, reset after each function definition
+      Arena *bodyArena; // set while the current function body is compiled
     } memory;
 
     int anonSymbolsCounter;
@@ -227,6 +274,7 @@ typedef struct _ParserContext {
       unsigned afterPPParen : 1;
       unsigned inStaticScope : 1;
       unsigned silentMode : 1; // in this mode diagnostics are not being issued
+      unsigned cannonizeUnits : 1; // canonicalize each external declaration as soon as it is parsed
       unsigned caseCount;
       unsigned returnStructBuffer;
       int lastLexCode;
@@ -243,6 +291,8 @@ typedef struct _ParserContext {
 
     HashMap *macroMap;
     HashMap *pragmaOnceMap;
+    HashMap *includeGuardMap; // file -> name of macro guarding it by '#ifndef X ... #endif' 
+    HashMap *typeTable; // canonical TypeRef -> itself, see uniqueTypeRef
 
 } ParserContext;
 
@@ -271,21 +321,31 @@ typedef struct _ParsedInitializer {
 
 Token *nextToken(ParserContext *ctx);
 
-Token *tokenizeBuffer(ParserContext *ctx);
+void retainCoordinates(ParserContext *ctx, Coordinates *coords);
+void recycleTokenWindow(ParserContext *ctx);
+
+/** preprocesses current file straight into output */
+void streamPreprocessedOutput(ParserContext *ctx, FILE *output);
 
-LocationInfo *allocateFileLocationInfo(const char *fileName, const char *buffer, size_t buffeSize, unsigned lineCount);
+LocationInfo *allocateFileLocationInfo(const char *fileName, const char *buffer, size_t buffeSize, LineTable *lines);
+void addLineChunk(LocationInfo *locInfo, const char *fileName, unsigned overrideLine, unsigned rawLine);
 LocationInfo *allocateMacroLocationInfo(const char *buffer, size_t buffeSize, Boolean isConst);
 
 LexerState *allocateFileLexerState(LocationInfo *locInfo);
 
-const char *joinToStringTokenSequence(ParserContext *ctx, Token *s);
-
 char *allocateString(ParserContext *ctx, size_t size);
 Token *allocToken(ParserContext *ctx);
 
 
 void compileFile(Configuration * config);
+
+/** reports declarations which cannot be precompiled, such as function and variable definitions */
+void verifyPrecompiledUnits(ParserContext *ctx, AstFile *file);
+Boolean writePrecompiledHeader(ParserContext *ctx, const char *fileName);
+/** restores macros, file scope declarations and include state saved by writePrecompiledHeader */
+Boolean loadPrecompiledHeader(ParserContext *ctx, const char *fileName);
 void cannonizeAstFile(ParserContext *ctx, AstFile *file);
+AstTranslationUnit *cannonizeParsedUnits(ParserContext *ctx, AstFile *file, AstTranslationUnit *done);
 AstConst* eval(ParserContext *ctx, AstExpression* expression);
 AstExpression* parseConditionalExpression(ParserContext *ctx);
 
@@ -37,11 +37,20 @@ struct _Token *preprocessFile(struct _ParserContext *ctx, struct _Token *s, stru
 struct _Token *originalToken(struct _Token *t);
 
 MacroDefinition *findMacro(struct _ParserContext *ctx, const char *name);
-
+MacroDefinition *allocateMacroDef(struct _ParserContext *ctx, const char *name, MacroParam *params, struct _Token *body, Boolean isVararg, Boolean isFunc);
+MacroParam *allocateMacroParam(struct _ParserContext *ctx, const char *name);
+
+struct _MacroState;
+/** token the expansion is going to hand out next or NULL at its end, cursor is moved over parameters and operators */
+struct _Token *peekMacroToken(struct _ParserContext *ctx, struct _MacroState *state);
+/** copy of the next token of expansion, tokens built by '#' and '##' are handed out without copying */
+struct _Token *nextMacroToken(struct _ParserContext *ctx, struct _MacroState *state);
 struct _LexerState *allocateMacroLexerState(MacroDefinition *def, struct _Token *trigger);
 struct _LexerState *popLexerState(struct _ParserContext *ctx);
 
 struct _LexerState *loadFile(const char *fileName, struct _LexerState *prev);
+/** cached check if source file exists, fileName must be interned */
+Boolean isSourceFileExist(const char *fileName);
 
 Boolean isNextToken(struct _ParserContext *ctx, int code);
 void handleDirective(struct _ParserContext *ctx, struct _Token *directive);
@@ -50,6 +59,10 @@ Boolean lexTokenRaw(struct _ParserContext *ctx, struct _Token *new);
 struct _Token *lexToken(struct _ParserContext *ctx);
 struct _Token *lexTokenNoSubstitute(struct _ParserContext *ctx);
 struct _Token *lexNonExpand(struct _ParserContext *ctx, Boolean shadowNL);
+/** identifier spelled by l followed by r or NULL if the spelling is not a single identifier */
+struct _Token *pasteIdentifier(struct _ParserContext *ctx, const struct _Token *l, const struct _Token *r);
 void skipUntilEoL(struct _ParserContext *ctx);
+/** moves file lexer to the next line starting with '#' without tokenizing anything, FALSE at end of file */
+Boolean skipToDirectiveLine(struct _ParserContext *ctx);
 
 #endif // __PP_H__
@@ -52,6 +52,7 @@ Boolean isNullConst(AstExpression *expr);
 Boolean checkReturnType(ParserContext *ctx, Coordinates *coords, TypeRef *returnType, AstExpression *expr);
 
 StructualMember *findStructualMember(TypeDefiniton *definition, const char *name);
+void indexStructualMembers(ParserContext *ctx, TypeDefiniton *definition);
 int32_t effectiveMemberOffset(StructualMember *member);
 int32_t memberOffset(TypeDefiniton *declaration, const char *memberName);
 void verifyStructualMembers(ParserContext *ctx, StructualMember *members);
@@ -121,11 +122,11 @@ typedef struct _Symbol {
     };
 } Symbol;
 
+#define SCOPE_INITIAL_CAPACITY 8
+
 typedef struct _Scope {
     struct _Scope* parent;
-    HashMap* symbols;
-
-    struct _Scope *next;
+    HashMap* symbols; // lives in type arena together with scope
 } Scope;
 
 void verifyFunctionReturnType(ParserContext *ctx, Declarator *declarator, TypeRef *returnType);
@@ -156,5 +157,7 @@ TypeRef *makeErrorRef(ParserContext *ctx);
 
 int stringHashCode(intptr_t v);
 int stringCmp(intptr_t v1, intptr_t v2);
+int typeRefHashCode(intptr_t v);
+int typeRefCmp(intptr_t v1, intptr_t v2);
 
 #endif // __SEMA_H__
@@ -104,11 +104,13 @@ enum Tokens {
 
 struct _Token;
 struct _LocationInfo;
+struct _LineTable;
 
 const char* tokenName(int token);
 const char* tokenNameInBuffer(int token, char* buff);
 
 
+unsigned lineTableLookup(struct _LineTable *lines, unsigned pos);
 unsigned tokenRawLine(struct _Token *t);
 
 void fileAndLine(struct _Token *token, unsigned *linePtr, const char **filePtr);
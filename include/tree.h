@@ -169,6 +169,7 @@ typedef struct _AstExpression {
   Coordinates coordinates;
   ExpressionType op;
   TypeRef *type;
+  AstConst *evaluated; // memoised by eval
   union {
     AstConst constExpr;
     AstUnaryExpression unaryExpr;
@@ -469,6 +470,7 @@ typedef struct _TypeDefinition {
     StructualMember *members; // struct or enum
     TypeRef *type;
   };
+  HashMap *memberIndex; // name -> member including ones of anonymous members, see indexStructualMembers
   struct _TypeDefinition *next;
 } TypeDefiniton;
 
@@ -576,6 +578,9 @@ AstExpression *deparen(AstExpression *expr);
 
 //Factories
 
+// arena for AST nodes, it is the current function body arena in pipeline mode
+struct _Arena *astNodeArena(struct _ParserContext *ctx);
+
 // types
 
 TypeDesc *createTypeDescriptor(struct _ParserContext *ctx, TypeId typeId, const char *name, int size);
@@ -625,7 +630,7 @@ AstExpression *createErrorExpression(struct _ParserContext *ctx, Coordinates *co
 
 AstStatement *createBlockStatement(struct _ParserContext *ctx, Coordinates *coords, struct _Scope *scope, AstStatementList *stmts, TypeRef *type);
 AstStatement *createExprStatement(struct _ParserContext *ctx, AstExpression* expression);
-AstStatement *createLabelStatement(struct _ParserContext *ctx, Coordinates *coords, LabelKind labelKind, AstStatement *body, const char *label, int c);
+AstStatement *createLabelStatement(struct _ParserContext *ctx, Coordinates *coords, LabelKind labelKind, AstStatement *body, const char *label, int64_t c);
 AstStatement *createDeclStatement(struct _ParserContext *ctx, Coordinates *coords, AstDeclaration *decl);
 AstStatement *createIfStatement(struct _ParserContext *ctx, Coordinates *coords, AstExpression *cond, AstStatement *thenB, AstStatement *elseB);
 AstStatement *createSwitchStatement(struct _ParserContext *ctx, Coordinates *coords, AstExpression *cond, AstStatement *body, unsigned caseCount, unsigned hasDefault);
@@ -34,8 +34,11 @@ typedef int (*hashCode_fun)(intptr_t);
 typedef int (*compare_fun)(intptr_t, intptr_t);
 
 typedef struct _HashMap HashMap;
+struct _Arena;
 
 HashMap* createHashMap(int capacity, hashCode_fun hc, compare_fun cmp);
+/** map and its storage are allocated in arena, releaseHashMap does nothing for such maps */
+HashMap* createArenaHashMap(struct _Arena *arena, int capacity, hashCode_fun hc, compare_fun cmp);
 void releaseHashMap(HashMap *map);
 
 /** returns old value if exixtsed, NULL otherwise */
@@ -46,10 +49,29 @@ intptr_t getFromHashMap(HashMap* map, intptr_t key);
 /** returns removed value if found, NULL otherwise */
 intptr_t removeFromHashMap(HashMap* map, intptr_t key);
 
+/** func may remove entries from map but must not put new ones */
 void foreachHashMap(HashMap *map, void (*func)(intptr_t, intptr_t, void*), void *ctx);
 
 int isInHashMap(HashMap* map, intptr_t key);
 
+unsigned hashMapSize(HashMap *map);
+
+/** spreads hash codes since many of them are weak in low bits */
+unsigned mixHash(unsigned h);
+
+/**
+ * Atoms are interned strings. Every distinct spelling is stored only once per process
+ * together with its precomputed hash, so atoms could be compared by pointer.
+ */
+const char *internString(const char *s, size_t length);
+const char *internCString(const char *s);
+
+/** hash map callbacks for maps keyed by atoms */
+int atomHashCode(intptr_t v);
+int atomCmp(intptr_t v1, intptr_t v2);
+
+void printAtomsStatistic(FILE *output);
+
 typedef struct _LinkedListNode {
     intptr_t data;
 
@@ -80,6 +102,7 @@ typedef struct {
 } StringBuffer;
 
 void putSymbol(StringBuffer *b, char c);
+void putSymbols(StringBuffer *b, const char *s, size_t n);
 
 
 typedef struct {
@@ -106,8 +129,7 @@ int compareBitSets(const BitSet *lhs, const BitSet *rhs);
 Boolean isEmptyBitSet(const BitSet *bs);
 size_t countBits(const BitSet *bs);
 
-unsigned countLinesInBuffer(const char *buffer);
-char *readFileToBuffer(const char *fileName, size_t *bufferSize);
+const char *readFileToBuffer(const char *fileName, size_t *bufferSize);
 
 int isPowerOf2(intptr_t v);
 int log2Integer(intptr_t v);
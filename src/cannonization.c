@@ -9,6 +9,15 @@ static AstExpression *transformExpression(ParserContext *ctx, AstExpression *exp
 static AstStatement *transformStatement(ParserContext *ctx, AstStatement *stmt);
 static AstInitializer *transformInitializer(ParserContext *ctx, AstInitializer *init);
 
+// reassociated constants may overflow where the source expression does not, so keep it quiet
+static AstConst *evalReassociated(ParserContext *ctx, AstExpression *expr) {
+  unsigned oldSilentMode = ctx->stateFlags.silentMode;
+  ctx->stateFlags.silentMode = 1;
+  AstConst *evaluated = eval(ctx, expr);
+  ctx->stateFlags.silentMode = oldSilentMode;
+  return evaluated;
+}
+
 static TypeRef *voidPtrType(ParserContext *ctx) {
   return makePointedType(ctx, 0U, makePrimitiveType(ctx, T_VOID, 0));
 }
@@ -137,7 +146,7 @@ static AstExpression *cannonizeBinaryExpression(ParserContext *ctx, AstExpressio
                 if (left->op == EB_DIV) newOp = EB_MUL;
 
                 left->op = newOp;
-                AstConst *evaluated = eval(ctx, left);
+                AstConst *evaluated = evalReassociated(ctx, left);
                 assert(evaluated);
                 expr->binaryExpr.right = createAstConst2(ctx, &right->coordinates, right->type, evaluated);
             }
@@ -159,7 +168,7 @@ static AstExpression *cannonizeBinaryExpression(ParserContext *ctx, AstExpressio
               expr->op = EB_ADD;
               left->op = EB_SUB;
 
-              AstConst *evaluated = eval(ctx, left);
+              AstConst *evaluated = evalReassociated(ctx, left);
               assert(evaluated);
               expr->binaryExpr.right = createAstConst2(ctx, &right->coordinates, right->type, evaluated);
 
@@ -180,7 +189,7 @@ static AstExpression *cannonizeBinaryExpression(ParserContext *ctx, AstExpressio
 
               expr->op = EB_SUB;
 
-              AstConst *evaluated = eval(ctx, left);
+              AstConst *evaluated = evalReassociated(ctx, left);
               assert(evaluated);
               expr->binaryExpr.right = createAstConst2(ctx, &right->coordinates, right->type, evaluated);
 
@@ -617,7 +626,7 @@ static AstExpression *cannonizeShiftExpression(ParserContext *ctx, AstExpression
 
     left = cannonizeAddExpression(ctx, left);
 
-    AstConst *evaluated = eval(ctx, left);
+    AstConst *evaluated = evalReassociated(ctx, left);
 
     if (evaluated) {
         left = createAstConst2(ctx, &left->coordinates, left->type, evaluated);
@@ -677,7 +686,10 @@ static AstExpression *transformExpression(ParserContext *ctx, AstExpression *exp
 
   AstConst *evaluated = eval(ctx, expr);
   if (evaluated) {
-      return createAstConst2(ctx, &expr->coordinates, expr->type, evaluated);
+      // fold in place, the node keeps its type and coordinates
+      expr->op = E_CONST;
+      expr->constExpr = *evaluated;
+      return expr;
   }
 
   ExpressionType op2 = E_ERROR;
@@ -898,25 +910,43 @@ static AstStatement *transformStatement(ParserContext *ctx, AstStatement *stmt)
   return stmt;
 }
 
+static void cannonizeTranslationUnit(ParserContext *ctx, AstTranslationUnit *unit) {
+  if (unit->kind == TU_FUNCTION_DEFINITION) {
+      AstFunctionDefinition *def = unit->definition;
+      transformStatement(ctx, def->body);
+  } else {
+      AstDeclaration *d = unit->declaration;
+      if (d->kind == DK_VAR) {
+          AstValueDeclaration *v = d->variableDeclaration;
+          if (v->initializer) {
+              v->initializer = transformInitializer(ctx, v->initializer);
+          }
+      }
+  }
+}
+
 void cannonizeAstFile(ParserContext *ctx, AstFile *file) {
+  AstTranslationUnit *unit = file->units;
+
+  while (unit) {
+      cannonizeTranslationUnit(ctx, unit);
+      unit = unit->next;
+  }
+}
 
+/**
+ * Canonicalizes units added to the file after 'done' and returns the last one.
+ * Trees with errors are never generated so they are left as parsed.
+ */
+AstTranslationUnit *cannonizeParsedUnits(ParserContext *ctx, AstFile *file, AstTranslationUnit *done) {
+  if (ctx->diagnostics.errorCount) return file->last;
 
-  AstTranslationUnit *unit = file->units;
+  AstTranslationUnit *unit = done ? done->next : file->units;
 
   while (unit) {
-      if (unit->kind == TU_FUNCTION_DEFINITION) {
-          AstFunctionDefinition *def = unit->definition;
-          transformStatement(ctx, def->body);
-      } else {
-          AstDeclaration *d = unit->declaration;
-          if (d->kind == DK_VAR) {
-              AstValueDeclaration *v = d->variableDeclaration;
-              if (v->initializer) {
-                  v->initializer = transformInitializer(ctx, v->initializer);
-              }
-          }
-      }
+      cannonizeTranslationUnit(ctx, unit);
       unit = unit->next;
   }
 
+  return file->last;
 }
@@ -6,6 +6,7 @@
 
 #include <alloca.h>
 #include <assert.h>
+#include <stdlib.h>
 
 GeneratedFile *allocateGenFile(GenerationContext *ctx) {
   return areanAllocate(ctx->codegenArena, sizeof (GeneratedFile));
@@ -14,7 +15,7 @@ GeneratedFile *allocateGenFile(GenerationContext *ctx) {
 GeneratedFunction *allocateGenFunction(GenerationContext *ctx) {
   GeneratedFunction *f = areanAllocate(ctx->codegenArena, sizeof (GeneratedFunction));
   f->returnStructAddressOffset = -1;
-  f->arena = ctx->codegenArena;
+  f->arena = ctx->scratchArena;
   f->section = ctx->text;
   f->sectionOffset = (ctx->text->pc - ctx->text->start);
   f->context = ctx;
@@ -162,14 +163,7 @@ static void writeObjFile(const char *sourceFileName, const char *outputFile, uin
   }
 }
 
-void buildElfFile(GenerationContext *ctx, AstFile *astFile, GeneratedFile *genFile, ElfFile *elfFile) {
-
-  size_t elfFileSize = 0;
-
-  uint8_t *elfFileBytes = generateElfFile(elfFile, genFile, &elfFileSize);
-
-  writeObjFile(astFile->fileName, ctx->parserContext->config->outputFile, elfFileBytes, elfFileSize);
-
+static void releaseSections(ElfFile *elfFile) {
   releaseHeap(elfFile->sections.asStruct.nullSection->start);
   releaseHeap(elfFile->sections.asStruct.text->start);
   releaseHeap(elfFile->sections.asStruct.reText->start);
@@ -183,11 +177,22 @@ void buildElfFile(GenerationContext *ctx, AstFile *astFile, GeneratedFile *genFi
   releaseHeap(elfFile->sections.asStruct.symtab->start);
   releaseHeap(elfFile->sections.asStruct.strtab->start);
   releaseHeap(elfFile->sections.asStruct.shstrtab->start);
+}
+
+void buildElfFile(GenerationContext *ctx, const char *fileName, GeneratedFile *genFile, ElfFile *elfFile) {
+
+  size_t elfFileSize = 0;
+
+  uint8_t *elfFileBytes = generateElfFile(elfFile, genFile, &elfFileSize);
+
+  writeObjFile(fileName, ctx->parserContext->config->outputFile, elfFileBytes, elfFileSize);
+
+  releaseSections(elfFile);
 
   releaseHeap(elfFileBytes);
 }
 
-GeneratedFile *generateCodeForFile(ParserContext *pctx, ArchCodegen *archCodegen, AstFile *astFile) {
+FileCodegen *startFileCodegen(ParserContext *pctx, ArchCodegen *archCodegen, const char *fileName) {
     Section nullSection = { "", SHT_NULL, 0x00, 0 };
     Section text = { ".text", SHT_PROGBITS, SHF_EXECINSTR | SHF_ALLOC, 1 }, reText = { ".rela.text", SHT_RELA, SHF_INFO_LINK, 8 };
     Section data = { ".data", SHT_PROGBITS, SHF_WRITE | SHF_ALLOC, 16 };
@@ -199,50 +204,85 @@ GeneratedFile *generateCodeForFile(ParserContext *pctx, ArchCodegen *archCodegen
     Section strtab = { ".strtab", SHT_STRTAB, 0x00, 1 };
     Section shstrtab = { ".shstrtab", SHT_STRTAB, 0x00, 1 };
 
-    ElfFile elfFile = { 0 };
-    elfFile.sections.asStruct.nullSection = &nullSection;
-    elfFile.sections.asStruct.text = &text;
-    elfFile.sections.asStruct.reText = &reText; reText.relocatedSection = &text;
-    elfFile.sections.asStruct.data = &data;
-    elfFile.sections.asStruct.bss = &bss;
-    elfFile.sections.asStruct.rodata = &rodata;
-    elfFile.sections.asStruct.rodataLocal = &roDataLocal;
-    elfFile.sections.asStruct.reRodataLocal = &reRoDataLocal; reRoDataLocal.relocatedSection = &roDataLocal;
-    elfFile.sections.asStruct.dataLocal = &dataLocal;
-    elfFile.sections.asStruct.reDataLocal = &reDataLocal; reDataLocal.relocatedSection = &dataLocal;
-    elfFile.sections.asStruct.symtab = &symtab;
-    elfFile.sections.asStruct.strtab = &strtab;
-    elfFile.sections.asStruct.shstrtab = &shstrtab;
-
-    GenerationContext ctx = { pctx, NULL, pctx->memory.codegenArena };
-    GeneratedFile *file = allocateGenFile(&ctx);
-    ctx.file = file;
-    file->name = astFile->fileName;
-
-    Symbol *memsetSymbol = findSymbol(pctx, "memset");
+    assert(archCodegen->generateFunction != NULL);
+    assert(archCodegen->generateVaribale != NULL);
+
+    FileCodegen *cg = (FileCodegen *)heapAllocate(sizeof (FileCodegen));
+    cg->archCodegen = archCodegen;
+    cg->fileName = fileName;
+
+    cg->sections.nullSection = nullSection;
+    cg->sections.text = text;
+    cg->sections.reText = reText;
+    cg->sections.data = data;
+    cg->sections.bss = bss;
+    cg->sections.rodata = rodata;
+    cg->sections.dataLocal = dataLocal;
+    cg->sections.reDataLocal = reDataLocal;
+    cg->sections.roDataLocal = roDataLocal;
+    cg->sections.reRoDataLocal = reRoDataLocal;
+    cg->sections.symtab = symtab;
+    cg->sections.strtab = strtab;
+    cg->sections.shstrtab = shstrtab;
+
+    ElfFile *elfFile = &cg->elfFile;
+    elfFile->sections.asStruct.nullSection = &cg->sections.nullSection;
+    elfFile->sections.asStruct.text = &cg->sections.text;
+    elfFile->sections.asStruct.reText = &cg->sections.reText; cg->sections.reText.relocatedSection = &cg->sections.text;
+    elfFile->sections.asStruct.data = &cg->sections.data;
+    elfFile->sections.asStruct.bss = &cg->sections.bss;
+    elfFile->sections.asStruct.rodata = &cg->sections.rodata;
+    elfFile->sections.asStruct.rodataLocal = &cg->sections.roDataLocal;
+    elfFile->sections.asStruct.reRodataLocal = &cg->sections.reRoDataLocal; cg->sections.reRoDataLocal.relocatedSection = &cg->sections.roDataLocal;
+    elfFile->sections.asStruct.dataLocal = &cg->sections.dataLocal;
+    elfFile->sections.asStruct.reDataLocal = &cg->sections.reDataLocal; cg->sections.reDataLocal.relocatedSection = &cg->sections.dataLocal;
+    elfFile->sections.asStruct.symtab = &cg->sections.symtab;
+    elfFile->sections.asStruct.strtab = &cg->sections.strtab;
+    elfFile->sections.asStruct.shstrtab = &cg->sections.shstrtab;
+
+    GenerationContext *ctx = &cg->context;
+    ctx->parserContext = pctx;
+    ctx->codegenArena = pctx->memory.codegenArena;
+    ctx->scratchArena = pctx->memory.functionArena ? pctx->memory.functionArena : pctx->memory.codegenArena;
+
+    GeneratedFile *file = allocateGenFile(ctx);
+    ctx->file = file;
+    file->name = fileName;
+
+    Symbol *memsetSymbol = findSymbol(pctx, internCString("memset"));
     if (memsetSymbol == NULL || memsetSymbol->kind != FunctionSymbol) {
         memsetSymbol = newSymbol(pctx, FunctionSymbol, "memset");
     }
 
-    ctx.memsetSymbol = memsetSymbol;
+    ctx->memsetSymbol = memsetSymbol;
 
-    initConstCache(&ctx);
+    Symbol *memcpySymbol = findSymbol(pctx, internCString("memcpy"));
+    if (memcpySymbol == NULL || memcpySymbol->kind != FunctionSymbol) {
+        memcpySymbol = newSymbol(pctx, FunctionSymbol, "memcpy");
+    }
 
-    ctx.text = &text;
-    ctx.bss = &bss;
-    ctx.rodata = &rodata;
-    ctx.data = &data;
-    ctx.dataLocal = &dataLocal;
-    ctx.rodataLocal = &roDataLocal;
+    ctx->memcpySymbol = memcpySymbol;
 
-    AstTranslationUnit *unit = astFile->units;
+    initConstCache(ctx);
 
-    assert(archCodegen->generateFunction != NULL);
-    assert(archCodegen->generateVaribale != NULL);
+    ctx->text = &cg->sections.text;
+    ctx->bss = &cg->sections.bss;
+    ctx->rodata = &cg->sections.rodata;
+    ctx->data = &cg->sections.data;
+    ctx->dataLocal = &cg->sections.dataLocal;
+    ctx->rodataLocal = &cg->sections.roDataLocal;
+
+    return cg;
+}
+
+void generateUnits(FileCodegen *cg, AstTranslationUnit *unit) {
+    GenerationContext *ctx = &cg->context;
+    ArchCodegen *archCodegen = cg->archCodegen;
+    GeneratedFile *file = ctx->file;
 
     while (unit) {
       if (unit->kind == TU_FUNCTION_DEFINITION) {
-          GeneratedFunction *f = archCodegen->generateFunction(&ctx, unit->definition);
+          GeneratedFunction *f = archCodegen->generateFunction(ctx, unit->definition);
           unit->definition->declaration->gen = f;
           unit->definition->declaration->symbol->function->gen = f;
 
@@ -257,7 +297,7 @@ GeneratedFile *generateCodeForFile(ParserContext *pctx, ArchCodegen *archCodegen
           assert(unit->kind == TU_DECLARATION);
           AstDeclaration *d = unit->declaration;
           if (d->kind == DK_VAR) {
-            GeneratedVariable *v = archCodegen->generateVaribale(&ctx, d->variableDeclaration);
+            GeneratedVariable *v = archCodegen->generateVaribale(ctx, d->variableDeclaration);
             if (v) {
               d->variableDeclaration->gen = v;
 
@@ -273,10 +313,25 @@ GeneratedFile *generateCodeForFile(ParserContext *pctx, ArchCodegen *archCodegen
       }
       unit = unit->next;
     }
+}
 
-    buildElfFile(&ctx, astFile, file, &elfFile);
+void finishFileCodegen(FileCodegen *cg, Boolean writeObject) {
+    if (writeObject) {
+        buildElfFile(&cg->context, cg->fileName, cg->context.file, &cg->elfFile);
+    } else {
+        releaseSections(&cg->elfFile);
+    }
 
-    releaseConstCache(&ctx);
+    releaseConstCache(&cg->context);
+    releaseHeap(cg);
+}
+
+GeneratedFile *generateCodeForFile(ParserContext *pctx, ArchCodegen *archCodegen, AstFile *astFile) {
+    FileCodegen *cg = startFileCodegen(pctx, archCodegen, astFile->fileName);
+
+    generateUnits(cg, astFile->units);
+
+    finishFileCodegen(cg, TRUE);
 
     return NULL;
 }
@@ -430,11 +485,77 @@ ptrdiff_t emitStringWithEscaping(GenerationContext *ctx, Section *section, AstCo
       emitSectionByte(section, str[idx]);
   }
 
-  putToHashMap(ctx->constCache.literalMap, (intptr_t)_const, (intptr_t)(sectionOffset + 1));
+  // the key has to outlive a function body AST
+  AstConst *key = (AstConst *)areanAllocate(ctx->codegenArena, sizeof (AstConst));
+  *key = *_const;
+  putToHashMap(ctx->constCache.literalMap, (intptr_t)key, (intptr_t)(sectionOffset + 1));
 
   return sectionOffset;
 }
 
+// =========== Switch lowering ===============================//
+
+#define SWITCH_KEY_BIAS 0x8000000000000000ULL
+#define SWITCH_LINEAR_LIMIT 3
+#define SWITCH_TABLE_MIN_DENSITY 40 // percent of table slots which lead to their own case
+#define SWITCH_TABLE_MAX_SPAN 0x10000
+
+static int compareSwitchCases(const void *a, const void *b) {
+  uint64_t ka = ((const SwitchCase *)a)->key;
+  uint64_t kb = ((const SwitchCase *)b)->key;
+  if (ka < kb) return -1;
+  return ka > kb ? 1 : 0;
+}
+
+void sortSwitchCases(SwitchCase *cases, struct CaseLabel *labels, unsigned count, TypeId tid) {
+  unsigned i;
+  for (i = 0; i < count; ++i) {
+      int64_t v = labels[i].caseConst;
+      switch (tid) {
+      case T_S8: cases[i].key = (uint64_t)v ^ SWITCH_KEY_BIAS; break;
+      case T_U8: cases[i].key = (uint64_t)v; break;
+      case T_U4: v = (uint32_t)v; cases[i].key = (uint64_t)v; break;
+      default: v = (int32_t)v; cases[i].key = (uint64_t)v ^ SWITCH_KEY_BIAS; break;
+      }
+      cases[i].value = v;
+      cases[i].label = &labels[i].label;
+  }
+
+  qsort(cases, count, sizeof(SwitchCase), &compareSwitchCases);
+}
+
+enum SwitchStrategy selectSwitchStrategy(const SwitchCase *cases, unsigned count) {
+  if (count <= SWITCH_LINEAR_LIMIT) return SS_LINEAR;
+
+  uint64_t span = cases[count - 1].key - cases[0].key;
+  if (span < SWITCH_TABLE_MAX_SPAN && (uint64_t)count * 100 >= (span + 1) * SWITCH_TABLE_MIN_DENSITY) {
+      return SS_TABLE;
+  }
+
+  return SS_SPLIT;
+}
+
+// split point is the widest gap between neighbour cases in the middle half so dense clusters stay together
+unsigned splitSwitchCases(const SwitchCase *cases, unsigned count) {
+  unsigned from = count / 4, to = count - count / 4;
+  unsigned result = count / 2, i;
+  uint64_t widest = 0;
+
+  if (from == 0) from = 1;
+
+  for (i = from; i < to; ++i) {
+      uint64_t gap = cases[i].key - cases[i - 1].key;
+      if (gap > widest) {
+          widest = gap;
+          result = i;
+      }
+  }
+
+  return result;
+}
+
+// =========== Switch lowering ===============================//
+
 static Boolean hasRelocationsExpr(AstExpression *expr) {
   switch (expr->op) {
   case E_CONST: return expr->constExpr.op == CK_STRING_LITERAL ? TRUE : FALSE;
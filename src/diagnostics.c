@@ -41,7 +41,8 @@ static LocationInfo *findLocationInfo(ParserContext *ctx, const char *fileName)
   LocationInfo *locInfo = ctx->locationInfo;
 
   while (locInfo) {
-      if (strcmp(fileName, locInfo->fileInfo.fileName) == 0) break;
+      if (locInfo->kind == LIK_FILE && strcmp(fileName, locInfo->fileInfo.fileName) == 0) break;
+      locInfo = locInfo->next;
   }
 
   return locInfo;
@@ -63,24 +64,13 @@ static void computeLineAndCollumn(ParserContext *ctx, LocationInfo *locInfo, int
 
   assert(locInfo->kind == LIK_FILE);
 
-  unsigned *lineMap = locInfo->fileInfo.linesPos;
+  unsigned *lineMap = locInfo->fileInfo.lines->positions;
   assert(lineMap != NULL);
 
   unsigned pos = (unsigned)_pos;
 
-  unsigned lineMax = locInfo->fileInfo.lineno;
-  unsigned lineNum = 0;
-  unsigned lineOffset = 0;
-  unsigned previousLine = 0;
-
-
-  for (lineNum = 0; lineNum < lineMax; ++lineNum) {
-      lineOffset = lineMap[lineNum];
-      if (pos < lineOffset) break;
-  }
-
-  --lineNum;
-  lineOffset = lineMap[lineNum];
+  unsigned lineNum = lineTableLookup(locInfo->fileInfo.lines, pos) - 1;
+  unsigned lineOffset = lineMap[lineNum];
 
   *line = lineNum + 1;
   *col = pos - lineOffset + 1;
@@ -255,6 +245,9 @@ void reportDiagnostic(ParserContext *ctx, enum DiagnosticId diag, const Coordina
 
   ctx->diagnostics.tail = newDiagnostic;
   ctx->diagnostics.count += 1;
+  if (getSeverity(descriptor->severityKind)->isError) {
+      ctx->diagnostics.errorCount += 1;
+  }
 }
 
 #define ANSI_COLOR_RESET   "\x1b[0m"
@@ -5,353 +5,235 @@
 #include "tree.h"
 #include "sema.h"
 
-static Boolean derefIntConst(AstConst *astConst, int64_const_t *result) {
-  if (astConst->op == CK_INT_CONST) {
-      *result = astConst->i;
-      return TRUE;
+// =========== Operator table ===============================//
+
+typedef enum _EvalOpKind {
+  EOK_NONE,       // not foldable
+  EOK_ARITH,      // int or float operands, result of the same kind
+  EOK_INTEGER,    // int operands only
+  EOK_DIVISION,   // arithmetic with division by zero check
+  EOK_RELATION,   // int or float operands, int result
+  EOK_LOGICAL     // any scalar operands, int result
+} EvalOpKind;
+
+static const uint8_t binaryOpKinds[E_NUM_OF_OPS] = {
+  [EB_ADD] = EOK_ARITH,
+  [EB_SUB] = EOK_ARITH,
+  [EB_MUL] = EOK_ARITH,
+  [EB_DIV] = EOK_DIVISION,
+  [EB_MOD] = EOK_DIVISION,
+  [EB_LHS] = EOK_INTEGER,
+  [EB_RHS] = EOK_INTEGER,
+  [EB_AND] = EOK_INTEGER,
+  [EB_XOR] = EOK_INTEGER,
+  [EB_OR] = EOK_INTEGER,
+  [EB_ANDAND] = EOK_LOGICAL,
+  [EB_OROR] = EOK_LOGICAL,
+  [EB_EQ] = EOK_RELATION,
+  [EB_NE] = EOK_RELATION,
+  [EB_LT] = EOK_RELATION,
+  [EB_LE] = EOK_RELATION,
+  [EB_GT] = EOK_RELATION,
+  [EB_GE] = EOK_RELATION
+};
+
+static int64_const_t evalIntegerOp(ExpressionType op, Boolean isU, int64_const_t l, int64_const_t r) {
+  sint64_const_t sl = (sint64_const_t)l, sr = (sint64_const_t)r;
+  switch (op) {
+    case EB_ADD: return l + r;
+    case EB_SUB: return l - r;
+    case EB_MUL: return l * r;
+    case EB_DIV: return isU ? l / r : (int64_const_t)(sl / sr);
+    case EB_MOD: return isU ? l % r : (int64_const_t)(sl % sr);
+    case EB_LHS: return l << r;
+    case EB_RHS: return isU ? l >> r : (int64_const_t)(sl >> sr);
+    case EB_AND: return l & r;
+    case EB_XOR: return l ^ r;
+    case EB_OR: return l | r;
+    case EB_ANDAND: return l && r;
+    case EB_OROR: return l || r;
+    case EB_EQ: return l == r;
+    case EB_NE: return l != r;
+    case EB_LT: return isU ? l < r : sl < sr;
+    case EB_LE: return isU ? l <= r : sl <= sr;
+    case EB_GT: return isU ? l > r : sl > sr;
+    case EB_GE: return isU ? l >= r : sl >= sr;
+    default: unreachable("Unexpected integer operator");
   }
-
-  return FALSE;
+  return 0;
 }
 
-static Boolean derefFloatConst(AstConst *astConst, float80_const_t *result) {
-  if (astConst->op == CK_FLOAT_CONST) {
-      *result = astConst->f;
-      return TRUE;
+static float80_const_t evalFloatOp(ExpressionType op, float80_const_t l, float80_const_t r) {
+  switch (op) {
+    case EB_ADD: return l + r;
+    case EB_SUB: return l - r;
+    case EB_MUL: return l * r;
+    case EB_DIV: return l / r;
+    default: unreachable("Unexpected float operator");
   }
-  return FALSE;
-}
-
-// int -> int
-
-static int64_const_t ee_i_u_minus(int64_const_t i) {
-  return -i;
-}
-
-static int64_const_t ee_i_u_tilda(int64_const_t i) {
-  return ~i;
-}
-
-static int64_const_t ee_i_u_exl(int64_const_t i) {
-  return !i;
-}
-
-static int64_const_t ee_i_u_inc(int64_const_t i) {
-  return i + 1;
-}
-
-static int64_const_t ee_i_u_dec(int64_const_t i) {
-  return i - 1;
-}
-
-// float -> float
-
-static float80_const_t ee_f_u_minus(float80_const_t f) {
-  return -f;
-}
-
-//static float80_const_t ee_f_u_tilda(float80_const_t f) {
-//  return ~f;
-//}
-
-static float80_const_t ee_f_u_exl(float80_const_t f) {
-  return !f;
-}
-
-static float80_const_t ee_f_u_inc(float80_const_t f) {
-  return f + 1.0f;
-}
-
-static float80_const_t ee_f_u_dec(float80_const_t f) {
-  return f - 1.0f;
-}
-
-// int, int -> int
-
-static int64_const_t ee_i_b_plus_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l + (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_minus_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l - (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_mul_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l * (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_div_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l / (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_mod_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l % (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_lhs_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l << (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_rhs_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l >> (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_and_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l & (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_or_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l | (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_xor_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l ^ (sint64_const_t)r;
-}
-
-// unsigned, unsigned -> unsigned
-
-static int64_const_t ee_i_b_plus_u(int64_const_t l, int64_const_t r) {
-  return l + r;
-}
-
-static int64_const_t ee_i_b_minus_u(int64_const_t l, int64_const_t r) {
-  return l - r;
-}
-
-static int64_const_t ee_i_b_mul_u(int64_const_t l, int64_const_t r) {
-  return l * r;
-}
-
-static int64_const_t ee_i_b_div_u(int64_const_t l, int64_const_t r) {
-  return l / r;
-}
-
-static int64_const_t ee_i_b_mod_u(int64_const_t l, int64_const_t r) {
-  return l % r;
-}
-
-static int64_const_t ee_i_b_lhs_u(int64_const_t l, int64_const_t r) {
-  return l << r;
-}
-
-static int64_const_t ee_i_b_rhs_u(int64_const_t l, int64_const_t r) {
-  return l >> r;
-}
-
-static int64_const_t ee_i_b_and_u(int64_const_t l, int64_const_t r) {
-  return l & r;
-}
-
-static int64_const_t ee_i_b_or_u(int64_const_t l, int64_const_t r) {
-  return l | r;
-}
-
-static int64_const_t ee_i_b_xor_u(int64_const_t l, int64_const_t r) {
-  return l ^ r;
-}
-
-
-static int64_const_t ee_i_b_andand(int64_const_t l, int64_const_t r) {
-  return l && r;
-}
-
-static int64_const_t ee_i_b_oror(int64_const_t l, int64_const_t r) {
-  return l || r;
-}
-
-static int64_const_t ee_i_b_eq(int64_const_t l, int64_const_t r) {
-  return l == r;
-}
-
-static int64_const_t ee_i_b_ne(int64_const_t l, int64_const_t r) {
-  int rs = l != r;
-  return rs;
-}
-
-static int64_const_t ee_i_b_lt_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l < (sint64_const_t)r;
+  return 0;
 }
 
-static int64_const_t ee_i_b_le_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l <= (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_gt_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l > (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_ge_s(int64_const_t l, int64_const_t r) {
-  return (sint64_const_t)l >= (sint64_const_t)r;
-}
-
-static int64_const_t ee_i_b_lt_u(int64_const_t l, int64_const_t r) {
-  return l < r;
+static int64_const_t evalFloatRelation(ExpressionType op, float80_const_t l, float80_const_t r) {
+  switch (op) {
+    case EB_ANDAND: return l && r;
+    case EB_OROR: return l || r;
+    case EB_EQ: return l == r;
+    case EB_NE: return l != r;
+    case EB_LT: return l < r;
+    case EB_LE: return l <= r;
+    case EB_GT: return l > r;
+    case EB_GE: return l >= r;
+    default: unreachable("Unexpected float relation");
+  }
+  return 0;
 }
 
-static int64_const_t ee_i_b_le_u(int64_const_t l, int64_const_t r) {
-  return l <= r;
-}
+// =========== Operator table ===============================//
 
-static int64_const_t ee_i_b_gt_u(int64_const_t l, int64_const_t r) {
-  return l > r;
-}
+// =========== Overflow check ===============================//
 
-static int64_const_t ee_i_b_ge_u(int64_const_t l, int64_const_t r) {
-  return l >= r;
+static sint64_const_t signExtendConst(int64_const_t v, int size) {
+  if (size >= 8) return (sint64_const_t)v;
+  unsigned shift = 64 - size * 8;
+  return (sint64_const_t)(v << shift) >> shift;
 }
 
-// float, float -> float
+static Boolean isSignedOverflow(ExpressionType op, int size, int64_const_t l, int64_const_t r, int64_const_t v) {
+  if (size < 8) {
+      return signExtendConst(v, size) != (sint64_const_t)v;
+  }
 
-static float80_const_t ee_f_b_plus(float80_const_t l, float80_const_t r) {
-  return l + r;
+  const int64_const_t signBit = 1ULL << 63;
+  switch (op) {
+    case EB_ADD: return ((l ^ v) & (r ^ v) & signBit) != 0;
+    case EB_SUB: return ((l ^ r) & (l ^ v) & signBit) != 0;
+    case EB_MUL:
+      if (l == 0) return FALSE;
+      if ((sint64_const_t)l == -1) return r == signBit;
+      return (sint64_const_t)v / (sint64_const_t)l != (sint64_const_t)r;
+    case EU_MINUS: return l == signBit;
+    default: return FALSE;
+  }
 }
 
-static float80_const_t ee_f_b_minus(float80_const_t l, float80_const_t r) {
-  return l - r;
-}
+static void checkSignedOverflow(ParserContext *ctx, AstExpression *expression, int64_const_t l, int64_const_t r, int64_const_t v) {
+  TypeRef *type = expression->type;
+  if (type == NULL || !isIntegerType(type) || isUnsignedType(type)) return;
 
-static float80_const_t ee_f_b_mul(float80_const_t l, float80_const_t r) {
-  return l * r;
+  int size = computeTypeSize(type);
+  if (isSignedOverflow(expression->op, size, l, r, v)) {
+      reportDiagnostic(ctx, DIAG_CONST_EXPR_OVERFLOW, &expression->coordinates, signExtendConst(v, size), type);
+  }
 }
 
-static float80_const_t ee_f_b_div(float80_const_t l, float80_const_t r) {
-  return l / r;
-}
+// =========== Overflow check ===============================//
 
-static int64_const_t ee_f_b_andand(float80_const_t l, float80_const_t r) {
-  return l && r;
-}
+// =========== Evaluation ===============================//
 
-static int64_const_t ee_f_b_oror(float80_const_t l, float80_const_t r) {
-  return l || r;
-}
+static Boolean evalExpression(ParserContext *ctx, AstExpression *expression, AstConst *result);
 
-static int64_const_t ee_f_b_eq(float80_const_t l, float80_const_t r) {
-  return l == r;
+static float80_const_t constToFloat(const AstConst *c) {
+  return c->op == CK_FLOAT_CONST ? c->f : (float80_const_t)(sint64_const_t)c->i;
 }
 
-static int64_const_t ee_f_b_ne(float80_const_t l, float80_const_t r) {
-  return l != r;
-}
+static Boolean evalBinary(ParserContext *ctx, AstExpression *expression, AstConst *result) {
+  ExpressionType op = expression->op;
+  EvalOpKind kind = binaryOpKinds[op];
+  AstExpression *leftExpr = expression->binaryExpr.left;
+  AstExpression *rightExpr = expression->binaryExpr.right;
+  AstConst left, right;
+
+  if (!evalExpression(ctx, leftExpr, &left)) return FALSE;
+  if (!evalExpression(ctx, rightExpr, &right)) return FALSE;
+
+  if (left.op == CK_STRING_LITERAL || right.op == CK_STRING_LITERAL ||
+      (kind == EOK_DIVISION && right.op == CK_INT_CONST && right.i == 0)) {
+      if (kind == EOK_RELATION || kind == EOK_LOGICAL) return FALSE;
+      // Do not evaluate division by zero or address arithmetic, but keep the folded operands
+      expression->binaryExpr.left = createAstConst2(ctx, &leftExpr->coordinates, leftExpr->type, &left);
+      expression->binaryExpr.right = createAstConst2(ctx, &rightExpr->coordinates, rightExpr->type, &right);
+      return FALSE;
+  }
 
-static int64_const_t ee_f_b_lt(float80_const_t l, float80_const_t r) {
-  return l < r;
-}
+  if (left.op == CK_FLOAT_CONST || right.op == CK_FLOAT_CONST) {
+      if (kind == EOK_INTEGER || op == EB_MOD) return FALSE; // cannot evaluate
+      float80_const_t lv = constToFloat(&left);
+      float80_const_t rv = constToFloat(&right);
+      if (kind == EOK_RELATION || kind == EOK_LOGICAL) {
+          result->op = CK_INT_CONST;
+          result->i = evalFloatRelation(op, lv, rv);
+      } else {
+          result->op = CK_FLOAT_CONST;
+          result->f = evalFloatOp(op, lv, rv);
+      }
+      return TRUE;
+  }
 
-static int64_const_t ee_f_b_le(float80_const_t l, float80_const_t r) {
-  return l <= r;
-}
+  Boolean isU;
+  if (kind == EOK_RELATION) {
+      isU = isUnsignedType(leftExpr->type) || isUnsignedType(rightExpr->type);
+  } else {
+      isU = isUnsignedType(expression->type);
+  }
 
-static int64_const_t ee_f_b_gt(float80_const_t l, float80_const_t r) {
-  return l > r;
-}
+  result->op = CK_INT_CONST;
+  result->i = evalIntegerOp(op, isU, left.i, right.i);
 
-static int64_const_t ee_f_b_ge(float80_const_t l, float80_const_t r) {
-  return l >= r;
-}
+  if (kind == EOK_ARITH && !isU) {
+      checkSignedOverflow(ctx, expression, left.i, right.i, result->i);
+  }
 
-static int no_checks(int64_const_t l, int64_const_t r) {
   return TRUE;
 }
 
-static int div_check(int64_const_t l, int64_const_t r) {
-  return r != 0;
-}
-
-typedef float80_const_t (*float_unary_evaluate)(float80_const_t);
-typedef int64_const_t (*int_unary_evaluate)(int64_const_t);
-
-typedef float80_const_t (*float_binary_evaluate)(float80_const_t, float80_const_t);
-typedef int64_const_t (*float2int_binary_evaluate)(float80_const_t, float80_const_t);
-typedef int64_const_t (*int_binary_evaluate)(int64_const_t, int64_const_t);
+static Boolean evalUnary(ParserContext *ctx, AstExpression *expression, AstConst *result) {
+  ExpressionType op = expression->op;
 
-typedef int (*evaluateChecker)(int64_const_t, int64_const_t);
+  if (!evalExpression(ctx, expression->unaryExpr.argument, result)) return FALSE;
 
-static Coordinates noCoords = { NULL, NULL };
+  if (op == EU_POST_INC || op == EU_POST_DEC || op == EU_PLUS || op == EU_REF)
+    return TRUE;
 
-static AstConst *evaluateUnaryConst(ParserContext *ctx, AstConst *expr, int_unary_evaluate eInt, float_unary_evaluate eFloat) {
-  if (expr->op == CK_FLOAT_CONST) {
-      if (eFloat == NULL) return NULL; // cannot evaluate
-      float80_const_t v = eFloat(expr->f);
-      return &createAstConst(ctx, &noCoords, expr->op, &v, 0)->constExpr;
-  } else {
-      int64_const_t v = 0;
-      derefIntConst(expr, &v);
-      v = eInt(v);
-      return &createAstConst(ctx, &noCoords, expr->op, &v, 0)->constExpr;
-  }
-}
+  if (result->op == CK_STRING_LITERAL) return FALSE;
 
-static AstConst *evaluateBinaryCondConst(ParserContext *ctx, AstConst *left, AstConst *right, evaluateChecker checker, int_binary_evaluate eInt, float2int_binary_evaluate eFloat) {
-  if (left->op == CK_FLOAT_CONST || right->op == CK_FLOAT_CONST) {
-      if (eFloat == NULL) return NULL; // cannot evaluate
-      float80_const_t lv, rv;
-      sint64_const_t iv = 0;
-      if (left->op == CK_FLOAT_CONST && right->op == CK_FLOAT_CONST) {
-          lv = left->f;
-          rv = right->f;
-      } else if (left->op != CK_FLOAT_CONST) {
-          derefIntConst(left, (int64_const_t *)&iv);
-          lv = (float80_const_t)iv;
-          rv = right->f;
-      } else {
-          derefIntConst(right, (int64_const_t *)&iv);
-          lv = left->f;
-          rv = (float80_const_t)iv;
-      }
-      int64_const_t v = eFloat(lv, rv);
-      return &createAstConst(ctx, &noCoords, CK_INT_CONST, &v, 0)->constExpr;
-  } else {
-      int64_const_t lv = 0, rv = 0;
-      derefIntConst(left, &lv);
-      derefIntConst(right, &rv);
-      if (checker(lv, rv)) {
-        int64_const_t v = eInt(lv, rv);
-        return &createAstConst(ctx, &noCoords, CK_INT_CONST, &v, 0)->constExpr;
+  if (result->op == CK_FLOAT_CONST) {
+      float80_const_t f = result->f;
+      switch (op) {
+        case EU_PRE_INC: result->f = f + 1.0f; break;
+        case EU_PRE_DEC: result->f = f - 1.0f; break;
+        case EU_MINUS: result->f = -f; break;
+        case EU_EXL: result->f = !f; break;
+        default: return FALSE; // only for int
       }
-      return NULL;
+      return TRUE;
   }
-}
 
-static AstConst *evaluateBinaryConst(ParserContext *ctx, AstConst *left, AstConst *right, evaluateChecker checker, int_binary_evaluate eInt, float_binary_evaluate eFloat) {
-  if (left->op == CK_FLOAT_CONST || right->op == CK_FLOAT_CONST) {
-      if (eFloat == NULL) return NULL; // cannot evaluate
-      float80_const_t lv, rv;
-      sint64_const_t iv = 0;
-      if (left->op == CK_FLOAT_CONST && right->op == CK_FLOAT_CONST) {
-          lv = left->f;
-          rv = right->f;
-      } else if (left->op != CK_FLOAT_CONST) {
-          derefIntConst(left, (int64_const_t *)&iv);
-          lv = (float80_const_t)iv;
-          rv = right->f;
-      } else {
-          derefIntConst(right, (int64_const_t *)&iv);
-          lv = left->f;
-          rv = (float80_const_t)iv;
-      }
-      float80_const_t v = eFloat(lv, rv);
-      return &createAstConst(ctx, &noCoords, CK_FLOAT_CONST, &v, 0)->constExpr;
-  } else {
-      int64_const_t lv = 0, rv = 0;
-      derefIntConst(left, &lv);
-      derefIntConst(right, &rv);
-      if (checker(lv, rv)) {
-        int64_const_t v = eInt(lv, rv);
-        return &createAstConst(ctx, &noCoords, CK_INT_CONST, &v, 0)->constExpr;
-      }
-      return NULL;
+  int64_const_t i = result->i;
+  switch (op) {
+    case EU_PRE_INC: result->i = i + 1; break;
+    case EU_PRE_DEC: result->i = i - 1; break;
+    case EU_MINUS:
+      result->i = -i;
+      checkSignedOverflow(ctx, expression, i, 0, result->i);
+      break;
+    case EU_TILDA: result->i = ~i; break;
+    case EU_EXL: result->i = !i; break;
+    default: return FALSE;
   }
+
+  return TRUE;
 }
 
-static AstConst* evalCast(ParserContext *ctx, TypeRef *toType, AstConst *arg) {
+static Boolean evalCast(ParserContext *ctx, TypeRef *toType, AstConst *arg) {
   if (toType->kind == TR_POINTED) {
       // TODO: think about const address representation
-      arg->i = (intptr_t)arg->i;
-      return arg;
+      if (arg->op == CK_INT_CONST) arg->i = (intptr_t)arg->i;
+      return TRUE;
   }
 
   if (toType->kind == TR_VALUE) {
+     if (arg->op == CK_STRING_LITERAL) return FALSE;
      TypeDesc *desc = toType->descriptorDesc;
      switch (desc->typeId) {
        case T_BOOL:
@@ -404,175 +286,113 @@ static AstConst* evalCast(ParserContext *ctx, TypeRef *toType, AstConst *arg) {
          arg->op = CK_FLOAT_CONST;
          break;
        default:
-         return NULL;
+         return FALSE;
      }
   }
 
-  return arg;
+  return TRUE;
 }
 
-static AstConst *evalStmt(ParserContext *ctx, AstStatement *stmt) {
+static Boolean evalStmt(ParserContext *ctx, AstStatement *stmt, AstConst *result) {
   switch (stmt->statementKind) {
-    case SK_EXPR_STMT: return eval(ctx, stmt->exprStmt.expression);
+    case SK_EXPR_STMT: return evalExpression(ctx, stmt->exprStmt.expression, result);
     case SK_BLOCK: {
         AstStatementList *n = stmt->block.stmts;
-        AstConst *e = NULL;
+        if (n == NULL) return FALSE;
         for (; n; n = n->next) {
-            e = evalStmt(ctx, n->stmt);
-            if (e == NULL) return NULL;
+            if (!evalStmt(ctx, n->stmt, result)) return FALSE;
         }
-        return e;
+        return TRUE;
     }
-    default: return NULL;
+    default: return FALSE;
     }
 }
 
-AstConst* eval(ParserContext *ctx, AstExpression* expression) {
+/**
+ * Folds expression into result without allocating intermediate nodes.
+ * Reuses a result memoised on the node by a previous call to eval.
+ */
+static Boolean evalExpression(ParserContext *ctx, AstExpression *expression, AstConst *result) {
 
-  if (isErrorType(expression->type)) return NULL; // cannot evaluate error expression
+  if (expression->evaluated) {
+      *result = *expression->evaluated;
+      return TRUE;
+  }
+
+  if (isErrorType(expression->type)) return FALSE; // cannot evaluate error expression
 
-  int64_const_t ic;
-  float80_const_t fc;
-  float f = 4.2f;
-  float f2;
-  int ii;
   ExpressionType op = expression->op;
-  int_unary_evaluate un_i_eval = NULL;
-  float_unary_evaluate un_f_eval = NULL;
-  int_binary_evaluate bin_i_eval = NULL;
-  float_binary_evaluate bin_f_eval = NULL;
-  float2int_binary_evaluate bin_f2i_eval = NULL;
-  evaluateChecker chk_eval = no_checks;
 
-  Boolean isU = isUnsignedType(expression->type);
-  Boolean isDiv = FALSE;
+  if (binaryOpKinds[op] != EOK_NONE) {
+      return evalBinary(ctx, expression, result);
+  }
 
   switch (op) {
-    case E_CONST: return &expression->constExpr;
+    case E_CONST:
+      *result = expression->constExpr;
+      return TRUE;
     case EB_COMMA:
-      return eval(ctx, expression->binaryExpr.right);
-    case EB_ADD: bin_i_eval = isU ? ee_i_b_plus_u : ee_i_b_plus_s; bin_f_eval = ee_f_b_plus; goto binary;
-    case EB_SUB: bin_i_eval = isU ? ee_i_b_minus_u : ee_i_b_minus_s; bin_f_eval = ee_f_b_minus; goto binary;
-    case EB_MUL: bin_i_eval = isU ? ee_i_b_mul_u : ee_i_b_mul_s; bin_f_eval = ee_f_b_mul; goto binary;
-    case EB_DIV: bin_i_eval = isU ? ee_i_b_div_u : ee_i_b_div_s; bin_f_eval = ee_f_b_div; chk_eval = div_check; isDiv = TRUE; goto binary;
-    case EB_MOD: bin_i_eval = isU ? ee_i_b_mod_u : ee_i_b_mod_s; chk_eval = div_check; isDiv = TRUE; goto binary; // only int
-    case EB_LHS: bin_i_eval = isU ? ee_i_b_lhs_u : ee_i_b_lhs_s; goto binary; // only int
-    case EB_RHS: bin_i_eval = isU ? ee_i_b_rhs_u : ee_i_b_rhs_s; goto binary; // only int
-    case EB_AND: bin_i_eval = isU ? ee_i_b_and_u : ee_i_b_and_s; goto binary; // only int
-    case EB_OR:  bin_i_eval = isU ? ee_i_b_or_u : ee_i_b_or_s;  goto binary;// only int
-    case EB_XOR: bin_i_eval = isU ? ee_i_b_xor_u : ee_i_b_xor_s; goto binary; // only int
-    binary: {
-      AstConst *left = eval(ctx, expression->binaryExpr.left);
-      if (left == NULL) return NULL;
-      AstConst *right = eval(ctx, expression->binaryExpr.right);
-      if (right == NULL) return NULL;
-      if (isDiv && right->op == CK_INT_CONST && right->i == 0) {
-          // Do not evaluate division by zero
-          AstExpression *oldLeft = expression->binaryExpr.left;
-          expression->binaryExpr.left = createAstConst2(ctx, &oldLeft->coordinates, oldLeft->type, left);
-          AstExpression *oldRight = expression->binaryExpr.right;
-          expression->binaryExpr.right = createAstConst2(ctx, &oldRight->coordinates, oldRight->type, right);
-          return NULL;
-      } else if (left->op == CK_STRING_LITERAL || right->op == CK_STRING_LITERAL) {
-          AstExpression *oldLeft = expression->binaryExpr.left;
-          expression->binaryExpr.left = createAstConst2(ctx, &oldLeft->coordinates, oldLeft->type, left);
-          AstExpression *oldRight = expression->binaryExpr.right;
-          expression->binaryExpr.right = createAstConst2(ctx, &oldRight->coordinates, oldRight->type, right);
-          return NULL;
-      }
-      return evaluateBinaryConst(ctx, left, right, chk_eval, bin_i_eval, bin_f_eval);
-    }
-    case EB_ANDAND: bin_i_eval = ee_i_b_andand; bin_f2i_eval = ee_f_b_andand; goto cond;
-    case EB_OROR:   bin_i_eval = ee_i_b_oror; bin_f2i_eval = ee_f_b_oror; goto cond;
-    case EB_EQ: bin_i_eval = ee_i_b_eq; bin_f2i_eval = ee_f_b_eq; goto cond;
-    case EB_NE: bin_i_eval = ee_i_b_ne; bin_f2i_eval = ee_f_b_ne; goto cond;
-    case EB_LT: bin_i_eval = isU ? ee_i_b_lt_u : ee_i_b_lt_s; bin_f2i_eval = ee_f_b_lt; goto cond;
-    case EB_LE: bin_i_eval = isU ? ee_i_b_le_u : ee_i_b_le_s; bin_f2i_eval = ee_f_b_le; goto cond;
-    case EB_GT: bin_i_eval = isU ? ee_i_b_gt_u : ee_i_b_gt_s; bin_f2i_eval = ee_f_b_gt; goto cond;
-    case EB_GE: bin_i_eval = isU ? ee_i_b_ge_u : ee_i_b_ge_s; bin_f2i_eval = ee_f_b_ge; goto cond;
-    cond: {
-        AstConst *left = eval(ctx, expression->binaryExpr.left);
-        if (left == NULL) return NULL;
-        AstConst *right = eval(ctx, expression->binaryExpr.right);
-        if (right == NULL) return NULL;
-        return evaluateBinaryCondConst(ctx, left, right, chk_eval, bin_i_eval, bin_f2i_eval);
-    }
+      return evalExpression(ctx, expression->binaryExpr.right, result);
     case E_TERNARY: {
-        AstConst *cond = eval(ctx, expression->ternaryExpr.condition);
-        if (cond) {
-            int cond_v;
-            switch (cond->op) {
-              case CK_INT_CONST: cond_v = (int)cond->i; break;
-              case CK_FLOAT_CONST: cond_v = (int)cond->f; break;
-              case CK_STRING_LITERAL: cond_v = TRUE; break;
-              default: unreachable("Const evaluation error"); return NULL;
-            }
-            return eval(ctx, cond_v ? expression->ternaryExpr.ifTrue : expression->ternaryExpr.ifFalse);
+        AstConst cond;
+        if (!evalExpression(ctx, expression->ternaryExpr.condition, &cond)) return FALSE;
+        Boolean cond_v;
+        switch (cond.op) {
+          case CK_INT_CONST: cond_v = cond.i != 0; break;
+          case CK_FLOAT_CONST: cond_v = cond.f != 0; break;
+          case CK_STRING_LITERAL: cond_v = TRUE; break;
+          default: unreachable("Const evaluation error"); return FALSE;
         }
-        return NULL;
+        return evalExpression(ctx, cond_v ? expression->ternaryExpr.ifTrue : expression->ternaryExpr.ifFalse, result);
     }
     case E_PAREN:
-      return eval(ctx, expression->parened);
+      return evalExpression(ctx, expression->parened, result);
     case E_BLOCK:
-      return evalStmt(ctx, expression->block);
-    case E_CAST: {
-      AstConst *arg = eval(ctx, expression->castExpr.argument);
-      if (arg == NULL) return NULL;
-      return evalCast(ctx, expression->castExpr.type, arg);
-    }
+      return evalStmt(ctx, expression->block, result);
+    case E_CAST:
+      if (!evalExpression(ctx, expression->castExpr.argument, result)) return FALSE;
+      return evalCast(ctx, expression->castExpr.type, result);
     case EU_POST_INC:
     case EU_POST_DEC:
     case EU_PLUS:
-    case EU_PRE_INC: un_i_eval = ee_i_u_inc; un_f_eval = ee_f_u_inc; goto unary;
-    case EU_PRE_DEC: un_i_eval = ee_i_u_dec; un_f_eval = ee_f_u_dec; goto unary;
-    case EU_MINUS:   un_i_eval = ee_i_u_minus; un_f_eval = ee_f_u_minus; goto unary;
-    case EU_TILDA:   un_i_eval = ee_i_u_tilda; goto unary;// only for int
-    case EU_EXL:     un_i_eval = ee_i_u_exl; un_f_eval = ee_f_u_exl; goto unary;
-    unary: {
-      AstConst *expr = eval(ctx, expression->unaryExpr.argument);
-      if (expr) {
-        if (op == EU_POST_INC || op == EU_POST_DEC || op == EU_PLUS)
-          return expr;
-        else {
-          return evaluateUnaryConst(ctx, expr, un_i_eval, un_f_eval);
-        }
-      }
-      return NULL;
-    }
-    case EB_A_ACC:
-      return NULL; // cannot evaluate array access
-    case EB_ASSIGN:
-    case EB_ASG_MUL:
-    case EB_ASG_DIV:
-    case EB_ASG_MOD:
-    case EB_ASG_ADD:
-    case EB_ASG_SUB:
-    case EB_ASG_SHL:
-    case EB_ASG_SHR:
-    case EB_ASG_AND:
-    case EB_ASG_XOR:
-    case EB_ASG_OR:
-      return NULL; // cannot evaluate assignemt
+    case EU_PRE_INC:
+    case EU_PRE_DEC:
+    case EU_MINUS:
+    case EU_TILDA:
+    case EU_EXL:
+    case EU_REF:
+      return evalUnary(ctx, expression, result);
+    case EF_ARROW:
+      if (!evalExpression(ctx, expression->fieldExpr.recevier, result)) return FALSE;
+      if (result->op != CK_INT_CONST) return FALSE;
+      result->i += effectiveMemberOffset(expression->fieldExpr.member);
+      return TRUE;
+    case EB_A_ACC:      // cannot evaluate array access
     case EF_DOT:
-      return NULL;
-    case EF_ARROW: {
-      AstConst *c = eval(ctx, expression->fieldExpr.recevier);
-      if (c) {
-          c->i += effectiveMemberOffset(expression->fieldExpr.member);
-      }
-      return c;
-    }
     case E_CALL:
-    case E_NAMEREF:
-      return NULL; // same for call foo() and nameref
-    case E_LABEL_REF:
-      return NULL; // no idea how to evaluate this
-    case EU_REF:
-      return eval(ctx, expression->unaryExpr.argument);
-    case EU_DEREF:
-      return NULL; // ref/deref is not supported yet;
+    case E_NAMEREF:     // same for call foo() and nameref
+    case E_LABEL_REF:   // no idea how to evaluate this
+    case EU_DEREF:      // ref/deref is not supported yet
     case E_ERROR:
-    default:
-      return NULL; // error cannot be evaluated
+    default:            // assignments and errors cannot be evaluated
+      return FALSE;
   }
 }
+
+AstConst* eval(ParserContext *ctx, AstExpression* expression) {
+  if (expression->op == E_CONST) return &expression->constExpr;
+  if (expression->evaluated) return expression->evaluated;
+
+  AstConst result;
+  if (!evalExpression(ctx, expression, &result)) return NULL;
+
+  // Only successful results are memoised since canonicalization rewrites nodes in place,
+  // the memo comes from the same arena as the nodes being evaluated, see astNodeArena
+  AstConst *memo = (AstConst *)areanAllocate(astNodeArena(ctx), sizeof(AstConst));
+  *memo = result;
+  expression->evaluated = memo;
+
+  return memo;
+}
+
+// =========== Evaluation ===============================//
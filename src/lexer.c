@@ -3,6 +3,10 @@
 #include <libgen.h>
 #include <linux/limits.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "parser.h"
 #include "sema.h"
 #include "pp.h"
@@ -18,6 +22,12 @@ char *allocateString(ParserContext *ctx, size_t size) {
 }
 
 Token *allocToken(ParserContext *ctx) {
+  Token *recycled = ctx->tokenWindow.freeList;
+  if (recycled) {
+      ctx->tokenWindow.freeList = recycled->next;
+      memset(recycled, 0, sizeof(Token));
+      return recycled;
+  }
   return (Token *)areanAllocate(ctx->memory.tokenArena, sizeof(Token));
 }
 
@@ -48,7 +58,7 @@ static void dumpToken(char *buffer, size_t bsize, Token *token) {
     bf += l; bsize -= l;
   }
 
-  if (token->pos) {
+  if (token->pos && token->locInfo) {
     ptrdiff_t startOffset = token->pos - token->locInfo->buffer;
     ptrdiff_t endOffset = startOffset + token->length;
     const char *place = token->locInfo->kind == LIK_FILE ? token->locInfo->fileInfo.fileName : "macro";
@@ -74,7 +84,7 @@ static void dumpToken(char *buffer, size_t bsize, Token *token) {
   }
 
   if (token->rawCode == F_CONSTANT_RAW) {
-      l = snprintf(bf, bsize, ", float value '%Lf'", token->value.ldv);
+      l = snprintf(bf, bsize, ", float value '%Lf'", *token->value.ldv);
       bf += l; bsize -= l;
   }
 
@@ -98,50 +108,36 @@ static unsigned needSpace(char c, const Token *p, const Token *t) {
       : 0;
 }
 
-const char *joinToStringTokenSequence(ParserContext *ctx, Token *s) {
-
-  StringBuffer sb = { 0 };
-
-  Token *t = s, *p = NULL;
-
-  while (t->rawCode != END_OF_FILE) {
-      if (sb.idx && t->startOfLine) {
-          putSymbol(&sb, '\n');
-      }
-
-      if (t->hasLeadingSpace || sb.ptr && needSpace(sb.ptr[sb.idx - 1], p, t)) {
-          putSymbol(&sb, ' ');
-      }
-
-      unsigned idx;
-      for (idx = 0; idx < t->length; ++idx) {
-          putSymbol(&sb, t->pos[idx]);
-      }
+void addLineChunk(LocationInfo *locInfo, const char *fileName, unsigned overrideLine, unsigned rawLine) {
+  unsigned count = locInfo->fileInfo.chunks.count;
+  unsigned capacity = locInfo->fileInfo.chunks.capacity;
 
-      p = t;
-      t = t->next;
+  if (count == capacity) {
+      unsigned newCapacity = capacity ? capacity << 1 : 4;
+      locInfo->fileInfo.chunks.items = heapReallocate(locInfo->fileInfo.chunks.items, capacity * sizeof(LineChunk), newCapacity * sizeof(LineChunk));
+      locInfo->fileInfo.chunks.capacity = newCapacity;
   }
 
-  return sb.ptr;
+  // directives come in lexing order so the chunks stay sorted
+  LineChunk *chunk = &locInfo->fileInfo.chunks.items[count];
+  chunk->overrideFileName = fileName;
+  chunk->overrideLineNumber = overrideLine;
+  chunk->posLineNumber = rawLine;
+
+  locInfo->fileInfo.chunks.count = count + 1;
 }
 
-LocationInfo *allocateFileLocationInfo(const char *fileName, const char *buffer, size_t buffeSize, unsigned lineCount) {
+LocationInfo *allocateFileLocationInfo(const char *fileName, const char *buffer, size_t buffeSize, LineTable *lines) {
   LocationInfo *locInfo = heapAllocate(sizeof(LocationInfo));
 
   locInfo->kind = LIK_FILE;
 
-  locInfo->fileInfo.linesPos = heapAllocate(sizeof(unsigned) * lineCount);
-  locInfo->fileInfo.linesPos[locInfo->fileInfo.lineno++] = 0;
-  locInfo->fileInfo.lineCount = lineCount;
+  locInfo->fileInfo.lines = lines;
+  locInfo->fileInfo.lineno = 1; // first line starts at 0 and is always known
 
   locInfo->fileInfo.fileName = fileName;
 
-  LineChunk *newChunk = heapAllocate(sizeof(LineChunk));
-  newChunk->overrideFileName = fileName;
-  newChunk->posLineNumber = 0;
-  newChunk->overrideLineNumber = 1;
-
-  locInfo->fileInfo.chunks = newChunk;
+  addLineChunk(locInfo, fileName, 1, 0);
 
   locInfo->buffer = buffer;
   locInfo->bufferSize = buffeSize;
@@ -183,17 +179,118 @@ LocationInfo *allocateMacroLocationInfo(const char *buffer, size_t buffeSize, Bo
   return locInfo;
 }
 
-LexerState *loadFile(const char *fileName, LexerState *prev) {
+// =========== File cache ===============================//
+
+#define INITIAL_LINE_TABLE_CAPACITY 256
+
+/**
+ * Source files are cached per process, so every header is looked up and read only once
+ * even if it is included many times or by several translation units.
+ * Content is mapped into memory and line table is shared between all LocationInfos of the file,
+ * every inclusion discovers the same line starts so the table is only extended by one
+ * which lexes further than others.
+ */
+
+enum SourceFileState {
+  SFS_UNKNOWN = 0,
+  SFS_MISSING,
+  SFS_EXISTS,
+  SFS_LOADED
+};
+
+typedef struct _SourceFile {
+  enum SourceFileState state;
+
+  const char *buffer;
+  size_t bufferSize;
+
+  LineTable lines;
+} SourceFile;
+
+static HashMap *sourceFiles = NULL;  // atom -> SourceFile
+
+static SourceFile *getSourceFile(const char *fileName) {
+  if (sourceFiles == NULL) {
+      sourceFiles = createHashMap(DEFAULT_MAP_CAPACITY, atomHashCode, atomCmp);
+  }
+
+  SourceFile *file = (SourceFile *)getFromHashMap(sourceFiles, (intptr_t)fileName);
+
+  if (file == NULL) {
+      file = heapAllocate(sizeof(SourceFile));
+      putToHashMap(sourceFiles, (intptr_t)fileName, (intptr_t)file);
+  }
+
+  return file;
+}
+
+Boolean isSourceFileExist(const char *fileName) {
+  SourceFile *file = getSourceFile(fileName);
+
+  if (file->state == SFS_UNKNOWN) {
+      file->state = access(fileName, F_OK) == 0 ? SFS_EXISTS : SFS_MISSING;
+  }
+
+  return file->state != SFS_MISSING;
+}
+
+static SourceFile *readSourceFile(const char *fileName) {
+  SourceFile *file = getSourceFile(fileName);
+
+  if (file->state == SFS_LOADED) return file;
+  if (file->state == SFS_MISSING) return NULL;
+
   size_t bufferSize = 0;
+  const char *buffer = readFileToBuffer(fileName, &bufferSize);
+
+  if (buffer == NULL) {
+      file->state = SFS_MISSING;
+      return NULL;
+  }
+
+  file->buffer = buffer;
+  file->bufferSize = bufferSize;
+  file->lines.capacity = INITIAL_LINE_TABLE_CAPACITY;
+  file->lines.positions = heapAllocate(sizeof(unsigned) * file->lines.capacity);
+  file->lines.positions[file->lines.count++] = 0;
+  file->state = SFS_LOADED;
+
+  return file;
+}
 
-  char *buffer = readFileToBuffer(fileName, &bufferSize);
+// =========== File cache ===============================//
 
-  if (buffer == NULL) return NULL;
+// lexer found that line 'lineno' starts at position pos
+static void newLine(LocationInfo *locInfo, unsigned pos) {
+  LineTable *lines = locInfo->fileInfo.lines;
+  unsigned line = locInfo->fileInfo.lineno++;
 
-  unsigned lineCount = countLinesInBuffer(buffer);
+  assert(lines && "new line is not allowed here");
 
-  // TODO: think about reusing of already allocated LocationInfo
-  LocationInfo *locInfo = allocateFileLocationInfo(fileName, buffer, bufferSize, lineCount);
+  if (line < lines->count) {
+      // already discovered by previous inclusion or lexer lookahead
+      assert(lines->positions[line] == pos);
+      return;
+  }
+
+  if (lines->count == lines->capacity) {
+      unsigned newCapacity = lines->capacity << 1;
+      lines->positions = heapReallocate(lines->positions, lines->capacity * sizeof(unsigned), newCapacity * sizeof(unsigned));
+      lines->capacity = newCapacity;
+  }
+
+  lines->positions[lines->count++] = pos;
+}
+
+LexerState *loadFile(const char *fileName, LexerState *prev) {
+  // file names are interned so '#pragma once' map could compare them by pointer
+  fileName = internCString(fileName);
+
+  SourceFile *file = readSourceFile(fileName);
+
+  if (file == NULL) return NULL;
+
+  LocationInfo *locInfo = allocateFileLocationInfo(fileName, file->buffer, file->bufferSize, &file->lines);
   LexerState *lexState = allocateFileLexerState(locInfo);
   lexState->prev = lexState->virtPrev = prev;
 
@@ -488,7 +585,7 @@ invalid_const_suffix:
   return flags | HAS_ERROR;
 }
 
-static void parseFloatLiteral(Token *new, unsigned flags, const char *buffer, size_t size)  {
+static void parseFloatLiteral(ParserContext *ctx, Token *new, unsigned flags, const char *buffer, size_t size)  {
 
   char tmp[64] = { 0 };
 
@@ -500,8 +597,8 @@ static void parseFloatLiteral(Token *new, unsigned flags, const char *buffer, si
     copy = strndup(buffer, size);
   }
 
-  long double r;
-  sscanf(copy, "%Lf", &r);
+  long double *r = (long double *)allocateString(ctx, sizeof(long double));
+  sscanf(copy, "%Lf", r);
   new->code = flags & SEEN_FSUFFIX ? F_CONSTANT : D_CONSTANT;
   new->rawCode = F_CONSTANT_RAW;
   new->value.ldv = r;
@@ -589,7 +686,7 @@ static void parseIntegerLiteral(ParserContext *ctx, Token *new, unsigned flags,
 
 static void parseNumberLiteral(ParserContext *ctx, Token *new, unsigned flags, const char *buffer, size_t size) {
   if (flags & IS_FLOAT) {
-      parseFloatLiteral(new, flags, buffer, size);
+      parseFloatLiteral(ctx, new, flags, buffer, size);
   } else {
       parseIntegerLiteral(ctx, new, flags, buffer, size);
   }
@@ -875,6 +972,147 @@ static unsigned lexChar(ParserContext *ctx, Token *new, const char *buffer, size
 
 }
 
+// =========== Byte scanners ===============================//
+
+/**
+ * Fast paths of lexer skip runs of ordinary bytes looking for the next interesting one.
+ * Buffers always end with '\0' sentinel and block scanner reads only aligned blocks, which
+ * never cross page boundary, so it is safe to look a bit past the sentinel.
+ * With SSE2 it classifies 16 bytes at once, otherwise 8 byte words are checked with
+ * bit tricks, so the lexer is still compilable by ourselves.
+ */
+
+enum {
+  CC_ID = 1,  // [A-Za-z_]
+  CC_DG = 2,  // [0-9]
+  CC_WS = 4   // horizontal white space
+};
+
+static const unsigned char charClasses[256] = {
+      0,     0,     0,     0,     0,     0,     0,     0,     0, CC_WS,     0, CC_WS, CC_WS,     0,     0,     0,
+      0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+  CC_WS,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+  CC_DG, CC_DG, CC_DG, CC_DG, CC_DG, CC_DG, CC_DG, CC_DG, CC_DG, CC_DG,     0,     0,     0,     0,     0,     0,
+      0, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID,
+  CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID,     0,     0,     0,     0, CC_ID,
+      0, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID,
+  CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID, CC_ID,     0,     0,     0,     0,     0,
+  // the rest is 0
+};
+
+#define CHAR_CLASS(c) charClasses[(unsigned char)(c)]
+
+#ifdef __SSE2__
+
+static unsigned blockMatches(const __m128i *block, __m128i c1, __m128i c2, __m128i c3) {
+  __m128i v = _mm_load_si128(block);
+  __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c1), _mm_cmpeq_epi8(v, c2)),
+                           _mm_or_si128(_mm_cmpeq_epi8(v, c3), _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+  return (unsigned)_mm_movemask_epi8(m);
+}
+
+// returns offset of the first byte in s which is c1, c2, c3 or '\0'
+static unsigned scanUntil(const char *s, char c1, char c2, char c3) {
+  unsigned misalign = (uintptr_t)s & 15;
+  const __m128i *block = (const __m128i *)(s - misalign);
+  __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2), v3 = _mm_set1_epi8(c3);
+
+  unsigned mask = blockMatches(block, v1, v2, v3) >> misalign;
+  if (mask) return __builtin_ctz(mask);
+
+  unsigned offset = 16 - misalign;
+  for (;;) {
+      mask = blockMatches(++block, v1, v2, v3);
+      if (mask) return offset + __builtin_ctz(mask);
+      offset += 16;
+  }
+}
+
+// returns offset of the first byte in s which is line break, comment or literal start, backslash or '\0'
+static unsigned scanUntilLineSpecial(const char *s) {
+  unsigned misalign = (uintptr_t)s & 15;
+  const __m128i *block = (const __m128i *)(s - misalign);
+  __m128i nl = _mm_set1_epi8('\n'), sl = _mm_set1_epi8('/'), bs = _mm_set1_epi8('\\');
+  __m128i dq = _mm_set1_epi8('"'), sq = _mm_set1_epi8('\'');
+
+  unsigned mask = (blockMatches(block, nl, sl, bs) | blockMatches(block, dq, sq, sq)) >> misalign;
+  if (mask) return __builtin_ctz(mask);
+
+  unsigned offset = 16 - misalign;
+  for (;;) {
+      ++block;
+      mask = blockMatches(block, nl, sl, bs) | blockMatches(block, dq, sq, sq);
+      if (mask) return offset + __builtin_ctz(mask);
+      offset += 16;
+  }
+}
+
+#else
+
+#define ONE_BYTES 0x0101010101010101UL
+#define HIGH_BITS 0x8080808080808080UL
+
+// not zero if any byte of w is zero
+static uint64_t zeroByteMask(uint64_t w) {
+  return (w - ONE_BYTES) & ~w & HIGH_BITS;
+}
+
+// returns offset of the first byte in s which is c1, c2, c3 or '\0'
+static unsigned scanUntil(const char *s, char c1, char c2, char c3) {
+  unsigned i = 0;
+
+  while ((uintptr_t)&s[i] & 7) {
+      char c = s[i];
+      if (c == c1 || c == c2 || c == c3 || c == 0) return i;
+      ++i;
+  }
+
+  uint64_t p1 = ONE_BYTES * (unsigned char)c1;
+  uint64_t p2 = ONE_BYTES * (unsigned char)c2;
+  uint64_t p3 = ONE_BYTES * (unsigned char)c3;
+
+  for (;;) {
+      uint64_t w = *(const uint64_t *)&s[i];
+      if (zeroByteMask(w) | zeroByteMask(w ^ p1) | zeroByteMask(w ^ p2) | zeroByteMask(w ^ p3)) break;
+      i += 8;
+  }
+
+  for (;;) {
+      char c = s[i];
+      if (c == c1 || c == c2 || c == c3 || c == 0) return i;
+      ++i;
+  }
+}
+
+static Boolean isLineSpecial(char c) {
+  return c == '\n' || c == '/' || c == '\\' || c == '"' || c == '\'' || c == 0;
+}
+
+// returns offset of the first byte in s which is line break, comment or literal start, backslash or '\0'
+static unsigned scanUntilLineSpecial(const char *s) {
+  unsigned i = 0;
+
+  while ((uintptr_t)&s[i] & 7) {
+      if (isLineSpecial(s[i])) return i;
+      ++i;
+  }
+
+  for (;;) {
+      uint64_t w = *(const uint64_t *)&s[i];
+      if (zeroByteMask(w) | zeroByteMask(w ^ (ONE_BYTES * '\n')) | zeroByteMask(w ^ (ONE_BYTES * '/'))
+          | zeroByteMask(w ^ (ONE_BYTES * '\\')) | zeroByteMask(w ^ (ONE_BYTES * '"')) | zeroByteMask(w ^ (ONE_BYTES * '\''))) break;
+      i += 8;
+  }
+
+  while (!isLineSpecial(s[i])) ++i;
+
+  return i;
+}
+
+#endif // __SSE2__
+
+// =========== Byte scanners ===============================//
+
 static unsigned lexStringLiteral(ParserContext *ctx, Token *new, LocationInfo *locInfo, const char *buffer, size_t size) {
   unsigned l = 0;
 
@@ -897,12 +1135,19 @@ static unsigned lexStringLiteral(ParserContext *ctx, Token *new, LocationInfo *l
 
   size_t stringSize = 0;
 
-  while (l < size) {
+  for (;;) {
+      unsigned run = scanUntil(&buffer[l], '"', '\\', '\n');
+      putSymbols(&sb, &buffer[l], run);
+      l += run;
+
       char c = buffer[l];
+      if (c == 0) {
+          break;
+      }
       if (c == '\\') {
           if (buffer[l+1] == '\n') {
             l += 2;
-            locInfo->fileInfo.linesPos[locInfo->fileInfo.lineno++] = l;
+            newLine(locInfo, &buffer[l] - locInfo->buffer);
           } else {
             int v = 0;
             l += lexEscapedLiteralSymbol(ctx, new->locInfo, &v, &buffer[l], size - l, isWide);
@@ -919,9 +1164,6 @@ static unsigned lexStringLiteral(ParserContext *ctx, Token *new, LocationInfo *l
           ++l;
           break;
       }
-
-      putSymbol(&sb, c);
-      ++l;
   }
 
   if (buffer[l - 1] != '"') {
@@ -929,97 +1171,214 @@ static unsigned lexStringLiteral(ParserContext *ctx, Token *new, LocationInfo *l
       reportDiagnostic(ctx, DIAG_UNTERMINATED_CHAR_STRING, &coords, '"');
   }
 
-  char *result = allocateString(ctx, sb.idx + 1);
+  TokenText *text = (TokenText *)allocateString(ctx, sizeof(TokenText) + sb.idx + 1);
+  char *result = (char *)(text + 1);
   if (sb.ptr) {
     memcpy(result, sb.ptr, sb.idx);
     releaseHeap(sb.ptr);
   }
   result[sb.idx] = '\0';
 
+  text->v = result;
+  text->l = sb.idx + 1;
+
   new->code = new->rawCode = STRING_LITERAL;
-  new->value.text.v = result;
-  new->value.text.l = sb.idx + 1;
+  new->value.text = text;
 
   return l;
 }
 
 static Boolean isValidIdStart(char c) {
-  if (c == '_') return TRUE;
-  if ('a' <= c && c <= 'z') return TRUE;
-  if ('A' <= c && c <= 'Z') return TRUE;
-  return FALSE;
+  return CHAR_CLASS(c) & CC_ID;
 }
 
 static Boolean isValidIdSymbol(char c) {
-  return isValidIdStart(c) || isDigit(c);
+  return CHAR_CLASS(c) & (CC_ID | CC_DG);
 }
 
-static unsigned lexIdentifier(ParserContext *ctx, Token *new, const char *buffer, size_t size) {
+// =========== Keywords ===============================//
+
+/**
+ * Keywords are recognized by perfect hash over the keyword set:
+ *   slot = (length + kwAsso[w[0]] + kwAsso[w[1]] + kwAsso[w[length - 1]]) mod KEYWORD_SLOTS
+ * Association values are picked so every keyword gets its own slot, hence one string compare
+ * decides if identifier is a keyword. They have to be re-picked if keyword set is changed.
+ */
+
+#define KEYWORD_SLOTS 64
+#define MIN_KEYWORD_LENGTH 2
+#define MAX_KEYWORD_LENGTH 8
+
+static const unsigned char kwAsso[128] = {
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0, 44, 43,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 60,
+   0,  1, 54, 41, 36, 60, 19, 54, 23, 57,  0, 62, 45, 55, 57, 26,
+   0,  0, 25, 26, 27, 37, 25, 59, 52,  4,  0,  0,  0,  0,  0,  0,
+};
+
+static const struct {
+  const char *word;
+  unsigned length;
+  int code;
+} keywords[KEYWORD_SLOTS] = {
+  { "double", 6, DOUBLE },
+  { "long", 4, LONG },
+  { "default", 7, DEFAULT },
+  { "_Alignof", 8, ALIGNOF },
+  { "auto", 4, AUTO },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { "continue", 8, CONTINUE },
+  { NULL, 0, IDENTIFIER },
+  { "for", 3, FOR },
+  { "unsigned", 8, UNSIGNED },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { "int", 3, INT },
+  { "short", 5, SHORT },
+  { "break", 5, BREAK },
+  { "while", 5, WHILE },
+  { "return", 6, RETURN },
+  { NULL, 0, IDENTIFIER },
+  { "struct", 6, STRUCT },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { "_Bool", 5, _BOOL },
+  { "do", 2, DO },
+  { "void", 4, VOID },
+  { "union", 5, UNION },
+  { "char", 4, CHAR },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { "float", 5, FLOAT },
+  { "if", 2, IF },
+  { NULL, 0, IDENTIFIER },
+  { "const", 5, CONST },
+  { "static", 6, STATIC },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { "else", 4, ELSE },
+  { "case", 4, CASE },
+  { NULL, 0, IDENTIFIER },
+  { "sizeof", 6, SIZEOF },
+  { NULL, 0, IDENTIFIER },
+  { "goto", 4, GOTO },
+  { "extern", 6, EXTERN },
+  { "enum", 4, ENUM },
+  { NULL, 0, IDENTIFIER },
+  { "switch", 6, SWITCH },
+  { NULL, 0, IDENTIFIER },
+  { "inline", 6, INLINE },
+  { NULL, 0, IDENTIFIER },
+  { "register", 8, REGISTER },
+  { "volatile", 8, VOLATILE },
+  { "restrict", 8, RESTRICT },
+  { "typedef", 7, TYPEDEF },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+  { "signed", 6, SIGNED },
+  { NULL, 0, IDENTIFIER },
+  { NULL, 0, IDENTIFIER },
+};
+
+static Boolean isKeyword(int code) {
+  return BREAK <= code && code <= WHILE;
+}
 
-  assert(isValidIdStart(buffer[0]));
-  unsigned i = 1;
+// returns keyword code or IDENTIFIER
+static int keywordCode(const char *s, unsigned length) {
+  if (length < MIN_KEYWORD_LENGTH || length > MAX_KEYWORD_LENGTH) return IDENTIFIER;
 
-  new->code = new->rawCode = IDENTIFIER;
+  unsigned slot = (length + kwAsso[s[0] & 0x7F] + kwAsso[s[1] & 0x7F] + kwAsso[s[length - 1] & 0x7F]) & (KEYWORD_SLOTS - 1);
 
-  while (i < size) {
-      if (isValidIdSymbol(buffer[i])) {
-          ++i;
-          continue;
-      }
-      break;
+  if (keywords[slot].length == length && memcmp(keywords[slot].word, s, length) == 0) {
+      return keywords[slot].code;
   }
 
-  char *id = allocateString(ctx, i + 1);
-  strncpy(id, buffer, i);
-  new->id = id;
+  return IDENTIFIER;
+}
+
+// =========== Keywords ===============================//
+
+// buffers are always terminated by '\0' sentinel so scanners below need no bounds checks
+
+static unsigned lexIdentifier(ParserContext *ctx, Token *new, const char *buffer) {
+
+  assert(isValidIdStart(buffer[0]));
+  unsigned i = 1;
+
+  while (CHAR_CLASS(buffer[i]) & (CC_ID | CC_DG)) ++i;
+
+  // keyword is still an identifier for preprocessor, parser looks at code
+  new->rawCode = IDENTIFIER;
+  new->code = keywordCode(buffer, i);
+  new->id = internString(buffer, i);
 
   return i;
 }
 
-static unsigned skipWhiteSpace(const char *buffer, size_t size) {
-  unsigned i = 0;
-  while (i < size) {
-      char c = buffer[i];
-      if (c == ' ' || c == '\t' || c == '\f' || c == '\v') {
-          ++i;
-          continue;
-      }
-      break;
+Token *pasteIdentifier(ParserContext *ctx, const Token *l, const Token *r) {
+  if (l->rawCode != IDENTIFIER) return NULL;
+
+  unsigned i;
+  for (i = 0; i < r->length; ++i) {
+      if (!isValidIdSymbol(r->pos[i])) return NULL;
   }
 
-  return i;
+  size_t length = l->length + r->length;
+  char local[128];
+  char *buffer = length > sizeof local ? allocateString(ctx, length) : local;
+
+  memcpy(buffer, l->pos, l->length);
+  memcpy(&buffer[l->length], r->pos, r->length);
+
+  Token *new = allocToken(ctx);
+  new->rawCode = IDENTIFIER;
+  new->code = keywordCode(buffer, length);
+  // interned copy outlives the token so it is spelling as well
+  new->id = new->pos = internString(buffer, length);
+  new->length = length;
+
+  return new;
 }
 
-static unsigned skipLineComment(const char *buffer, size_t size) {
-  unsigned i = 1;
+static unsigned skipWhiteSpace(const char *buffer) {
+  unsigned i = 0;
 
-  for (; i < size; ++i) {
-      if (buffer[i] == '\n') {
-          break;
-      }
-  }
+  while (CHAR_CLASS(buffer[i]) & CC_WS) ++i;
 
   return i;
 }
 
-static unsigned skipBlockComment(ParserContext *ctx, LocationInfo *locInfo, const char *buffer, unsigned start, size_t size) {
-  unsigned i = start + 2; // skip /*
+static unsigned skipLineComment(const char *buffer) {
+  return 1 + scanUntil(&buffer[1], '\n', '\n', '\n');
+}
 
-  unsigned *linePos = locInfo->fileInfo.linesPos;
-  unsigned lineCounter = locInfo->fileInfo.lineno;
+static unsigned skipBlockComment(ParserContext *ctx, LocationInfo *locInfo, const char *buffer, unsigned start) {
+  unsigned i = start + 2; // skip /*
 
-  while (i < size) {
+  for (;;) {
+      i += scanUntil(&buffer[i], '*', '\n', '*');
       char c = buffer[i];
-      if (c == '\n') {
-          linePos[lineCounter++] = i;
-          locInfo->fileInfo.lineno = lineCounter;
+      if (c == 0) {
+          break;
+      } else if (c == '\n') {
+          newLine(locInfo, i);
       } else if (c == '*') {
-          if (i + 1 < size) {
-              if (buffer[i + 1] == '/') {
-                  i += 2;
-                  break;
-              }
-          } else {
+          if (buffer[i + 1] == '/') {
+              i += 2;
+              break;
+          } else if (buffer[i + 1] == 0) {
               Token dummy = { 0 };
               dummy.locInfo = locInfo;
               dummy.pos = buffer;
@@ -1035,6 +1394,111 @@ static unsigned skipBlockComment(ParserContext *ctx, LocationInfo *locInfo, cons
   return i - start;
 }
 
+// =========== Inactive regions ===============================//
+
+/**
+ * Groups of not taken conditionals are never tokenized. Scanner jumps from line to line and stops
+ * only at lines whose first token is '#'. Comments and literals are skipped as a whole since they
+ * could hide both line breaks and '#', line starts are registered the same way lexer does it
+ * because line table is shared by all inclusions of the file.
+ */
+
+// skip quoted literal up to closing quote or line break, unterminated ones end at the line break
+static unsigned skipInactiveLiteral(LocationInfo *locInfo, const char *buffer, unsigned i) {
+  char quote = buffer[i++];
+
+  for (;;) {
+      i += scanUntil(&buffer[i], quote, '\\', '\n');
+      char c = buffer[i];
+      if (c == quote) return i + 1;
+      if (c != '\\') return i;
+      if (buffer[i + 1] == '\n') {
+          i += 2;
+          newLine(locInfo, i);
+      } else if (buffer[i + 1] != 0) {
+          i += 2;
+      } else {
+          return i + 1;
+      }
+  }
+}
+
+// returns length of backslash-newline sequence at buffer[i] or 0 if it is a stray backslash
+static unsigned lineContinuation(const char *buffer, unsigned i) {
+  unsigned skipped = skipWhiteSpace(&buffer[i + 1]);
+  return buffer[i + skipped + 1] == '\n' ? skipped + 2 : 0;
+}
+
+Boolean skipToDirectiveLine(ParserContext *ctx) {
+  LexerState *lexState = ctx->lexerState;
+  LocationInfo *locInfo = lexState->fileContext.locInfo;
+  const char *buffer = locInfo->buffer;
+  unsigned i = lexState->fileContext.pos;
+  Boolean atLineStart = lexState->fileContext.atLineStart;
+  unsigned l;
+
+  assert(lexState->state == LS_FILE);
+
+  for (;;) {
+      if (atLineStart) {
+          // look for the first token of the line
+          i += skipWhiteSpace(&buffer[i]);
+          char c = buffer[i];
+          if (c == '#') {
+              lexState->fileContext.pos = i;
+              lexState->fileContext.atLineStart = 1;
+              return TRUE;
+          }
+          if (c == '/' && buffer[i + 1] == '*') {
+              i += skipBlockComment(ctx, locInfo, buffer, i);
+              continue;
+          }
+          if (c == '\\' && (l = lineContinuation(buffer, i)) != 0) {
+              i += l;
+              newLine(locInfo, i);
+              continue;
+          }
+          atLineStart = FALSE;
+      }
+
+      i += scanUntilLineSpecial(&buffer[i]);
+
+      switch (buffer[i]) {
+        case 0:
+          lexState->fileContext.pos = i + 1;
+          ctx->stateFlags.lastLexCode = END_OF_FILE;
+          return FALSE;
+        case '\n':
+          ++i;
+          newLine(locInfo, i);
+          atLineStart = TRUE;
+          break;
+        case '/':
+          if (buffer[i + 1] == '/') {
+              i += skipLineComment(&buffer[i]);
+          } else if (buffer[i + 1] == '*') {
+              i += skipBlockComment(ctx, locInfo, buffer, i);
+          } else {
+              ++i;
+          }
+          break;
+        case '\\':
+          if ((l = lineContinuation(buffer, i)) != 0) {
+              i += l;
+              newLine(locInfo, i);
+          } else {
+              ++i;
+          }
+          break;
+        default: // quote
+          i = skipInactiveLiteral(locInfo, buffer, i);
+          break;
+      }
+  }
+}
+
+// =========== Inactive regions ===============================//
+
 // lex token from file lexer, returns False if lexing done
 Boolean lexTokenRaw2(ParserContext *ctx, Token *new) {
   LexerState *lexState = ctx->lexerState;
@@ -1044,15 +1508,14 @@ Boolean lexTokenRaw2(ParserContext *ctx, Token *new) {
   unsigned tokenEnd = tokenStart;
   const char *buffer = locInfo->buffer;
   const size_t bufferSize = locInfo->bufferSize - 1;
-  unsigned *linePos = locInfo->fileInfo.linesPos;
 
-  unsigned lineCounter = locInfo->fileInfo.lineno;
   unsigned l = 0;
 
   Boolean isWide = FALSE;
   char c = buffer[i];
   Token head = { 0 };
   Coordinates coords = { &head, &head };
+  head.locInfo = locInfo;
   new->pos = head.pos = &buffer[i];
 
   int code;
@@ -1063,22 +1526,18 @@ Boolean lexTokenRaw2(ParserContext *ctx, Token *new) {
       tokenEnd = ++i;
       break;
     case '\\': { // escaping
-        unsigned skipped = skipWhiteSpace(&buffer[i], bufferSize - i);
-        if ((i + skipped + 1) < bufferSize) {
-            if (buffer[i + skipped + 1] == '\n') {
-                assert(linePos && "new line is not allowed here");
-                i += (skipped + 2);
-                linePos[lineCounter++] = i;
-                locInfo->fileInfo.lineno = lineCounter;
-                if (skipped) {
-                    head.length = &buffer[i] - head.pos;
-                    reportDiagnostic(ctx, DIAG_SPACE_SEPARATED, &coords);
-                }
-                new->code = new->rawCode = DANGLING_NEWLINE;
-                new->length = 1;
-                lexState->fileContext.pos = i;
-                return TRUE;
+        unsigned skipped = skipWhiteSpace(&buffer[i + 1]);
+        if (buffer[i + skipped + 1] == '\n') {
+            i += (skipped + 2);
+            newLine(locInfo, i);
+            if (skipped) {
+                head.length = &buffer[i] - head.pos;
+                reportDiagnostic(ctx, DIAG_SPACE_SEPARATED, &coords);
             }
+            new->code = new->rawCode = DANGLING_NEWLINE;
+            new->length = 1;
+            lexState->fileContext.pos = i;
+            return TRUE;
         }
       }
       new->code = new->rawCode = '\\';
@@ -1096,9 +1555,7 @@ Boolean lexTokenRaw2(ParserContext *ctx, Token *new) {
       // fall through
     case '\n':
       tokenEnd = ++i;
-      assert(linePos && "new line is not allowed here");
-      linePos[lineCounter++] = i;
-      locInfo->fileInfo.lineno = lineCounter;
+      newLine(locInfo, i);
       lexState->fileContext.atLineStart = 1;
       lexState->fileContext.pos = i;
       new->hasLeadingSpace = 0;
@@ -1135,14 +1592,14 @@ Boolean lexTokenRaw2(ParserContext *ctx, Token *new) {
       if ((i + 1) < bufferSize) {
         char c = buffer[i+1];
         if (c == '/') {
-            l = skipLineComment(&buffer[i], bufferSize - i);
+            l = skipLineComment(&buffer[i]);
             i += l;
             new->code = new->rawCode = LINE_COMMENT;
             new->length = l;
             lexState->fileContext.pos = i;
             return TRUE;
         } else if (c == '*') {
-            l = skipBlockComment(ctx, locInfo, buffer, i, bufferSize);
+            l = skipBlockComment(ctx, locInfo, buffer, i);
             i += l;
             new->code = new->rawCode = BLOCK_COMMENT;
             new->length = l;
@@ -1353,7 +1810,7 @@ Boolean lexTokenRaw2(ParserContext *ctx, Token *new) {
     case 'v': case 'w': case 'x': case 'y': case 'z':
     case '_': // identifier
     lexID:
-      i += lexIdentifier(ctx, new, &buffer[i], bufferSize - tokenStart);
+      i += lexIdentifier(ctx, new, &buffer[i]);
       tokenEnd = i;
       break;
     default: // bad character
@@ -1372,6 +1829,11 @@ LexerState *popLexerState(ParserContext *ctx) {
   assert(state);
 
   if (state->state == LS_FILE) {
+      if (state->fileContext.guardState == IGS_AFTER_GUARD) {
+          // next time the file could be skipped while guard macro is defined
+          LocationInfo *locInfo = state->fileContext.locInfo;
+          putToHashMap(ctx->includeGuardMap, (intptr_t)locInfo->fileInfo.fileName, (intptr_t)state->fileContext.guardMacro);
+      }
       PPConditionFrame *frame = state->fileContext.conditionStack;
       while (frame) {
           Coordinates coords = { frame->ifDirective, frame->ifDirective };
@@ -1408,8 +1870,6 @@ Token *lexNonExpand(ParserContext *ctx, Boolean shadowNL) {
   unreachable("infinite loop");
 }
 
-Token *concatTokens(ParserContext *ctx, Token *macro, Token *l, Token *r);
-
 // lex raw token from file lexer into *token and fills token tech infomation
 Boolean lexTokenRaw(ParserContext *ctx, Token *token) {
 
@@ -1450,36 +1910,7 @@ Token *lexTokenNoSubstitute(ParserContext *ctx) {
 
   assert(lexState->state == LS_MACRO);
 
-  Token *t = lexState->macroContext.bodyPtr;
-  if (t) {
-      Token *next = t->next;
-      if (lexState->macroContext.definition && next && next->rawCode == DSHARP) {
-          do {
-              Token *lhs = t;
-              Token *rhs = next->next;
-              assert(rhs);
-
-              next = rhs->next;
-
-              lhs->next = NULL;
-              rhs->next = NULL;
-
-              t = concatTokens(ctx, lexState->macroContext.trigger, lhs, rhs);
-
-              if (t->rawCode == DSHARP) {
-                  // it's a hack for #define x # ## #
-                  t->rawCode = t->code = BAD_CHARACTER;
-              }
-
-          } while (next && next->rawCode == DSHARP);
-      }
-      lexState->macroContext.bodyPtr = next;
-  } else {
-      t = allocToken(ctx);
-      t->code = t->rawCode = END_OF_FILE;
-  }
-
-  return t;
+  return nextMacroToken(ctx, &lexState->macroContext);
 }
 
 void skipUntilEoL(ParserContext *ctx) {
@@ -1516,14 +1947,10 @@ static Boolean checkNextTokenInState(ParserContext *ctx, LexerState *state, int
       state->fileContext.locInfo->fileInfo.lineno = line;
   } else {
       assert(state->state == LS_MACRO);
-      Token *saved = state->macroContext.bodyPtr;
-      LexerState *oldState = ctx->lexerState;
-      ctx->lexerState = state;
+      // cursor points to the token itself, nothing is copied
+      t = peekMacroToken(ctx, &state->macroContext);
 
-      t = lexTokenNoSubstitute(ctx);
-
-      ctx->lexerState = oldState;
-      state->macroContext.bodyPtr = saved;
+      if (t == NULL) return checkNextTokenInState(ctx, state->prev, code);
   }
 
   if (t->rawCode != END_OF_FILE) {
@@ -1558,7 +1985,17 @@ Token *lexToken(ParserContext *ctx) {
         handleDirective(ctx, directive);
 
         continue;
-    } else if (rawCode == IDENTIFIER) {
+    }
+
+    if (!isTechnicalToken(rawCode) && rawCode != END_OF_FILE) {
+        LexerState *lexState = ctx->lexerState;
+        if (lexState->state == LS_FILE && lexState->fileContext.guardState != IGS_IN_GUARD) {
+            // significant token outside of include guard
+            lexState->fileContext.guardState = IGS_INVALID;
+        }
+    }
+
+    if (rawCode == IDENTIFIER) {
         // could be a macro to expand
         Token *exp = handleIdentifier(ctx, token);
         if (exp) return exp;
@@ -1599,338 +2036,151 @@ static Token *lexCleanToken(ParserContext *ctx) {
   unreachable("infinite loop");
 }
 
-Token *tokenizeBuffer(ParserContext *ctx) {
+// =========== Preprocessed output ===============================//
 
-  unsigned int i = 0;
+#define PP_OUTPUT_BUFFER_SIZE (64 * 1024)
 
-  unsigned startOfLine = 1;
-  unsigned lineCounter = 0;
+typedef struct {
+  FILE *output;
+  size_t idx;
+  size_t total;
+  char last;
+  char buffer[PP_OUTPUT_BUFFER_SIZE];
+} PPWriter;
 
-  LexerState *lexState = ctx->lexerState;
+static void flushPPWriter(PPWriter *w) {
+  if (w->idx) fwrite(w->buffer, 1, w->idx, w->output);
+  w->idx = 0;
+}
 
-  LocationInfo *locInfo = lexState->fileContext.locInfo;
+static void writePPSymbols(PPWriter *w, const char *s, size_t n) {
+  if (n == 0) return;
 
-  unsigned *linePos = locInfo->fileInfo.linesPos;
+  w->total += n;
+  w->last = s[n - 1];
 
-  if (linePos) {
-    linePos[lineCounter++] = 0;
+  if (w->idx + n > PP_OUTPUT_BUFFER_SIZE) {
+      flushPPWriter(w);
+      if (n > PP_OUTPUT_BUFFER_SIZE) {
+          fwrite(s, 1, n, w->output);
+          return;
+      }
   }
 
-  const char *buffer = locInfo->buffer;
+  memcpy(&w->buffer[w->idx], s, n);
+  w->idx += n;
+}
 
-  Token head = { 0 }, *current = &head;
-  head.locInfo = locInfo;
-  Token *new = allocToken2(ctx, locInfo);
+/**
+ * Lexes and expands the whole file writing tokens out as soon as they are produced. Only the previous token
+ * is needed to decide on separating space, so everything behind it goes back to token free list.
+ */
+void streamPreprocessedOutput(ParserContext *ctx, FILE *output) {
+  PPWriter *w = heapAllocate(sizeof(PPWriter));
+  Token *p = NULL;
 
-  const size_t bufferSize = locInfo->bufferSize - 1;
-  Coordinates coords = { &head, &head };
+  w->output = output;
+  w->idx = w->total = 0;
+  w->last = '\0';
 
   for (;;) {
-      current = current->next = lexCleanToken(ctx);
-      i = lexState->fileContext.pos;
-
-      if (current->rawCode == END_OF_FILE) break;
-  }
-
-  return head.next;
-}
-
-static const char boolWord[] = "_Bool";
-static const char autoWord[] = "auto";
-static const char breakWord[] = "break";
-static const char caseWord[] = "case";
-static const char charWord[] = "char";
-static const char constWord[] = "const";
-static const char continueWord[] = "continue";
-static const char doubleWord[] = "double";
-static const char defaultWord[] = "default";
-static const char elseWord[] = "else";
-static const char enumWord[] = "enum";
-static const char externWord[] = "extern";
-static const char floatWord[] = "float";
-static const char gotoWord[] = "goto";
-static const char inlineWord[] = "inline";
-static const char longWord[] = "long";
-static const char returnWord[] = "return";
-static const char registerWord[] = "register";
-static const char restrictWord[] = "restrict";
-static const char volatileWord[] = "volatile";
-static const char voidWord[] = "void";
-static const char shortWord[] = "short";
-static const char sizeofWord[] = "sizeof";
-static const char staticWord[] = "static";
-static const char signedWord[] = "signed";
-static const char structWord[] = "struct";
-static const char switchWord[] = "switch";
-static const char alignofWord[] = "_Alignof";
-static const char typedefWord[] = "typedef";
-static const char unionWord[] = "union";
-static const char unsignedWord[] = "unsigned";
-static const char whileWord[] = "while";
-
-static void maybeSetupKeyword(Token *token) {
-  if (token->code != IDENTIFIER) return;
-  const char *pos = token->pos;
-  size_t length = token->length;
-  char c = pos[0];
-  uint32_t code, tokenCode;
-  uint64_t code8, tokenCode8;
-  switch (c) {
-  case 'a':
-      if (length == 4) {
-        code = *(uint32_t*)(autoWord);
-        tokenCode = *(uint32_t*)(pos);
-        if (tokenCode == code) {
-            token->code = AUTO;
-        }
-      }
-      return;
-  case 'b': // break
-      if (length == 5) {
-          code = *(uint32_t*)(&breakWord[1]);
-          tokenCode = *(uint32_t*)(&pos[1]);
-          if (tokenCode == code) {
-              token->code = BREAK;
-          }
-      }
-      return;
-  case 'c': // case | char | const | continue
-      if (length == 4) {
-          tokenCode = *(uint32_t*)(&pos[0]);
-          code = *(uint32_t*)caseWord;
-          if (code == tokenCode) {
-              token->code = CASE;
-              return;
-          }
-          code = *(uint32_t*)charWord;
-          if (code == tokenCode) {
-            token->code = CHAR;
-            return;
-          }
-      } else if (length == 5) {
-          tokenCode = *(uint32_t*)(&pos[1]);
-          code = *(uint32_t*)(&constWord[1]);
-          if (code == tokenCode) {
-              token->code = CONST;
-          }
-      } else if (length == 8) {
-          tokenCode8 = *(uint64_t*)(&pos[0]);
-          code8 = *(uint64_t*)continueWord;
-          if (tokenCode8 == code8) {
-              token->code = CONTINUE;
-          }
-      }
-      return;
-  case 'd': // default | do | double
-      if (length == 2 && pos[1] == 'o') {
-          token->code = DO;
-      } else if (length == 6) {
-          tokenCode = *(uint32_t*)(&pos[2]);
-          code = *(uint32_t*)(&doubleWord[2]);
-          if (pos[1] == 'o' && tokenCode == code) {
-              token->code = DOUBLE;
-          }
-      } else if (length == 7) {
-          tokenCode8 = *(uint64_t*)(&pos[0]);
-          tokenCode8 &= ~(0xFFUL << 56);
-          code8 = *(uint64_t*)defaultWord;
-          if (tokenCode8 == code8) {
-              token->code = DEFAULT;
-          }
-      }
-      return;
-  case 'e': // else | enum | extern
-      if (length == 4) {
-          tokenCode = *(uint32_t*)(&pos[0]);
-          code = *(uint32_t*)elseWord;
-          if (code == tokenCode) {
-              token->code = ELSE;
-              return;
-          }
-          code = *(uint32_t*)enumWord;
-          if (code == tokenCode) {
-            token->code = ENUM;
-            return;
-          }
-      } else if (length == 6) {
-          tokenCode = *(uint32_t*)(&pos[2]);
-          code = *(uint32_t*)(&externWord[2]);
-          if (pos[1] == 'x' && tokenCode == code) {
-              token->code = EXTERN;
-          }
-      }
-      return;
-  case 'f': // float | for
-      if (length == 5) {
-          code = *(uint32_t*)(&floatWord[1]);
-          tokenCode = *(uint32_t*)(&pos[1]);
-          if (tokenCode == code) {
-              token->code = FLOAT;
-          }
-      } else if (length == 3) {
-          if (pos[1] == 'o' && pos[2] == 'r') {
-              token->code = FOR;
-          }
-      }
-      return;
-  case 'g': // goto
-      if (length == 4) {
-          tokenCode = *(uint32_t*)(&pos[0]);
-          code = *(uint32_t*)(&gotoWord[0]);
-          if (code == tokenCode) {
-              token->code = GOTO;
-          }
-      }
-      return;
-  case 'i': // if | int
-      if (length == 2 && pos[1] == 'f') {
-          token->code = IF;
-      } else if (length == 3 && pos[1] == 'n' && pos[2] == 't') {
-          token->code = INT;
-      } else if (length == 6 && pos[1] == 'n') {
-          tokenCode = *(uint32_t*)(&pos[2]);
-          code = *(uint32_t*)(&inlineWord[2]);
-          if (code == tokenCode) {
-              token->code = INLINE;
-          }
-      }
-      return;
-  case 'l': // long
-      if (length == 4) {
-          tokenCode = *(uint32_t*)(&pos[0]);
-          code = *(uint32_t*)(&longWord[0]);
-          if (code == tokenCode) {
-              token->code = LONG;
-          }
-      }
-      return;
-  case 'r': // register | return
-      if (length == 6 && pos[1] == 'e') {
-          tokenCode = *(uint32_t*)(&pos[2]);
-          code = *(uint32_t*)(&returnWord[2]);
-          if (code == tokenCode) {
-              token->code = RETURN;
-          }
-      } else if (length == 8) {
-          tokenCode8 = *(uint64_t*)(&pos[0]);
-          code8 = *(uint64_t*)registerWord;
-          if (tokenCode8 == code8) {
-              token->code = REGISTER;
-              return;
-          }
-          code8 = *(uint64_t*)restrictWord;
-          if (tokenCode8 == code8) {
-              token->code = RESTRICT;
-              return;
-          }
-      }
-      return;
-  case 'v': // volatile | void
-      if (length == 4) {
-          tokenCode = *(uint32_t*)(&pos[0]);
-          code = *(uint32_t*)(&voidWord[0]);
-          if (code == tokenCode) {
-              token->code = VOID;
-          }
-      } else if (length == 8) {
-          tokenCode8 = *(uint64_t*)(&pos[0]);
-          code8 = *(uint64_t*)volatileWord;
-          if (tokenCode8 == code8) {
-              token->code = VOLATILE;
-          }
-      }
-      return;
-  case 's': // short | signed | sizeof | static | struct | switch
-      if (length == 5) {
-          code = *(uint32_t*)(&shortWord[1]);
-          tokenCode = *(uint32_t*)(&pos[1]);
-          if (tokenCode == code) {
-              token->code = SHORT;
-          }
-      } else if (length == 6) {
-          tokenCode = *(uint32_t*)(&pos[2]);
-          if (pos[1] == 'i') {
-              code = *(uint32_t*)(&signedWord[2]);
-              if (tokenCode == code) {
-                  token->code = SIGNED;
-                  return;
-              }
-              code = *(uint32_t*)(&sizeofWord[2]);
-              if (tokenCode == code) {
-                  token->code = SIZEOF;
-                  return;
-              }
-          } else if (pos[1]== 't') {
-              code = *(uint32_t*)(&staticWord[2]);
-              if (tokenCode == code) {
-                  token->code = STATIC;
-                  return;
-              }
-              code = *(uint32_t*)(&structWord[2]);
-              if (tokenCode == code) {
-                  token->code = STRUCT;
-                  return;
-              }
-          } else if (pos[1] == 'w') {
-              code = *(uint32_t*)(&switchWord[2]);
-              if (tokenCode == code) {
-                  token->code = SWITCH;
-                  return;
-              }
-          }
-      }
-      return;
-  case '_': // _Bool | _Alignof
-      if (length == 5) {
-        code = *(uint32_t*)(&boolWord[1]);
-        tokenCode = *(uint32_t*)(&pos[1]);
-        if (tokenCode == code) {
-            token->code = _BOOL;
-        }
-      } else if (length == 8) {
-          tokenCode8 = *(uint64_t*)(&pos[0]);
-          code8 = *(uint64_t*)alignofWord;
-          if (tokenCode8 == code8) {
-              token->code = ALIGNOF;
-          }
-      }
-      return;
-  case 't': // typedef
-      if (length == 7) {
-          tokenCode8 = *(uint64_t*)(&pos[0]);
-          tokenCode8 &= ~(0xFFUL << 56);
-          code8 = *(uint64_t*)typedefWord;
-          if (tokenCode8 == code8) {
-              token->code = TYPEDEF;
-          }
+      Token *t = lexCleanToken(ctx);
+
+      if (t->rawCode == END_OF_FILE) break;
+
+      if (w->total && t->startOfLine) {
+          writePPSymbols(w, "\n", 1);
       }
-      return;
-  case 'u': // union | unsigned
-      if (length == 5) {
-          code = *(uint32_t*)(&unionWord[1]);
-          tokenCode = *(uint32_t*)(&pos[1]);
-          if (tokenCode == code) {
-              token->code = UNION;
-          }
-      } else if (length == 8) {
-          tokenCode8 = *(uint64_t*)(&pos[0]);
-          code8 = *(uint64_t*)unsignedWord;
-          if (tokenCode8 == code8) {
-              token->code = UNSIGNED;
-          }
+
+      if (t->hasLeadingSpace || w->total && needSpace(w->last, p, t)) {
+          writePPSymbols(w, " ", 1);
       }
-      return;
-  case 'w': // while
-      if (length == 5) {
-          code = *(uint32_t*)(&whileWord[1]);
-          tokenCode = *(uint32_t*)(&pos[1]);
-          if (tokenCode == code) {
-              token->code = WHILE;
-          }
+
+      writePPSymbols(w, t->pos, t->length);
+
+      if (p) {
+          p->next = ctx->tokenWindow.freeList;
+          ctx->tokenWindow.freeList = p;
       }
+      p = t;
+  }
+
+  if (w->total) {
+      writePPSymbols(w, "\n", 1);
   }
+
+  flushPPWriter(w);
+  releaseHeap(w);
 }
 
+// =========== Preprocessed output ===============================//
+
+// =========== Token window ===============================//
+
+/**
+ * Parser sees tokens through a window which starts at ctx->firstToken and is recycled after every
+ * external declaration. AST keeps only pinned copies of original tokens, which are the only thing
+ * diagnostics need, so window tokens are put into free list and reused by allocToken.
+ */
+
+void retainCoordinates(ParserContext *ctx, Coordinates *coords) {
+  if (!ctx->tokenWindow.isOpen) return;
+
+  if (ctx->tokenWindow.retainedCount == ctx->tokenWindow.retainedCapacity) {
+      unsigned oldCapacity = ctx->tokenWindow.retainedCapacity;
+      unsigned newCapacity = oldCapacity ? oldCapacity << 1 : 256;
+      ctx->tokenWindow.retained = heapReallocate(ctx->tokenWindow.retained, oldCapacity * sizeof(Coordinates *), newCapacity * sizeof(Coordinates *));
+      ctx->tokenWindow.retainedCapacity = newCapacity;
+  }
+
+  ctx->tokenWindow.retained[ctx->tokenWindow.retainedCount++] = coords;
+}
+
+static Token *pinToken(ParserContext *ctx, Token *t) {
+  if (t == NULL || t->pinned) return t;
+
+  Token *origin = originalToken(t);
+
+  if (!origin->pinned) {
+      Token *copy = (Token *)areanAllocate(ctx->memory.tokenArena, sizeof(Token));
+      memcpy(copy, origin, sizeof(Token));
+      copy->expanded = copy->next = NULL;
+      copy->pinned = 1;
+      // other expansions of the same origin find the copy
+      origin->expanded = copy;
+      origin = copy;
+  }
+
+  t->expanded = origin;
+
+  return origin;
+}
+
+void recycleTokenWindow(ParserContext *ctx) {
+  unsigned i;
+
+  for (i = 0; i < ctx->tokenWindow.retainedCount; ++i) {
+      Coordinates *coords = ctx->tokenWindow.retained[i];
+      coords->left = pinToken(ctx, coords->left);
+      coords->right = pinToken(ctx, coords->right);
+  }
+
+  ctx->tokenWindow.retainedCount = 0;
+
+  Token *t = ctx->firstToken;
+  Token *current = ctx->token;
+
+  while (t != current) {
+      Token *next = t->next;
+      t->next = ctx->tokenWindow.freeList;
+      ctx->tokenWindow.freeList = t;
+      t = next;
+  }
+
+  ctx->firstToken = current;
+}
+
+// =========== Token window ===============================//
 
 Token *nextToken(ParserContext *ctx) {
 
@@ -1948,7 +2198,8 @@ Token *nextToken(ParserContext *ctx) {
     cur->next = next = lexCleanToken(ctx);
   }
 
-  if (next->rawCode == IDENTIFIER && !ctx->stateFlags.inPP) {
+  if (next->rawCode == IDENTIFIER && !isKeyword(next->code) && !ctx->stateFlags.inPP) {
+      // keywords are already classified by lexer
       if (isTypeName(ctx, next->id, ctx->currentScope)) {
           next->code = TYPE_NAME;
       } else {
@@ -1956,8 +2207,6 @@ Token *nextToken(ParserContext *ctx) {
         if (enumerator) {
           next->code = ENUM_CONST;
           next->value.iv = enumerator->value;
-        } else {
-          maybeSetupKeyword(next);
         }
       }
   }
@@ -298,6 +298,7 @@ int main(int argc, char** argv) {
   StringList lDirHead = { 0 }, *lDirCur = &lDirHead;
 
   unsigned inputCountC = 0;
+  unsigned inputCountH = 0;
   unsigned inputCountO = 0;
   unsigned libCount = 0;
   unsigned libDirCount = 0;
@@ -328,6 +329,22 @@ int main(int argc, char** argv) {
           fprintf(stderr, "file name expected after '-irDump' option");
           return 2;
         }
+    } else if (strcmp("-emit-pch", arg) == 0) {
+        unsigned idx = ++i;
+        if (idx < argc) {
+          config.pchOutput = argv[idx];
+        } else {
+          fprintf(stderr, "file name expected after '-emit-pch' option");
+          return 2;
+        }
+    } else if (strcmp("-include-pch", arg) == 0) {
+        unsigned idx = ++i;
+        if (idx < argc) {
+          config.pchInput = argv[idx];
+        } else {
+          fprintf(stderr, "file name expected after '-include-pch' option");
+          return 2;
+        }
     } else if (strcmp("-oneline", arg) == 0) {
       config.verbose = 0;
     } else if (strcmp("-memstat", arg) == 0) {
@@ -336,6 +353,8 @@ int main(int argc, char** argv) {
       config.logTokens = 1;
     } else if (strcmp("-skipCodegen", arg) == 0) {
       config.skipCodegen = 1;
+    } else if (strcmp("-pipeline", arg) == 0) {
+      config.pipeline = 1;
     } else if (strcmp("-E", arg) == 0) {
       config.ppOutput = 1;
     } else if (strncmp("-I", arg, 2) == 0) {
@@ -423,9 +442,10 @@ int main(int argc, char** argv) {
         unsigned l = strlen(arg);
         if (l > 2) {
            if (arg[l - 2] == '.') {
-               if (arg[l - 1] == 'c') {
+               if (arg[l - 1] == 'c' || arg[l - 1] == 'h') {
                   ccur = ccur->next = newStringNode(arg);
                   ++inputCountC;
+                  if (arg[l - 1] == 'h') ++inputCountH;
                   continue;
                } else if (arg[l - 1] == 'o' || arg[l - 1] == 'a') {
                   ++inputCountO;
@@ -452,9 +472,19 @@ int main(int argc, char** argv) {
       return 2;
   }
 
+  if (config.pchOutput && (inputCountC != 1 || config.ppOutput)) {
+      fprintf(stderr, "fatal error: '-emit-pch' expects exactly one header to precompile\n");
+      return 2;
+  }
+
+  if (inputCountH && !(config.pchOutput || config.ppOutput || config.skipCodegen)) {
+      fprintf(stderr, "fatal error: header input is only allowed with '-emit-pch', '-E' or '-skipCodegen'\n");
+      return 2;
+  }
+
   char *tmpDir = NULL;
   char template[] = "/tmp/tmpdir.XXXXXX";
-  if (!(config.objOutput || config.ppOutput)) {
+  if (!(config.objOutput || config.ppOutput || config.pchOutput)) {
       tmpDir = mkdtemp(template);
   }
 
@@ -462,7 +492,7 @@ int main(int argc, char** argv) {
 
   StringList *compiledObjFiles = compileFiles(chead.next, &config, tmpDir);
 
-  if (config.skipCodegen) return 0;
+  if (config.skipCodegen || config.pchOutput) return 0;
 
   if (!config.objOutput && !config.ppOutput) {
     runLinker(config.outputFile ? config.outputFile : "a.out", compiledObjFiles, ohead.next, lhead.next, lDirHead.next);
@@ -153,6 +153,15 @@ void *areanAllocate(Arena *arena, size_t _size) {
   return result;
 }
 
+static void releaseBigChuncks(HeapChunck *heap) {
+  while (heap) {
+      releaseHeap(heap->allocated);
+      HeapChunck *next = heap->next;
+      releaseHeap(heap);
+      heap = next;
+  }
+}
+
 void releaseArena(Arena *arena) {
   Chunck *chunck = arena->chuncks;
 
@@ -163,16 +172,24 @@ void releaseArena(Arena *arena) {
       chunck = next;
   }
 
-  HeapChunck *heap = arena->bigChuncks;
+  releaseBigChuncks(arena->bigChuncks);
 
-  while (heap) {
-      releaseHeap(heap->allocated);
-      HeapChunck *next = heap->next;
-      releaseHeap(heap);
-      heap = next;
+  releaseHeap(arena);
+}
+
+void resetArena(Arena *arena) {
+  Chunck *chunck = arena->chuncks;
+
+  while (chunck) {
+      // arena memory is handed out zeroed
+      memset(chunck->start, 0, chunck->pnt - chunck->start);
+      chunck->pnt = chunck->start;
+      chunck->avaliable = chunck->size;
+      chunck = chunck->next;
   }
 
-  releaseHeap(arena);
+  releaseBigChuncks(arena->bigChuncks);
+  arena->bigChuncks = NULL;
 }
 
 void printArenaStatistic(FILE *output, Arena *arena) {
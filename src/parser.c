@@ -18,6 +18,10 @@
 extern TypeDesc *errorTypeDescriptor;
 extern TypeDesc builtInTypeDescriptors[];
 
+// interned identifiers with special meaning in expressions
+static const char *builtinVaArgAtom;
+static const char *functionNameAtom;
+
 static Boolean nextTokenIf(ParserContext *ctx, int nextIf) {
     if (ctx->token->code == nextIf) {
         nextToken(ctx);
@@ -79,7 +83,7 @@ static void consumeOrSkip(ParserContext *ctx, int expected) {
 
 
 static AstStatementList *allocateStmtList(ParserContext *ctx, AstStatement *stmt) {
-  AstStatementList* result = (AstStatementList*)areanAllocate(ctx->memory.astArena, sizeof(AstStatementList));
+  AstStatementList* result = (AstStatementList*)areanAllocate(astNodeArena(ctx), sizeof(AstStatementList));
   result->stmt = stmt;
   return result;
 }
@@ -265,7 +269,13 @@ static Boolean parseAsIntConst(ParserContext *ctx, int64_t *result) {
         return FALSE;
     }
 
-    *result = (int)constExpr->i;
+    int64_t v = constExpr->i;
+    if (computeTypeSize(expression->type) == sizeof(int32_t)) {
+      // the folder keeps full precision, narrow back to the expression type
+      v = isUnsignedType(expression->type) ? (int64_t)(uint32_t)v : (int64_t)(int32_t)v;
+    }
+
+    *result = v;
     return TRUE;
 }
 
@@ -341,7 +351,7 @@ static AstExpression* parsePrimaryExpression(ParserContext *ctx) {
     TypeId typeId = T_ERROR;
     switch (ctx->token->code) {
         case IDENTIFIER:
-            if (strcmp("__builtin_va_arg", ctx->token->id) == 0) {
+            if (ctx->token->id == builtinVaArgAtom) {
               nextToken(ctx);
               consume(ctx, '(');
               AstExpression *valist = parseAssignmentExpression(ctx);
@@ -350,7 +360,7 @@ static AstExpression* parsePrimaryExpression(ParserContext *ctx) {
               coords.right = ctx->token;
               consume(ctx, ')');
               return va_arg_expression(ctx, &coords, valist, vatype);
-            } else if (strcmp("__FUNCTION__", ctx->token->id) == 0) {
+            } else if (ctx->token->id == functionNameAtom) {
               nextToken(ctx);
               const char *funName = ctx->parsingFunction->name;
               result = createAstConst(ctx, &coords, CK_STRING_LITERAL, &funName, strlen(funName) + 1);
@@ -381,7 +391,7 @@ static AstExpression* parsePrimaryExpression(ParserContext *ctx) {
         case F_CONSTANT: typeId = T_F4; goto fconst;
         case D_CONSTANT: typeId = T_F8; goto fconst;
         fconst: {
-            float80_const_t f = ctx->token->value.ldv;
+            float80_const_t f = *ctx->token->value.ldv;
             result = createAstConst(ctx, &coords, CK_FLOAT_CONST, &f, 0);
             result->type = makePrimitiveType(ctx, typeId, flags.storage);
             break;
@@ -395,7 +405,7 @@ static AstExpression* parsePrimaryExpression(ParserContext *ctx) {
 
             while (current->code == STRING_LITERAL) {
                 last = current;
-                length += current->value.text.l - 1;
+                length += current->value.text->l - 1;
                 current = nextToken(ctx);
             }
 
@@ -405,8 +415,8 @@ static AstExpression* parsePrimaryExpression(ParserContext *ctx) {
             const char *literal = buffer;
 
             while (first != last->next) {
-                size_t l = first->value.text.l;
-                memcpy(buffer, first->value.text.v, l - 1);
+                size_t l = first->value.text->l;
+                memcpy(buffer, first->value.text->v, l - 1);
                 buffer += (l - 1);
                 first = first->next;
             }
@@ -448,7 +458,7 @@ static AstExpressionList *parseArgumentExpressionList(ParserContext *ctx) {
 
     do {
       AstExpression *expr = parseAssignmentExpression(ctx);
-      AstExpressionList *node = (AstExpressionList*)areanAllocate(ctx->memory.astArena, sizeof(AstExpressionList));
+      AstExpressionList *node = (AstExpressionList*)areanAllocate(astNodeArena(ctx), sizeof(AstExpressionList));
       node->prev = tail;
       node->expression = expr;
       tail = tail->next = node;
@@ -502,6 +512,10 @@ static AstExpression* parsePostfixExpression(ParserContext *ctx) {
           consume(ctx, ')');
           ParsedInitializer *parsed = parseInitializer(ctx);
           AstInitializer *initializer = finalizeInitializer(ctx, literalType, parsed, ctx->stateFlags.inStaticScope);
+          if (literalType->kind == TR_ARRAY && initializer->slotType->kind == TR_ARRAY) {
+            // (int []) { 1, 2 } gets its size from initializer
+            literalType = initializer->slotType;
+          }
           coords.right = initializer->coordinates.right;
           ctx->stateFlags.returnStructBuffer = max(ctx->stateFlags.returnStructBuffer, computeTypeSize(literalType));
           left = createCompundExpression(ctx, &coords, initializer);
@@ -608,7 +622,7 @@ static void useLabelExpr(ParserContext *ctx, AstExpression *expr, AstStatement *
   DefinedLabel *l = ctx->labels.definedLabels;
 
   while (l) {
-      if (strcmp(l->label->label, label) == 0) {
+      if (l->label->label == label) {
           return;
       }
       l = l->next;
@@ -1280,6 +1294,7 @@ static EnumConstant *parseEnumeratorList(ParserContext *ctx) {
     if (nextTokenIf(ctx, '=')) {
       coords.right = ctx->token;
       parseAsIntConst(ctx, &v);
+      v = (int)v; // enumeration constants are ints
       idx = v + 1;
     } else {
       v = idx++;
@@ -1687,6 +1702,10 @@ done:;
     definition->members = members;
     definition->isFlexible = flexible;
 
+    if (isDefinition) {
+        indexStructualMembers(ctx, definition);
+    }
+
     return definition;
 }
 
@@ -2037,8 +2056,10 @@ static void parseDeclarationSpecifiers(ParserContext *ctx, DeclarationSpecifiers
             TypeDesc *typeDescriptor = NULL;
             if (name) { // TODO: should not be done here
                 int len = strlen(name);
-                char *symbolName = allocateString(ctx, len + 1 + 1);
-                size = sprintf(symbolName, "$%s", name);
+                char *tagName = len + 2 <= sizeof tmpBuf ? tmpBuf : heapAllocate(len + 2);
+                size = sprintf(tagName, "$%s", name);
+                const char *symbolName = internString(tagName, size);
+                if (tagName != tmpBuf) releaseHeap(tagName);
 
                 Symbol *s = NULL;
                 if (ssk == SSK_REFERENCE) {
@@ -2166,7 +2187,7 @@ static SpecifierFlags parseTypeQualifierList(ParserContext *ctx) {
 }
 
 static ParsedInitializer *allocParsedInitializer(ParserContext *ctx, Coordinates *coords, AstExpression *expr, int32_t level, enum ParsedLoc loc)  {
-  ParsedInitializer *p = areanAllocate(ctx->memory.astArena, sizeof(ParsedInitializer));
+  ParsedInitializer *p = areanAllocate(astNodeArena(ctx), sizeof(ParsedInitializer));
 
   p->coords = *coords;
   p->expression = expr;
@@ -2651,7 +2672,7 @@ static void defineLabel(ParserContext *ctx, const char *label, AstStatement *lbl
 
   while (defined) {
       assert(defined->label->kind == LK_LABEL);
-      if (strcmp(defined->label->label, label) == 0) {
+      if (defined->label->label == label) {
           redefinition = TRUE;
       }
       defined = defined->next;
@@ -2672,7 +2693,7 @@ static void defineLabel(ParserContext *ctx, const char *label, AstStatement *lbl
   UsedLabel *used = ctx->labels.usedLabels;
 
   while (used) {
-      if (strcmp(used->label, label) == 0) {
+      if (used->label == label) {
         *prev = used->next;
         UsedLabel *t = used;
         used = used->next;
@@ -3175,6 +3196,9 @@ static AstTranslationUnit *parseFunctionDeclaration(ParserContext *ctx, Declarat
 
   Scope *functionScope = functionalPart->parameters.scope;
 
+  // in pipeline mode the body lives until the function is generated, see parseFile
+  ctx->memory.bodyArena = ctx->memory.functionArena;
+
   AstValueDeclaration *va_area_var = NULL;
   ctx->locals = NULL;
   ctx->stateFlags.returnStructBuffer = 0;
@@ -3184,7 +3208,7 @@ static AstTranslationUnit *parseFunctionDeclaration(ParserContext *ctx, Declarat
   if (declaration->isVariadic) {
       TypeRef *vatype = makeArrayType(ctx, 4 + 6 + 8, makePrimitiveType(ctx, T_U8, 0));
       Coordinates vacoords = { ctx->token, ctx->token };
-      va_area_var = createAstValueDeclaration(ctx, &vacoords, VD_VARIABLE, vatype, "__va_area__", 0, 0, NULL);
+      va_area_var = createAstValueDeclaration(ctx, &vacoords, VD_VARIABLE, vatype, internCString("__va_area__"), 0, 0, NULL);
       va_area_var->flags.bits.isLocal = 1;
       va_area_var->symbol = declareValueSymbol(ctx, va_area_var->name, va_area_var);
   }
@@ -3272,6 +3296,10 @@ static AstDeclaration *parseDeclaration(ParserContext *ctx, DeclarationSpecifier
     }
     ParsedInitializer *parsedInit = parseInitializer(ctx);
     valueDeclaration->initializer = finalizeInitializer(ctx, type, parsedInit, isTopLevel);
+    if (type->kind == TR_ARRAY && type->arrayTypeDesc.size == UNKNOWN_SIZE && valueDeclaration->initializer->slotType->kind == TR_ARRAY) {
+      // int a[] = { 1, 2 }; gets its size from initializer
+      valueDeclaration->type = valueDeclaration->initializer->slotType;
+    }
   } else if (type->kind == TR_ARRAY && type->arrayTypeDesc.size == UNKNOWN_SIZE && !(specifiers->flags.bits.isExternal)) {
     reportDiagnostic(ctx, DIAG_ARRAY_EXPLICIT_SIZE_OR_INIT, &declarator->coordinates);
   }
@@ -3427,21 +3455,19 @@ static void initializeContext(ParserContext *ctx) {
 
   ctx->rootScope = ctx->currentScope = newScope(ctx, NULL);
 
-  ctx->macroMap = createHashMap(DEFAULT_MAP_CAPACITY, stringHashCode, stringCmp);
-  ctx->pragmaOnceMap = createHashMap(DEFAULT_MAP_CAPACITY, stringHashCode, stringCmp);
+  ctx->macroMap = createHashMap(DEFAULT_MAP_CAPACITY, atomHashCode, atomCmp);
+  ctx->pragmaOnceMap = createHashMap(DEFAULT_MAP_CAPACITY, atomHashCode, atomCmp);
+  ctx->includeGuardMap = createHashMap(DEFAULT_MAP_CAPACITY, atomHashCode, atomCmp);
+  ctx->typeTable = createHashMap(DEFAULT_MAP_CAPACITY, typeRefHashCode, typeRefCmp);
+
+  builtinVaArgAtom = internCString("__builtin_va_arg");
+  functionNameAtom = internCString("__FUNCTION__");
 
   initializeProprocessor(ctx);
 }
 
 static void releaseContext(ParserContext *ctx) {
 
-  Scope *scope = ctx->scopeList;
-
-  while (scope) {
-      releaseHashMap(scope->symbols);
-      scope = scope->next;
-  }
-
   releaseArena(ctx->memory.tokenArena);
   releaseArena(ctx->memory.macroArena);
   releaseArena(ctx->memory.typeArena);
@@ -3449,16 +3475,21 @@ static void releaseContext(ParserContext *ctx) {
   releaseArena(ctx->memory.stringArena);
   releaseArena(ctx->memory.diagnosticsArena);
   releaseArena(ctx->memory.codegenArena);
+  if (ctx->memory.functionArena) {
+      releaseArena(ctx->memory.functionArena);
+  }
+
+  releaseHeap(ctx->tokenWindow.retained);
 
   LocationInfo *locInfo = ctx->locationInfo;
 
   while (locInfo) {
       LocationInfo *next = locInfo->next;
-      if (locInfo->kind != LIK_CONST_MACRO) {
+      // file content is owned by process-wide file cache
+      if (locInfo->kind == LIK_MACRO) {
         releaseHeap((void*)locInfo->buffer);
-      }
-      if (locInfo->kind == LIK_FILE) {
-        releaseHeap(locInfo->fileInfo.linesPos);
+      } else {
+        releaseHeap(locInfo->fileInfo.chunks.items);
       }
       releaseHeap(locInfo);
 
@@ -3467,11 +3498,11 @@ static void releaseContext(ParserContext *ctx) {
 
   releaseHashMap(ctx->macroMap);
   releaseHashMap(ctx->pragmaOnceMap);
+  releaseHashMap(ctx->includeGuardMap);
+  releaseHashMap(ctx->typeTable);
 }
 
-static Boolean printDiagnostics(Diagnostics *diagnostics, Boolean verbose) {
-  Diagnostic *diagnostic = diagnostics->head;
-
+static Boolean printDiagnostics(Diagnostic *diagnostic, Boolean verbose) {
   Boolean hasError = FALSE;
 
   while (diagnostic) {
@@ -3487,20 +3518,60 @@ static Boolean printDiagnostics(Diagnostics *diagnostics, Boolean verbose) {
   return hasError;
 }
 
+/**
+ * Pipeline mode: the function definition which was just parsed and static data introduced by its body
+ * are generated right away and dropped from the file, so the function arena could be reset.
+ */
+static AstTranslationUnit *generateParsedFunction(ParserContext *ctx, FileCodegen *pipeline, AstFile *file, AstTranslationUnit *last) {
+  AstTranslationUnit *units = last ? last->next : file->units;
+
+  if (!ctx->diagnostics.errorCount) {
+      generateUnits(pipeline, units);
+  }
+
+  if (last) {
+      last->next = NULL;
+  } else {
+      file->units = NULL;
+  }
+  file->last = last;
+
+  ctx->memory.bodyArena = NULL;
+
+  return last;
+}
+
 /**
 translation_unit
     : external_declaration+
  */
-static AstFile *parseFile(ParserContext *ctx) {
+static AstFile *parseFile(ParserContext *ctx, FileCodegen *pipeline) {
   AstFile *astFile = createAstFile(ctx);
   ctx->parsedFile = astFile;
   astFile->fileName = ctx->config->fileToCompile;
+
+  ctx->tokenWindow.isOpen = 1;
   nextToken(ctx);
 
+  AstTranslationUnit *cannonized = NULL;
+
   while (ctx->token->code != END_OF_FILE) {
+      AstTranslationUnit *last = astFile->last;
       parseExternalDeclaration(ctx, astFile);
+      if (ctx->stateFlags.cannonizeUnits) {
+          cannonized = cannonizeParsedUnits(ctx, astFile, cannonized);
+      }
+      if (ctx->memory.bodyArena) {
+          cannonized = generateParsedFunction(ctx, pipeline, astFile, last);
+      }
+      recycleTokenWindow(ctx);
+      if (ctx->memory.functionArena) {
+          resetArena(ctx->memory.functionArena);
+      }
   }
 
+  ctx->tokenWindow.isOpen = 0;
+
   return astFile;
 }
 
@@ -3523,22 +3594,32 @@ static void printMemoryStatistics(ParserContext *ctx) {
   printArenaStatistic(stdout, ctx->memory.typeArena);
   printArenaStatistic(stdout, ctx->memory.diagnosticsArena);
   printArenaStatistic(stdout, ctx->memory.codegenArena);
+  if (ctx->memory.functionArena) {
+      printArenaStatistic(stdout, ctx->memory.functionArena);
+  }
+  printAtomsStatistic(stdout);
   fflush(stdout);
 }
 
 static void printPPOutput(ParserContext *ctx) {
-  const char *r = joinToStringTokenSequence(ctx, ctx->firstToken);
-  if (r) {
-    const char *cfgOutput = ctx->config->outputFile;
-    FILE *output = cfgOutput ? fopen(cfgOutput, "w") : stdout;
-    if (output) {
-      fprintf(output, "%s\n", r);
-      if (cfgOutput) fclose(output);
-      releaseHeap((char*)r);
-    } else {
-      fprintf(stderr, "cannot open file %s\n", cfgOutput);
-      exit(-3);
-    }
+  const char *cfgOutput = ctx->config->outputFile;
+  FILE *output = cfgOutput ? fopen(cfgOutput, "w") : stdout;
+  if (output) {
+    streamPreprocessedOutput(ctx, output);
+    if (cfgOutput) fclose(output);
+  } else {
+    fprintf(stderr, "cannot open file %s\n", cfgOutput);
+    exit(-3);
+  }
+}
+
+static void initArchCodegen(Configuration *config, ArchCodegen *cg) {
+  if (config->arch == X86_64) {
+    initArchCodegen_x86_64(cg);
+  } else if (config->arch == RISCV64) {
+    initArchCodegen_riscv64(cg);
+  } else {
+    unreachable("Unknown arch");
   }
 }
 
@@ -3561,16 +3642,36 @@ void compileFile(Configuration * config) {
   context.locationInfo = lex->fileContext.locInfo;
   context.lexerState = lex;
 
+  if (config->pchInput && !loadPrecompiledHeader(&context, config->pchInput)) {
+      releaseContext(&context);
+      return;
+  }
+
   if (config->ppOutput) {
-      context.firstToken = tokenizeBuffer(&context);
-      printDiagnostics(&context.diagnostics, config->verbose);
       printPPOutput(&context);
+      printDiagnostics(context.diagnostics.head, config->verbose);
       return;
   }
 
-  AstFile *astFile = parseFile(&context);
+  // the original tree is kept intact only when it is going to be dumped or translated to IR
+  context.stateFlags.cannonizeUnits = !config->dumpFileName && !config->experimental && !config->pchOutput;
 
-  Boolean hasError = printDiagnostics(&context.diagnostics, config->verbose);
+  ArchCodegen cg = {0};
+  FileCodegen *pipeline = NULL;
+
+  if (config->pipeline && context.stateFlags.cannonizeUnits && !config->canonDumpFileName && !config->skipCodegen) {
+      context.memory.functionArena = createArena("Function Arena", DEFAULT_CHUNCK_SIZE);
+      initArchCodegen(config, &cg);
+      pipeline = startFileCodegen(&context, &cg, config->fileToCompile);
+  }
+
+  AstFile *astFile = parseFile(&context, pipeline);
+
+  if (config->pchOutput) {
+      verifyPrecompiledUnits(&context, astFile);
+  }
+
+  Boolean hasError = printDiagnostics(context.diagnostics.head, config->verbose);
 
   if (config->memoryStatistics) {
       printMemoryStatistics(&context);
@@ -3580,7 +3681,11 @@ void compileFile(Configuration * config) {
       dumpFile(astFile, context.typeDefinitions, config->dumpFileName);
   }
 
-  if (!hasError) {
+  if (config->pchOutput) {
+      if (!hasError) {
+          writePrecompiledHeader(&context, config->pchOutput);
+      }
+  } else if (!hasError) {
 	if (config->experimental) {
 	  IrContext irCtx;
 	  initializeIrContext(&irCtx, &context);
@@ -3593,24 +3698,31 @@ void compileFile(Configuration * config) {
 
 	  releaseIrContext(&irCtx);
 	} else {
-	  cannonizeAstFile(&context, astFile);
+	  if (!context.stateFlags.cannonizeUnits) {
+		Diagnostic *printed = context.diagnostics.tail;
+		cannonizeAstFile(&context, astFile);
+		// constant folding may warn about overflows
+		printDiagnostics(printed ? printed->next : context.diagnostics.head, config->verbose);
+	  }
 	  if (config->canonDumpFileName) {
 		dumpFile(astFile, context.typeDefinitions, config->canonDumpFileName);
 	  }
 
-	  if (!config->skipCodegen) {
-		ArchCodegen cg = {0};
-		if (config->arch == X86_64) {
-		  initArchCodegen_x86_64(&cg);
-		} else if (config->arch == RISCV64) {
-		  initArchCodegen_riscv64(&cg);
-		} else {
-		  unreachable("Unknown arch");
-		}
+	  if (pipeline) {
+		// only file scope declarations are left
+		generateUnits(pipeline, astFile->units);
+		finishFileCodegen(pipeline, TRUE);
+		pipeline = NULL;
+	  } else if (!config->skipCodegen) {
+		initArchCodegen(config, &cg);
 		GeneratedFile *genFile = generateCodeForFile(&context, &cg, astFile);
 	  }
 	}
   }
 
+  if (pipeline) {
+      finishFileCodegen(pipeline, FALSE);
+  }
+
   releaseContext(&context);
 }
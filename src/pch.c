@@ -0,0 +1,1141 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "parser.h"
+#include "sema.h"
+#include "pp.h"
+
+extern TypeDesc *errorTypeDescriptor;
+extern TypeDesc builtInTypeDescriptors[];
+
+/**
+ * Precompiled header is a snapshot of preprocessor and file scope declaration state taken after a header
+ * prefix is parsed. Image is a header followed by sections of fixed size records, objects reference each other
+ * by record index + 1 (0 is NULL), so image is used right from mmapped memory and restoring it is a single
+ * pass per section. All names are kept in string section and get interned on load, spellings of macro
+ * tokens point right into the image.
+ *
+ * Only declarations are precompiled, prefix which defines functions or variables is rejected since there is
+ * nothing to hand to codegen for them.
+ */
+
+#define PCH_MAGIC 0x31484350 // "PCH1"
+#define PCH_VERSION 1
+
+enum PchSection {
+  PS_STRINGS,
+  PS_BLOB,
+  PS_TOKENS,
+  PS_PARAMS,
+  PS_MACROS,
+  PS_TYPE_REFS,
+  PS_TYPE_LISTS,
+  PS_TYPE_DESCS,
+  PS_TYPE_DEFS,
+  PS_MEMBERS,
+  PS_ENUMERATORS,
+  PS_VALUES,
+  PS_FUNCTIONS,
+  PS_SYMBOLS,
+  PS_ROOT,
+  PS_GUARDS,
+  PS_ONCE,
+  PS_COUNT
+};
+
+typedef struct {
+  uint32_t offset;
+  uint32_t count;
+} PchSectionRef;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t anonSymbolsCounter;
+  uint32_t typeDefinitions;
+  PchSectionRef sections[PS_COUNT];
+} PchHeader;
+
+typedef struct {
+  uint32_t offset; // in blob, string is followed by '\0'
+  uint32_t length;
+} PchString;
+
+enum {
+  PTF_LEADING_SPACE = 1,
+  PTF_START_OF_LINE = 2,
+  PTF_STRINGIFY = 4,
+  PTF_MACRO_PARAM = 8,
+  PTF_DISABLED_EXPANSION = 16
+};
+
+typedef struct {
+  int16_t code;
+  int16_t rawCode;
+  uint32_t flags;
+  uint32_t spelling;
+  uint32_t id;
+  uint64_t value; // integer value or string holding literal payload
+} PchToken;
+
+typedef struct {
+  uint32_t name;
+  uint32_t isVararg;
+} PchParam;
+
+enum {
+  PMF_VARARG = 1,
+  PMF_FUNCTIONAL = 2,
+  PMF_ENABLED = 4,
+  PMF_PARAMS_USED = 8
+};
+
+typedef struct {
+  uint32_t name;
+  uint32_t flags;
+  uint32_t params;
+  uint32_t paramCount;
+  uint32_t body;
+  uint32_t bodyLength;
+} PchMacro;
+
+// TR_VALUE: a = desc; TR_POINTED: a = pointed; TR_ARRAY: a = element, b = size, c = isStatic
+// TR_FUNCTION: a = return type, b = first param in type lists, c = param count | variadic bit
+// TR_BITFIELD: a = storage, b = offset, c = width
+typedef struct {
+  uint32_t kind;
+  uint32_t flags;
+  uint32_t a, b, c;
+} PchTypeRef;
+
+#define PCH_VARIADIC_BIT 0x80000000u
+
+typedef struct {
+  uint32_t typeId;
+  int32_t size;
+  uint32_t name;
+  uint32_t definition;
+} PchTypeDesc;
+
+typedef struct {
+  uint32_t kind;
+  uint32_t isDefined;
+  uint32_t isFlexible;
+  uint32_t name;
+  int32_t size;
+  int32_t align;
+  uint32_t body; // enumerator, member or type ref depending on kind
+  uint32_t next;
+} PchTypeDef;
+
+typedef struct {
+  uint32_t name;
+  uint32_t type;
+  int32_t offset;
+  uint32_t isFlexible;
+  uint32_t parent;
+  uint32_t next;
+} PchMember;
+
+typedef struct {
+  uint32_t name;
+  int32_t value;
+  uint32_t next;
+} PchEnumerator;
+
+typedef struct {
+  uint32_t kind;
+  uint32_t name;
+  uint32_t type;
+  uint32_t flags;
+  uint32_t symbol;
+  int32_t index2;
+  uint32_t index;
+  uint32_t next;
+} PchValue;
+
+typedef struct {
+  uint32_t flags;
+  uint32_t name;
+  uint32_t functionalType;
+  uint32_t returnType;
+  uint32_t parameterCount;
+  uint32_t parameters;
+  uint32_t isVariadic;
+  uint32_t symbol;
+  uint32_t structReturnSize;
+} PchFunction;
+
+typedef struct {
+  uint32_t kind;
+  uint32_t name;
+  uint32_t target; // record in section matching the kind
+} PchSymbol;
+
+typedef struct {
+  uint32_t key;
+  uint32_t value;
+} PchPair;
+
+static const size_t recordSizes[PS_COUNT] = {
+  sizeof(PchString),
+  1,
+  sizeof(PchToken),
+  sizeof(PchParam),
+  sizeof(PchMacro),
+  sizeof(PchTypeRef),
+  sizeof(uint32_t),
+  sizeof(PchTypeDesc),
+  sizeof(PchTypeDef),
+  sizeof(PchMember),
+  sizeof(PchEnumerator),
+  sizeof(PchValue),
+  sizeof(PchFunction),
+  sizeof(PchSymbol),
+  sizeof(PchPair),
+  sizeof(PchPair),
+  sizeof(uint32_t)
+};
+
+// =========== Verification ===============================//
+
+void verifyPrecompiledUnits(ParserContext *ctx, AstFile *file) {
+  AstTranslationUnit *unit = file->units;
+
+  for (; unit; unit = unit->next) {
+      if (unit->kind == TU_FUNCTION_DEFINITION) {
+          AstFunctionDeclaration *declaration = unit->definition->declaration;
+          reportDiagnostic(ctx, DIAG_PCH_UNSUPPORTED_DECLARATION, &declaration->coordinates, declaration->name);
+      } else if (unit->declaration->kind == DK_VAR) {
+          AstValueDeclaration *variable = unit->declaration->variableDeclaration;
+          if (!variable->flags.bits.isExternal || variable->initializer) {
+              reportDiagnostic(ctx, DIAG_PCH_UNSUPPORTED_DECLARATION, &variable->coordinates, variable->name);
+          }
+      }
+  }
+}
+
+// =========== Verification ===============================//
+
+// =========== Writer ===============================//
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+} PchBuffer;
+
+typedef struct {
+  PchBuffer sections[PS_COUNT];
+  HashMap *indexes[PS_COUNT]; // object -> index + 1
+  HashMap *atoms; // atom -> string index + 1
+} PchWriter;
+
+static int pointerHashCode(intptr_t v) {
+  uint64_t h = (uint64_t)v * 0x9E3779B97F4A7C15UL;
+  return (int)(h >> 32);
+}
+
+static int pointerCmp(intptr_t v1, intptr_t v2) {
+  return v1 != v2;
+}
+
+static uint32_t sectionCount(PchWriter *w, enum PchSection s) {
+  return w->sections[s].size / recordSizes[s];
+}
+
+// appends zeroed record and returns its index
+static uint32_t appendRecord(PchWriter *w, enum PchSection s) {
+  PchBuffer *b = &w->sections[s];
+  size_t size = recordSizes[s];
+
+  if (b->size + size > b->capacity) {
+      size_t newCapacity = b->capacity ? b->capacity << 1 : 1024;
+      while (b->size + size > newCapacity) newCapacity <<= 1;
+      b->data = heapReallocate(b->data, b->capacity, newCapacity);
+      b->capacity = newCapacity;
+  }
+
+  uint32_t index = sectionCount(w, s);
+  memset(b->data + b->size, 0, size);
+  b->size += size;
+
+  return index;
+}
+
+// records move on buffer growth so pointer is valid only until next append into the section
+static void *recordAt(PchWriter *w, enum PchSection s, uint32_t index) {
+  return w->sections[s].data + index * recordSizes[s];
+}
+
+static uint32_t writeString(PchWriter *w, const char *s, size_t length) {
+  uint32_t offset = w->sections[PS_BLOB].size;
+  size_t i;
+
+  for (i = 0; i <= length; ++i) {
+      uint32_t idx = appendRecord(w, PS_BLOB);
+      *(char *)recordAt(w, PS_BLOB, idx) = i < length ? s[i] : '\0';
+  }
+
+  uint32_t index = appendRecord(w, PS_STRINGS);
+  PchString *r = recordAt(w, PS_STRINGS, index);
+  r->offset = offset;
+  r->length = length;
+
+  return index + 1;
+}
+
+static uint32_t writeAtom(PchWriter *w, const char *atom) {
+  if (atom == NULL) return 0;
+
+  uint32_t ref = (uint32_t)getFromHashMap(w->atoms, (intptr_t)atom);
+  if (ref) return ref;
+
+  ref = writeString(w, atom, strlen(atom));
+  putToHashMap(w->atoms, (intptr_t)atom, ref);
+
+  return ref;
+}
+
+// returns existing reference to object or reserves a record for it, *isNew tells if it has to be filled
+static uint32_t reserveObject(PchWriter *w, enum PchSection s, const void *object, Boolean *isNew) {
+  uint32_t ref = (uint32_t)getFromHashMap(w->indexes[s], (intptr_t)object);
+
+  *isNew = ref == 0;
+
+  if (ref == 0) {
+      ref = appendRecord(w, s) + 1;
+      putToHashMap(w->indexes[s], (intptr_t)object, ref);
+  }
+
+  return ref;
+}
+
+static uint32_t writeTypeRef(PchWriter *w, const TypeRef *type);
+static uint32_t writeTypeDefinition(PchWriter *w, const TypeDefiniton *definition);
+static uint32_t writeSymbol(PchWriter *w, const Symbol *symbol);
+
+static uint32_t writeTypeDesc(PchWriter *w, const TypeDesc *desc) {
+  if (desc == NULL) return 0;
+
+  assert(desc != errorTypeDescriptor);
+
+  Boolean isNew;
+  uint32_t ref = reserveObject(w, PS_TYPE_DESCS, desc, &isNew);
+  if (!isNew) return ref;
+
+  uint32_t name = writeAtom(w, desc->name);
+  uint32_t definition = writeTypeDefinition(w, desc->typeDefinition);
+
+  PchTypeDesc *r = recordAt(w, PS_TYPE_DESCS, ref - 1);
+  r->typeId = desc->typeId;
+  r->size = desc->size;
+  r->name = name;
+  r->definition = definition;
+
+  return ref;
+}
+
+static uint32_t writeTypeRef(PchWriter *w, const TypeRef *type) {
+  if (type == NULL) return 0;
+
+  Boolean isNew;
+  uint32_t ref = reserveObject(w, PS_TYPE_REFS, type, &isNew);
+  if (!isNew) return ref;
+
+  uint32_t a = 0, b = 0, c = 0;
+
+  switch (type->kind) {
+    case TR_VALUE:
+      a = writeTypeDesc(w, type->descriptorDesc);
+      break;
+    case TR_POINTED:
+      a = writeTypeRef(w, type->pointed);
+      break;
+    case TR_ARRAY:
+      a = writeTypeRef(w, type->arrayTypeDesc.elementType);
+      b = (uint32_t)type->arrayTypeDesc.size;
+      c = type->arrayTypeDesc.isStatic;
+      break;
+    case TR_FUNCTION: {
+      TypeList *param = type->functionTypeDesc.parameters;
+      uint32_t first = sectionCount(w, PS_TYPE_LISTS);
+      uint32_t count = 0, i;
+
+      a = writeTypeRef(w, type->functionTypeDesc.returnType);
+
+      // reserve the run first, nested function types append their own runs
+      for (; param; param = param->next, ++count) {
+          appendRecord(w, PS_TYPE_LISTS);
+      }
+      for (i = 0, param = type->functionTypeDesc.parameters; param; param = param->next, ++i) {
+          uint32_t p = writeTypeRef(w, param->type);
+          *(uint32_t *)recordAt(w, PS_TYPE_LISTS, first + i) = p;
+      }
+
+      b = first;
+      c = count | (type->functionTypeDesc.isVariadic ? PCH_VARIADIC_BIT : 0);
+      break;
+    }
+    case TR_BITFIELD:
+      a = writeTypeRef(w, type->bitFieldDesc.storageType);
+      b = type->bitFieldDesc.offset;
+      c = type->bitFieldDesc.width;
+      break;
+    default:
+      // VLA is not possible at file scope
+      unreachable("unexpected type in precompiled declaration");
+  }
+
+  PchTypeRef *r = recordAt(w, PS_TYPE_REFS, ref - 1);
+  r->kind = type->kind;
+  r->flags = type->flags.storage;
+  r->a = a;
+  r->b = b;
+  r->c = c;
+
+  return ref;
+}
+
+static uint32_t writeEnumerator(PchWriter *w, const EnumConstant *enumerator) {
+  if (enumerator == NULL) return 0;
+
+  Boolean isNew;
+  uint32_t ref = reserveObject(w, PS_ENUMERATORS, enumerator, &isNew);
+  if (!isNew) return ref;
+
+  uint32_t name = writeAtom(w, enumerator->name);
+  uint32_t next = writeEnumerator(w, enumerator->next);
+
+  PchEnumerator *r = recordAt(w, PS_ENUMERATORS, ref - 1);
+  r->name = name;
+  r->value = enumerator->value;
+  r->next = next;
+
+  return ref;
+}
+
+static uint32_t writeMember(PchWriter *w, const StructualMember *member) {
+  if (member == NULL) return 0;
+
+  Boolean isNew;
+  uint32_t ref = reserveObject(w, PS_MEMBERS, member, &isNew);
+  if (!isNew) return ref;
+
+  uint32_t name = writeAtom(w, member->name);
+  uint32_t type = writeTypeRef(w, member->type);
+  uint32_t parent = writeMember(w, member->parent);
+  uint32_t next = writeMember(w, member->next);
+
+  PchMember *r = recordAt(w, PS_MEMBERS, ref - 1);
+  r->name = name;
+  r->type = type;
+  r->offset = member->offset;
+  r->isFlexible = member->isFlexible;
+  r->parent = parent;
+  r->next = next;
+
+  return ref;
+}
+
+static uint32_t writeTypeDefinition(PchWriter *w, const TypeDefiniton *definition) {
+  if (definition == NULL) return 0;
+
+  Boolean isNew;
+  uint32_t ref = reserveObject(w, PS_TYPE_DEFS, definition, &isNew);
+  if (!isNew) return ref;
+
+  uint32_t name = writeAtom(w, definition->name);
+  uint32_t body = 0;
+
+  switch (definition->kind) {
+    case TDK_ENUM: body = writeEnumerator(w, definition->enumerators); break;
+    case TDK_STRUCT:
+    case TDK_UNION: body = writeMember(w, definition->members); break;
+    case TDK_TYPEDEF: body = writeTypeRef(w, definition->type); break;
+  }
+
+  uint32_t next = writeTypeDefinition(w, definition->next);
+
+  PchTypeDef *r = recordAt(w, PS_TYPE_DEFS, ref - 1);
+  r->kind = definition->kind;
+  r->isDefined = definition->isDefined;
+  r->isFlexible = definition->isFlexible;
+  r->name = name;
+  r->size = definition->size;
+  r->align = definition->align;
+  r->body = body;
+  r->next = next;
+
+  return ref;
+}
+
+static uint32_t writeValue(PchWriter *w, const AstValueDeclaration *value) {
+  if (value == NULL) return 0;
+
+  Boolean isNew;
+  uint32_t ref = reserveObject(w, PS_VALUES, value, &isNew);
+  if (!isNew) return ref;
+
+  uint32_t name = writeAtom(w, value->name);
+  uint32_t type = writeTypeRef(w, value->type);
+  uint32_t symbol = writeSymbol(w, value->symbol);
+  uint32_t next = value->kind == VD_PARAMETER ? writeValue(w, value->next) : 0;
+
+  PchValue *r = recordAt(w, PS_VALUES, ref - 1);
+  r->kind = value->kind;
+  r->name = name;
+  r->type = type;
+  r->flags = value->flags.storage;
+  r->symbol = symbol;
+  r->index2 = value->index2;
+  r->index = value->kind == VD_PARAMETER ? value->index : 0;
+  r->next = next;
+
+  return ref;
+}
+
+static uint32_t writeFunction(PchWriter *w, const AstFunctionDeclaration *function) {
+  if (function == NULL) return 0;
+
+  Boolean isNew;
+  uint32_t ref = reserveObject(w, PS_FUNCTIONS, function, &isNew);
+  if (!isNew) return ref;
+
+  uint32_t name = writeAtom(w, function->name);
+  uint32_t functionalType = writeTypeRef(w, function->functionalType);
+  uint32_t returnType = writeTypeRef(w, function->returnType);
+  uint32_t parameters = writeValue(w, function->parameters);
+  uint32_t symbol = writeSymbol(w, function->symbol);
+
+  PchFunction *r = recordAt(w, PS_FUNCTIONS, ref - 1);
+  r->flags = function->flags.storage;
+  r->name = name;
+  r->functionalType = functionalType;
+  r->returnType = returnType;
+  r->parameterCount = function->parameterCount;
+  r->parameters = parameters;
+  r->isVariadic = function->isVariadic;
+  r->symbol = symbol;
+  r->structReturnSize = function->structReturnSize;
+
+  return ref;
+}
+
+static uint32_t writeSymbol(PchWriter *w, const Symbol *symbol) {
+  if (symbol == NULL) return 0;
+
+  Boolean isNew;
+  uint32_t ref = reserveObject(w, PS_SYMBOLS, symbol, &isNew);
+  if (!isNew) return ref;
+
+  uint32_t name = writeAtom(w, symbol->name);
+  uint32_t target = 0;
+
+  switch (symbol->kind) {
+    case FunctionSymbol: target = writeFunction(w, symbol->function); break;
+    case StructSymbol:
+    case UnionSymbol:
+    case EnumSymbol: target = writeTypeDesc(w, symbol->typeDescriptor); break;
+    case TypedefSymbol: target = writeTypeRef(w, symbol->typeref); break;
+    case ValueSymbol: target = writeValue(w, symbol->variableDesc); break;
+    case EnumConstSymbol: target = writeEnumerator(w, symbol->enumerator); break;
+    case TypeDefinitionSymbol: target = writeTypeDefinition(w, symbol->typeDefinition); break;
+  }
+
+  PchSymbol *r = recordAt(w, PS_SYMBOLS, ref - 1);
+  r->kind = symbol->kind;
+  r->name = name;
+  r->target = target;
+
+  return ref;
+}
+
+static uint32_t writeTokenSequence(PchWriter *w, const Token *t, uint32_t *length) {
+  uint32_t first = sectionCount(w, PS_TOKENS);
+  uint32_t count = 0;
+
+  for (; t; t = t->next, ++count) {
+      uint32_t spelling = writeString(w, t->pos, t->length);
+      uint32_t id = writeAtom(w, t->id);
+      uint64_t value = t->value.iv;
+
+      if (t->rawCode == STRING_LITERAL) {
+          value = writeString(w, t->value.text->v, t->value.text->l - 1);
+      } else if (t->rawCode == F_CONSTANT_RAW) {
+          value = writeString(w, (const char *)t->value.ldv, sizeof(long double));
+      }
+
+      uint32_t index = appendRecord(w, PS_TOKENS);
+      PchToken *r = recordAt(w, PS_TOKENS, index);
+      r->code = t->code;
+      r->rawCode = t->rawCode;
+      r->flags = (t->hasLeadingSpace ? PTF_LEADING_SPACE : 0)
+               | (t->startOfLine ? PTF_START_OF_LINE : 0)
+               | (t->macroStringitize ? PTF_STRINGIFY : 0)
+               | (t->isMacroParam ? PTF_MACRO_PARAM : 0)
+               | (t->disabledExpansion ? PTF_DISABLED_EXPANSION : 0);
+      r->spelling = spelling;
+      r->id = id;
+      r->value = value;
+  }
+
+  *length = count;
+
+  return first;
+}
+
+static void writeMacro(intptr_t key, intptr_t value, void *arg) {
+  PchWriter *w = (PchWriter *)arg;
+  const MacroDefinition *def = (const MacroDefinition *)value;
+
+  // builtin handlers and broken definitions are set up by preprocessor itself
+  if (def == NULL || def->handler) return;
+
+  uint32_t name = writeAtom(w, (const char *)key);
+  uint32_t params = sectionCount(w, PS_PARAMS);
+  uint32_t paramCount = 0;
+  const MacroParam *param = def->params;
+
+  for (; param; param = param->next, ++paramCount) {
+      uint32_t paramName = writeAtom(w, param->name);
+      uint32_t index = appendRecord(w, PS_PARAMS);
+      PchParam *p = recordAt(w, PS_PARAMS, index);
+      p->name = paramName;
+      p->isVararg = param->isVararg;
+  }
+
+  uint32_t bodyLength = 0;
+  uint32_t body = writeTokenSequence(w, def->body, &bodyLength);
+
+  uint32_t index = appendRecord(w, PS_MACROS);
+  PchMacro *r = recordAt(w, PS_MACROS, index);
+  r->name = name;
+  r->flags = (def->isVararg ? PMF_VARARG : 0)
+           | (def->isFunctional ? PMF_FUNCTIONAL : 0)
+           | (def->isEnabled ? PMF_ENABLED : 0)
+           | (def->isParamsUsed ? PMF_PARAMS_USED : 0);
+  r->params = params;
+  r->paramCount = paramCount;
+  r->body = body;
+  r->bodyLength = bodyLength;
+}
+
+static void writeRootSymbol(intptr_t key, intptr_t value, void *arg) {
+  PchWriter *w = (PchWriter *)arg;
+
+  uint32_t name = writeAtom(w, (const char *)key);
+  uint32_t symbol = writeSymbol(w, (const Symbol *)value);
+
+  uint32_t index = appendRecord(w, PS_ROOT);
+  PchPair *r = recordAt(w, PS_ROOT, index);
+  r->key = name;
+  r->value = symbol;
+}
+
+static void writeGuard(intptr_t key, intptr_t value, void *arg) {
+  PchWriter *w = (PchWriter *)arg;
+
+  uint32_t file = writeAtom(w, (const char *)key);
+  uint32_t macro = writeAtom(w, (const char *)value);
+
+  uint32_t index = appendRecord(w, PS_GUARDS);
+  PchPair *r = recordAt(w, PS_GUARDS, index);
+  r->key = file;
+  r->value = macro;
+}
+
+static void writeOnce(intptr_t key, intptr_t value, void *arg) {
+  PchWriter *w = (PchWriter *)arg;
+
+  uint32_t file = writeAtom(w, (const char *)key);
+  uint32_t index = appendRecord(w, PS_ONCE);
+  *(uint32_t *)recordAt(w, PS_ONCE, index) = file;
+}
+
+Boolean writePrecompiledHeader(ParserContext *ctx, const char *fileName) {
+  PchWriter w = { 0 };
+  unsigned s;
+
+  for (s = 0; s < PS_COUNT; ++s) {
+      w.indexes[s] = createHashMap(DEFAULT_MAP_CAPACITY, pointerHashCode, pointerCmp);
+  }
+  w.atoms = createHashMap(DEFAULT_MAP_CAPACITY, pointerHashCode, pointerCmp);
+
+  // builtin descriptors are shared by all contexts, they occupy first records and are never restored
+  for (s = 0; s < T_BUILT_IN_TYPES; ++s) {
+      Boolean isNew;
+      reserveObject(&w, PS_TYPE_DESCS, &builtInTypeDescriptors[s], &isNew);
+      ((PchTypeDesc *)recordAt(&w, PS_TYPE_DESCS, s))->typeId = s;
+  }
+
+  foreachHashMap(ctx->macroMap, writeMacro, &w);
+  foreachHashMap(ctx->rootScope->symbols, writeRootSymbol, &w);
+  foreachHashMap(ctx->includeGuardMap, writeGuard, &w);
+  foreachHashMap(ctx->pragmaOnceMap, writeOnce, &w);
+
+  PchHeader header = { 0 };
+  header.magic = PCH_MAGIC;
+  header.version = PCH_VERSION;
+  header.anonSymbolsCounter = ctx->anonSymbolsCounter;
+  header.typeDefinitions = writeTypeDefinition(&w, ctx->typeDefinitions);
+
+  // every section starts 8-byte aligned so records could be read in place
+  size_t offset = (sizeof header + 7) & ~7UL;
+  for (s = 0; s < PS_COUNT; ++s) {
+      header.sections[s].offset = offset;
+      header.sections[s].count = sectionCount(&w, s);
+      offset += (w.sections[s].size + 7) & ~7UL;
+  }
+
+  Boolean result = TRUE;
+  FILE *output = fopen(fileName, "wb");
+
+  if (output) {
+      static const uint8_t padding[8] = { 0 };
+      fwrite(&header, sizeof header, 1, output);
+      fwrite(padding, ((sizeof header + 7) & ~7UL) - sizeof header, 1, output);
+      for (s = 0; s < PS_COUNT; ++s) {
+          size_t size = w.sections[s].size;
+          if (size) fwrite(w.sections[s].data, size, 1, output);
+          fwrite(padding, ((size + 7) & ~7UL) - size, 1, output);
+      }
+      result = ferror(output) == 0;
+      fclose(output);
+  } else {
+      result = FALSE;
+  }
+
+  if (!result) {
+      fprintf(stderr, "Cannot write precompiled header %s\n", fileName);
+  }
+
+  for (s = 0; s < PS_COUNT; ++s) {
+      releaseHeap(w.sections[s].data);
+      releaseHashMap(w.indexes[s]);
+  }
+  releaseHashMap(w.atoms);
+
+  return result;
+}
+
+// =========== Writer ===============================//
+
+// =========== Reader ===============================//
+
+typedef struct {
+  ParserContext *ctx;
+  const uint8_t *image;
+  const PchHeader *header;
+  const char *blob;
+  const char **atoms; // interned lazily, string index -> atom
+  Coordinates coordinates; // all restored declarations point here
+
+  Token *tokens;
+  TypeRef *typeRefs;
+  TypeList *typeLists;
+  TypeDesc *typeDescs;
+  TypeDefiniton *typeDefs;
+  StructualMember *members;
+  EnumConstant *enumerators;
+  AstValueDeclaration *values;
+  AstFunctionDeclaration *functions;
+  Symbol *symbols;
+} PchReader;
+
+static const void *sectionRecords(PchReader *r, enum PchSection s) {
+  return r->image + r->header->sections[s].offset;
+}
+
+static uint32_t recordCount(PchReader *r, enum PchSection s) {
+  return r->header->sections[s].count;
+}
+
+static const PchString *stringRecord(PchReader *r, uint32_t ref) {
+  return &((const PchString *)sectionRecords(r, PS_STRINGS))[ref - 1];
+}
+
+static const char *spellingAt(PchReader *r, uint32_t ref) {
+  return ref ? r->blob + stringRecord(r, ref)->offset : NULL;
+}
+
+static const char *atomAt(PchReader *r, uint32_t ref) {
+  if (ref == 0) return NULL;
+
+  if (r->atoms[ref - 1] == NULL) {
+      const PchString *s = stringRecord(r, ref);
+      r->atoms[ref - 1] = internString(r->blob + s->offset, s->length);
+  }
+
+  return r->atoms[ref - 1];
+}
+
+#define PCH_OBJECT(array, ref) ((ref) ? &(array)[(ref) - 1] : NULL)
+
+static TypeDesc *typeDescAt(PchReader *r, uint32_t ref) {
+  if (ref == 0) return NULL;
+  if (ref <= T_BUILT_IN_TYPES) return &builtInTypeDescriptors[ref - 1];
+  return &r->typeDescs[ref - 1 - T_BUILT_IN_TYPES];
+}
+
+static void *allocateObjects(Arena *arena, size_t count, size_t size) {
+  if (count == 0) return NULL;
+
+  void *objects = areanAllocate(arena, count * size);
+  memset(objects, 0, count * size);
+
+  return objects;
+}
+
+static Boolean checkImage(const uint8_t *image, size_t size) {
+  if (size < sizeof(PchHeader)) return FALSE;
+
+  const PchHeader *header = (const PchHeader *)image;
+  if (header->magic != PCH_MAGIC || header->version != PCH_VERSION) return FALSE;
+
+  unsigned s;
+  for (s = 0; s < PS_COUNT; ++s) {
+      uint64_t end = (uint64_t)header->sections[s].offset + (uint64_t)header->sections[s].count * recordSizes[s];
+      if (end > size) return FALSE;
+  }
+
+  return header->sections[PS_TYPE_DESCS].count >= T_BUILT_IN_TYPES;
+}
+
+static void restoreMacros(PchReader *r) {
+  ParserContext *ctx = r->ctx;
+  const PchToken *tokens = sectionRecords(r, PS_TOKENS);
+  const PchParam *params = sectionRecords(r, PS_PARAMS);
+  const PchMacro *macros = sectionRecords(r, PS_MACROS);
+  uint32_t count = recordCount(r, PS_TOKENS);
+  uint32_t i, j;
+
+  LocationInfo *locInfo = r->coordinates.left->locInfo;
+
+  r->tokens = allocateObjects(ctx->memory.macroArena, count, sizeof(Token));
+
+  for (i = 0; i < count; ++i) {
+      const PchToken *p = &tokens[i];
+      Token *t = &r->tokens[i];
+
+      t->locInfo = locInfo;
+      t->pos = spellingAt(r, p->spelling);
+      t->length = stringRecord(r, p->spelling)->length;
+      t->id = atomAt(r, p->id);
+      t->code = p->code;
+      t->rawCode = p->rawCode;
+      t->hasLeadingSpace = (p->flags & PTF_LEADING_SPACE) != 0;
+      t->startOfLine = (p->flags & PTF_START_OF_LINE) != 0;
+      t->macroStringitize = (p->flags & PTF_STRINGIFY) != 0;
+      t->isMacroParam = (p->flags & PTF_MACRO_PARAM) != 0;
+      t->disabledExpansion = (p->flags & PTF_DISABLED_EXPANSION) != 0;
+
+      if (p->rawCode == STRING_LITERAL) {
+          TokenText *text = (TokenText *)allocateString(ctx, sizeof(TokenText));
+          text->v = spellingAt(r, (uint32_t)p->value);
+          text->l = stringRecord(r, (uint32_t)p->value)->length + 1;
+          t->value.text = text;
+      } else if (p->rawCode == F_CONSTANT_RAW) {
+          long double *ldv = (long double *)allocateString(ctx, sizeof(long double));
+          memcpy(ldv, spellingAt(r, (uint32_t)p->value), sizeof(long double));
+          t->value.ldv = ldv;
+      } else {
+          t->value.iv = p->value;
+      }
+  }
+
+  for (i = 0; i < recordCount(r, PS_MACROS); ++i) {
+      const PchMacro *m = &macros[i];
+      MacroParam head = { 0 }, *cur = &head;
+
+      for (j = 0; j < m->paramCount; ++j) {
+          cur = cur->next = allocateMacroParam(ctx, atomAt(r, params[m->params + j].name));
+          cur->isVararg = params[m->params + j].isVararg != 0;
+      }
+
+      Token *body = m->bodyLength ? &r->tokens[m->body] : NULL;
+      for (j = 1; j < m->bodyLength; ++j) {
+          r->tokens[m->body + j - 1].next = &r->tokens[m->body + j];
+      }
+
+      const char *name = atomAt(r, m->name);
+      MacroDefinition *def = allocateMacroDef(ctx, name, head.next, body, (m->flags & PMF_VARARG) != 0, (m->flags & PMF_FUNCTIONAL) != 0);
+      def->isEnabled = (m->flags & PMF_ENABLED) != 0;
+      def->isParamsUsed = (m->flags & PMF_PARAMS_USED) != 0;
+
+      putToHashMap(ctx->macroMap, (intptr_t)name, (intptr_t)def);
+  }
+}
+
+static void restoreTypes(PchReader *r) {
+  ParserContext *ctx = r->ctx;
+  Arena *arena = ctx->memory.typeArena;
+  const PchTypeRef *typeRefs = sectionRecords(r, PS_TYPE_REFS);
+  const uint32_t *typeLists = sectionRecords(r, PS_TYPE_LISTS);
+  const PchTypeDesc *typeDescs = sectionRecords(r, PS_TYPE_DESCS);
+  const PchTypeDef *typeDefs = sectionRecords(r, PS_TYPE_DEFS);
+  const PchMember *members = sectionRecords(r, PS_MEMBERS);
+  const PchEnumerator *enumerators = sectionRecords(r, PS_ENUMERATORS);
+  uint32_t i;
+
+  uint32_t descCount = recordCount(r, PS_TYPE_DESCS) - T_BUILT_IN_TYPES;
+
+  r->typeRefs = allocateObjects(arena, recordCount(r, PS_TYPE_REFS), sizeof(TypeRef));
+  r->typeLists = allocateObjects(arena, recordCount(r, PS_TYPE_LISTS), sizeof(TypeList));
+  r->typeDescs = allocateObjects(arena, descCount, sizeof(TypeDesc));
+  r->typeDefs = allocateObjects(arena, recordCount(r, PS_TYPE_DEFS), sizeof(TypeDefiniton));
+  r->members = allocateObjects(arena, recordCount(r, PS_MEMBERS), sizeof(StructualMember));
+  r->enumerators = allocateObjects(arena, recordCount(r, PS_ENUMERATORS), sizeof(EnumConstant));
+
+  for (i = 0; i < recordCount(r, PS_TYPE_LISTS); ++i) {
+      r->typeLists[i].type = PCH_OBJECT(r->typeRefs, typeLists[i]);
+  }
+
+  for (i = 0; i < recordCount(r, PS_TYPE_REFS); ++i) {
+      const PchTypeRef *p = &typeRefs[i];
+      TypeRef *t = &r->typeRefs[i];
+
+      t->kind = p->kind;
+      t->flags.storage = p->flags;
+
+      switch (t->kind) {
+        case TR_VALUE:
+          t->descriptorDesc = typeDescAt(r, p->a);
+          break;
+        case TR_POINTED:
+          t->pointed = PCH_OBJECT(r->typeRefs, p->a);
+          break;
+        case TR_ARRAY:
+          t->arrayTypeDesc.elementType = PCH_OBJECT(r->typeRefs, p->a);
+          t->arrayTypeDesc.size = (int)p->b;
+          t->arrayTypeDesc.isStatic = p->c != 0;
+          break;
+        case TR_FUNCTION: {
+          uint32_t count = p->c & ~PCH_VARIADIC_BIT, j;
+          t->functionTypeDesc.returnType = PCH_OBJECT(r->typeRefs, p->a);
+          t->functionTypeDesc.isVariadic = (p->c & PCH_VARIADIC_BIT) != 0;
+          t->functionTypeDesc.parameters = count ? &r->typeLists[p->b] : NULL;
+          for (j = 1; j < count; ++j) {
+              r->typeLists[p->b + j - 1].next = &r->typeLists[p->b + j];
+          }
+          break;
+        }
+        case TR_BITFIELD:
+          t->bitFieldDesc.storageType = PCH_OBJECT(r->typeRefs, p->a);
+          t->bitFieldDesc.offset = p->b;
+          t->bitFieldDesc.width = p->c;
+          break;
+        default:
+          unreachable("unexpected type ref in precompiled header");
+      }
+  }
+
+  for (i = 0; i < descCount; ++i) {
+      const PchTypeDesc *p = &typeDescs[T_BUILT_IN_TYPES + i];
+      TypeDesc *d = &r->typeDescs[i];
+
+      d->typeId = p->typeId;
+      d->size = p->size;
+      d->name = atomAt(r, p->name);
+      d->typeDefinition = PCH_OBJECT(r->typeDefs, p->definition);
+  }
+
+  for (i = 0; i < recordCount(r, PS_TYPE_DEFS); ++i) {
+      const PchTypeDef *p = &typeDefs[i];
+      TypeDefiniton *d = &r->typeDefs[i];
+
+      d->coordinates = r->coordinates;
+      d->kind = p->kind;
+      d->isDefined = p->isDefined != 0;
+      d->isFlexible = p->isFlexible != 0;
+      d->name = atomAt(r, p->name);
+      d->size = p->size;
+      d->align = p->align;
+      d->scope = ctx->rootScope;
+      d->next = PCH_OBJECT(r->typeDefs, p->next);
+
+      switch (d->kind) {
+        case TDK_ENUM: d->enumerators = PCH_OBJECT(r->enumerators, p->body); break;
+        case TDK_STRUCT:
+        case TDK_UNION: d->members = PCH_OBJECT(r->members, p->body); break;
+        case TDK_TYPEDEF: d->type = PCH_OBJECT(r->typeRefs, p->body); break;
+      }
+  }
+
+  for (i = 0; i < recordCount(r, PS_MEMBERS); ++i) {
+      const PchMember *p = &members[i];
+      StructualMember *m = &r->members[i];
+
+      m->coordinates = r->coordinates;
+      m->name = atomAt(r, p->name);
+      m->type = PCH_OBJECT(r->typeRefs, p->type);
+      m->offset = p->offset;
+      m->isFlexible = p->isFlexible;
+      m->parent = PCH_OBJECT(r->members, p->parent);
+      m->next = PCH_OBJECT(r->members, p->next);
+  }
+
+  for (i = 0; i < recordCount(r, PS_ENUMERATORS); ++i) {
+      const PchEnumerator *p = &enumerators[i];
+      EnumConstant *e = &r->enumerators[i];
+
+      e->coordinates = r->coordinates;
+      e->name = atomAt(r, p->name);
+      e->value = p->value;
+      e->next = PCH_OBJECT(r->enumerators, p->next);
+  }
+
+  for (i = 0; i < recordCount(r, PS_TYPE_DEFS); ++i) {
+      TypeDefiniton *d = &r->typeDefs[i];
+      if (d->isDefined && (d->kind == TDK_STRUCT || d->kind == TDK_UNION)) {
+          indexStructualMembers(ctx, d);
+      }
+  }
+}
+
+static void restoreDeclarations(PchReader *r) {
+  ParserContext *ctx = r->ctx;
+  const PchValue *values = sectionRecords(r, PS_VALUES);
+  const PchFunction *functions = sectionRecords(r, PS_FUNCTIONS);
+  const PchSymbol *symbols = sectionRecords(r, PS_SYMBOLS);
+  const PchPair *root = sectionRecords(r, PS_ROOT);
+  uint32_t i;
+
+  r->values = allocateObjects(ctx->memory.astArena, recordCount(r, PS_VALUES), sizeof(AstValueDeclaration));
+  r->functions = allocateObjects(ctx->memory.astArena, recordCount(r, PS_FUNCTIONS), sizeof(AstFunctionDeclaration));
+  r->symbols = allocateObjects(ctx->memory.typeArena, recordCount(r, PS_SYMBOLS), sizeof(Symbol));
+
+  for (i = 0; i < recordCount(r, PS_VALUES); ++i) {
+      const PchValue *p = &values[i];
+      AstValueDeclaration *v = &r->values[i];
+
+      v->coordinates = r->coordinates;
+      v->kind = p->kind;
+      v->name = atomAt(r, p->name);
+      v->type = PCH_OBJECT(r->typeRefs, p->type);
+      v->flags.storage = p->flags;
+      v->symbol = PCH_OBJECT(r->symbols, p->symbol);
+      v->index2 = p->index2;
+      if (v->kind == VD_PARAMETER) {
+          v->index = p->index;
+          v->next = PCH_OBJECT(r->values, p->next);
+      }
+  }
+
+  for (i = 0; i < recordCount(r, PS_FUNCTIONS); ++i) {
+      const PchFunction *p = &functions[i];
+      AstFunctionDeclaration *f = &r->functions[i];
+
+      f->coordinates = r->coordinates;
+      f->flags.storage = p->flags;
+      f->name = atomAt(r, p->name);
+      f->functionalType = PCH_OBJECT(r->typeRefs, p->functionalType);
+      f->returnType = PCH_OBJECT(r->typeRefs, p->returnType);
+      f->parameterCount = p->parameterCount;
+      f->parameters = PCH_OBJECT(r->values, p->parameters);
+      f->isVariadic = p->isVariadic != 0;
+      f->symbol = PCH_OBJECT(r->symbols, p->symbol);
+      f->structReturnSize = p->structReturnSize;
+  }
+
+  for (i = 0; i < recordCount(r, PS_SYMBOLS); ++i) {
+      const PchSymbol *p = &symbols[i];
+      Symbol *s = &r->symbols[i];
+
+      s->kind = p->kind;
+      s->name = atomAt(r, p->name);
+
+      switch (s->kind) {
+        case FunctionSymbol: s->function = PCH_OBJECT(r->functions, p->target); break;
+        case StructSymbol:
+        case UnionSymbol:
+        case EnumSymbol: s->typeDescriptor = typeDescAt(r, p->target); break;
+        case TypedefSymbol: s->typeref = PCH_OBJECT(r->typeRefs, p->target); break;
+        case ValueSymbol: s->variableDesc = PCH_OBJECT(r->values, p->target); break;
+        case EnumConstSymbol: s->enumerator = PCH_OBJECT(r->enumerators, p->target); break;
+        case TypeDefinitionSymbol: s->typeDefinition = PCH_OBJECT(r->typeDefs, p->target); break;
+      }
+  }
+
+  for (i = 0; i < recordCount(r, PS_ROOT); ++i) {
+      putToHashMap(ctx->rootScope->symbols, (intptr_t)atomAt(r, root[i].key), (intptr_t)PCH_OBJECT(r->symbols, root[i].value));
+  }
+
+  ctx->typeDefinitions = PCH_OBJECT(r->typeDefs, r->header->typeDefinitions);
+  ctx->anonSymbolsCounter = r->header->anonSymbolsCounter;
+}
+
+static void restoreIncludeState(PchReader *r) {
+  ParserContext *ctx = r->ctx;
+  const PchPair *guards = sectionRecords(r, PS_GUARDS);
+  const uint32_t *once = sectionRecords(r, PS_ONCE);
+  uint32_t i;
+
+  for (i = 0; i < recordCount(r, PS_GUARDS); ++i) {
+      putToHashMap(ctx->includeGuardMap, (intptr_t)atomAt(r, guards[i].key), (intptr_t)atomAt(r, guards[i].value));
+  }
+
+  for (i = 0; i < recordCount(r, PS_ONCE); ++i) {
+      const char *file = atomAt(r, once[i]);
+      putToHashMap(ctx->pragmaOnceMap, (intptr_t)file, (intptr_t)file);
+  }
+}
+
+// image is mapped once per process and shared by all compiled files
+static struct {
+  const char *fileName;
+  const uint8_t *image;
+  size_t size;
+} loadedImage;
+
+Boolean loadPrecompiledHeader(ParserContext *ctx, const char *fileName) {
+  fileName = internCString(fileName);
+
+  if (loadedImage.fileName != fileName) {
+      size_t size = 0;
+      const char *image = readFileToBuffer(fileName, &size);
+      if (image == NULL) {
+          fprintf(stderr, "Cannot open precompiled header %s\n", fileName);
+          return FALSE;
+      }
+      loadedImage.fileName = fileName;
+      loadedImage.image = (const uint8_t *)image;
+      loadedImage.size = size - 1;
+  }
+
+  if (!checkImage(loadedImage.image, loadedImage.size)) {
+      fprintf(stderr, "Precompiled header %s is corrupted or made by another version\n", fileName);
+      return FALSE;
+  }
+
+  PchReader r = { 0 };
+  r.ctx = ctx;
+  r.image = loadedImage.image;
+  r.header = (const PchHeader *)loadedImage.image;
+  r.blob = (const char *)sectionRecords(&r, PS_BLOB);
+  r.atoms = heapAllocate(sizeof(const char *) * (recordCount(&r, PS_STRINGS) + 1));
+
+  // restored entities have no source, diagnostics point to the image as to a macro buffer
+  LocationInfo *locInfo = allocateMacroLocationInfo(r.blob, recordCount(&r, PS_BLOB), TRUE);
+  locInfo->next = ctx->locationInfo;
+  ctx->locationInfo = locInfo;
+
+  Token *origin = (Token *)areanAllocate(ctx->memory.tokenArena, sizeof(Token));
+  memset(origin, 0, sizeof(Token));
+  origin->locInfo = locInfo;
+  origin->pos = r.blob;
+  origin->pinned = 1;
+  r.coordinates.left = r.coordinates.right = origin;
+
+  restoreMacros(&r);
+  restoreTypes(&r);
+  restoreDeclarations(&r);
+  restoreIncludeState(&r);
+
+  releaseHeap(r.atoms);
+
+  return TRUE;
+}
+
+// =========== Reader ===============================//
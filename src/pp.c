@@ -19,6 +19,45 @@ extern char *ctime_r (const time_t *__timer, char *__buf);
 
 static int counterState = 0;
 
+// interned spellings of directives and special identifiers, they are compared by pointer
+static const char *includeAtom;
+static const char *includeNextAtom;
+static const char *defineAtom;
+static const char *undefAtom;
+static const char *ifAtom;
+static const char *elifAtom;
+static const char *elseAtom;
+static const char *endifAtom;
+static const char *ifdefAtom;
+static const char *ifndefAtom;
+static const char *pragmaAtom;
+static const char *lineAtom;
+static const char *errorAtom;
+static const char *warningAtom;
+static const char *definedAtom;
+static const char *onceAtom;
+static const char *vaArgsAtom;
+
+static void initializeAtoms() {
+  includeAtom = internCString("include");
+  includeNextAtom = internCString("include_next");
+  defineAtom = internCString("define");
+  undefAtom = internCString("undef");
+  ifAtom = internCString("if");
+  elifAtom = internCString("elif");
+  elseAtom = internCString("else");
+  endifAtom = internCString("endif");
+  ifdefAtom = internCString("ifdef");
+  ifndefAtom = internCString("ifndef");
+  pragmaAtom = internCString("pragma");
+  lineAtom = internCString("line");
+  errorAtom = internCString("error");
+  warningAtom = internCString("warning");
+  definedAtom = internCString("defined");
+  onceAtom = internCString("once");
+  vaArgsAtom = internCString("__VA_ARGS__");
+}
+
 MacroDefinition *allocateMacroDef(ParserContext *ctx, const char *name, MacroParam *params, Token *body, Boolean isVararg, Boolean isFunc) {
   MacroDefinition *d = areanAllocate(ctx->memory.macroArena, sizeof(MacroDefinition));
 
@@ -137,14 +176,16 @@ static Token *stringToken(ParserContext *ctx, Token *p, const char *s) {
 }
 
 
-Token *stringifySequence(ParserContext *ctx, Token *s) {
-  Token *t = s, *p = NULL;
-
-  size_t bufferSize = 0;
-
-  Boolean first = TRUE;
+/**
+ * Spelling of the result is built together with its value, the value is the spelling without
+ * added escapes so the literal is not lexed again. Sequences with stray backslash or line
+ * continuation inside are left to the lexer as their escapes are not ours.
+ */
+static Token *stringifySequence(ParserContext *ctx, Token *s, Token *macro) {
+  Token *t = s;
 
   StringBuffer sb = { 0 };
+  Boolean needLexing = FALSE;
 
   putSymbol(&sb, '"');
   Boolean isFirst = TRUE;
@@ -154,6 +195,7 @@ Token *stringifySequence(ParserContext *ctx, Token *s) {
           putSymbol(&sb, ' ');
       }
       isFirst = FALSE;
+      if (t->rawCode == '\\') needLexing = TRUE;
       unsigned i = 0;
       for (; i < t->length; ++i) {
           char c = t->pos[i];
@@ -161,6 +203,8 @@ Token *stringifySequence(ParserContext *ctx, Token *s) {
               putSymbol(&sb, '\\');
           } else if (c == '\\' && t->rawCode != '\\') {
               putSymbol(&sb, '\\');
+          } else if (c == '\n') {
+              needLexing = TRUE;
           }
           putSymbol(&sb, c);
       }
@@ -169,7 +213,40 @@ Token *stringifySequence(ParserContext *ctx, Token *s) {
   putSymbol(&sb, '"');
   putSymbol(&sb, '\0');
 
-  Token *r = tokenizeString(ctx, s, sb.ptr, sb.idx, FALSE);
+  Token *r = NULL;
+
+  if (needLexing) {
+      r = tokenizeString(ctx, s, sb.ptr, sb.idx, FALSE);
+      Token *tail = r;
+      while (tail->next->rawCode != END_OF_FILE) tail = tail->next;
+      tail->next = NULL;
+  } else {
+      size_t spellingLength = sb.idx - 1;
+      TokenText *text = (TokenText *)allocateString(ctx, sizeof(TokenText) + 2 * spellingLength);
+      char *value = (char *)(text + 1);
+      char *spelling = value + spellingLength;
+      unsigned i, j = 0;
+
+      memcpy(spelling, sb.ptr, spellingLength);
+      releaseHeap(sb.ptr);
+
+      for (i = 1; i < spellingLength - 1; ++i) {
+          if (spelling[i] == '\\') ++i;
+          value[j++] = spelling[i];
+      }
+      value[j] = '\0';
+
+      text->v = value;
+      text->l = j + 1;
+
+      r = allocToken(ctx);
+      r->code = r->rawCode = STRING_LITERAL;
+      r->pos = spelling;
+      r->length = spellingLength;
+      r->value.text = text;
+      r->expanded = macro;
+  }
+
   r->startOfLine = r->hasLeadingSpace = 0;
   r->macroStringitize = 1;
 
@@ -200,6 +277,21 @@ Token *concatTokens(ParserContext *ctx, Token *macro, Token *l, Token *r) {
   // find most right token of left sequence
   l = t;
 
+  Token *s = pasteIdentifier(ctx, l, r);
+
+  if (s) {
+      s->hasLeadingSpace = l->hasLeadingSpace;
+      s->startOfLine = l->startOfLine;
+      s->expanded = macro;
+      s->next = r->next;
+
+      if (pl) {
+          pl->next = s;
+      }
+
+      return s;
+  }
+
   bufferSize += l->length;
   bufferSize += r->length;
   bufferSize += 1;
@@ -215,7 +307,7 @@ Token *concatTokens(ParserContext *ctx, Token *macro, Token *l, Token *r) {
 
   assert(j == bufferSize);
 
-  Token *s = tokenizeString(ctx, macro, buffer, bufferSize, FALSE);
+  s = tokenizeString(ctx, macro, buffer, bufferSize, FALSE);
 
   s->hasLeadingSpace = l->hasLeadingSpace;
   s->startOfLine = l->startOfLine;
@@ -236,7 +328,7 @@ static MacroArg *findArgument(const Token *arg, MacroArg *args) {
   if (arg->rawCode != IDENTIFIER) return NULL;
 
   while (args) {
-    if (args->param && strcmp(args->param->name, arg->id) == 0) {
+    if (args->param && args->param->name == arg->id) {
         return args;
     }
     args = args->next;
@@ -258,7 +350,7 @@ static Token *constToken(ParserContext *ctx, int64_t v, Token *token) {
 static Token *evaluateDefinedOp(ParserContext *ctx, Token *token, Boolean relaxed, Token **next) {
   assert(token);
   assert(token->rawCode == IDENTIFIER);
-  assert(strcmp("defined", token->id) == 0);
+  assert(token->id == definedAtom);
 
   Token *n = token->next;
   if (n && n->rawCode == '(') {
@@ -298,8 +390,6 @@ static Token *evaluateDefinedOp(ParserContext *ctx, Token *token, Boolean relaxe
   return NULL;
 }
 
-static const char defaultVarargName[] = "__VA_ARGS__";
-
 Boolean cmpMacroses(MacroDefinition *old, MacroDefinition *new) {
   if (old->isFunctional != new->isFunctional) return TRUE;
   if (old->isVararg != new->isVararg) return TRUE;
@@ -310,7 +400,7 @@ Boolean cmpMacroses(MacroDefinition *old, MacroDefinition *new) {
       MacroParam *newP = new->params;
       while (oldP && newP) {
           if (oldP->isVararg != new->isVararg) return TRUE;
-          if (strcmp(oldP->name, newP->name)) return TRUE;
+          if (oldP->name != newP->name) return TRUE;
           oldP = oldP->next;
           newP = newP->next;
       }
@@ -467,10 +557,11 @@ static MacroDefinition __timestamt_macro = { "__TIMESTAMP__", NULL, NULL, &times
 
 
 static MacroDefinition *defineBuiltinMacro(ParserContext *ctx, const char *name, Token *t) {
-  MacroDefinition *def = allocateMacroDef(ctx, name, NULL, t, FALSE, FALSE);
+  const char *atom = internCString(name);
+  MacroDefinition *def = allocateMacroDef(ctx, atom, NULL, t, FALSE, FALSE);
   def->isEnabled = 1;
 
-  putToHashMap(ctx->macroMap, (intptr_t)name, (intptr_t)def);
+  putToHashMap(ctx->macroMap, (intptr_t)atom, (intptr_t)def);
 }
 
 static const char *dateString() {
@@ -537,10 +628,8 @@ static void defineCLIMacro(ParserContext *ctx, const char *s) {
 
   for (; s[idx]; ++idx) {
       if (s[idx] == '=') {
-          char *b = allocateString(ctx, idx);
           macroBody = &s[idx + 1];
-          strncpy(b, s, idx);
-          macroName = b;
+          macroName = internString(s, idx);
           break;
       }
   }
@@ -564,10 +653,12 @@ void initializeProprocessor(ParserContext *ctx) {
 
   counterState = 0;
 
-  putToHashMap(ctx->macroMap, (intptr_t)__file_macro.name, (intptr_t)&__file_macro);
-  putToHashMap(ctx->macroMap, (intptr_t)__line_macro.name, (intptr_t)&__line_macro);
-  putToHashMap(ctx->macroMap, (intptr_t)__counter_macro.name, (intptr_t)&__counter_macro);
-  putToHashMap(ctx->macroMap, (intptr_t)__timestamt_macro.name, (intptr_t)&__timestamt_macro);
+  initializeAtoms();
+
+  putToHashMap(ctx->macroMap, (intptr_t)internCString(__file_macro.name), (intptr_t)&__file_macro);
+  putToHashMap(ctx->macroMap, (intptr_t)internCString(__line_macro.name), (intptr_t)&__line_macro);
+  putToHashMap(ctx->macroMap, (intptr_t)internCString(__counter_macro.name), (intptr_t)&__counter_macro);
+  putToHashMap(ctx->macroMap, (intptr_t)internCString(__timestamt_macro.name), (intptr_t)&__timestamt_macro);
 
   Token dummy = { 0 };
 
@@ -629,6 +720,27 @@ static const char *getBaseFileName(ParserContext *ctx) {
   return lex->fileContext.locInfo->fileInfo.fileName;
 }
 
+// results of lookups through include path list, kept for the whole process
+static HashMap *includeSearchCache = NULL;  // include name atom -> path atom or notFoundPath
+static IncludePath *cachedSearchList = NULL;
+static const char notFoundPath[] = "";
+
+static const char *searchIncludePath(IncludePath *includePath, const char *includeName) {
+  static char pathBuffer[PATH_MAX] = { 0 };
+
+  while (includePath) {
+      int len = snprintf(pathBuffer, PATH_MAX, "%s/%s", includePath->path, includeName);
+      const char *path = internString(pathBuffer, len);
+      if (isSourceFileExist(path)) {
+          return path;
+      }
+
+      includePath = includePath->next;
+  }
+
+  return notFoundPath;
+}
+
 static const char *findIncludePath(ParserContext *ctx, const char *includeName, Boolean dquoted) {
   if (dquoted && includeName[0] != '/') {
     const char *baseFileName = getFileName(ctx);
@@ -638,32 +750,32 @@ static const char *findIncludePath(ParserContext *ctx, const char *includeName,
     char *path = heapAllocate(l);
     snprintf(path, l, "%s/%s", dir, includeName);
     free(copy);
-    if (access(path, F_OK) == 0) {
-        char *result = allocateString(ctx, l);
-        strncpy(result, path, l);
-        releaseHeap(path);
+    const char *result = internCString(path);
+    releaseHeap(path);
+    if (isSourceFileExist(result)) {
         return result;
     }
-    releaseHeap(path);
   }
 
-  if (includeName[0] == '/') return includeName;
+  if (includeName[0] == '/') return internCString(includeName);
 
   IncludePath *includePath = ctx->config->includePath;
-  static char pathBuffer[PATH_MAX] = { 0 };
 
-  while (includePath) {
-      int len = snprintf(pathBuffer, PATH_MAX, "%s/%s", includePath->path, includeName);
-      if (access(pathBuffer, F_OK) == 0) {
-          char *result = allocateString(ctx, len + 1);
-          strncpy(result, pathBuffer, len + 1);
-          return result;
-      }
+  if (includeSearchCache == NULL || cachedSearchList != includePath) {
+      if (includeSearchCache) releaseHashMap(includeSearchCache);
+      includeSearchCache = createHashMap(DEFAULT_MAP_CAPACITY, atomHashCode, atomCmp);
+      cachedSearchList = includePath;
+  }
 
-      includePath = includePath->next;
+  const char *nameAtom = internCString(includeName);
+  const char *result = (const char *)getFromHashMap(includeSearchCache, (intptr_t)nameAtom);
+
+  if (result == NULL) {
+      result = searchIncludePath(includePath, nameAtom);
+      putToHashMap(includeSearchCache, (intptr_t)nameAtom, (intptr_t)result);
   }
 
-  return NULL;
+  return result != notFoundPath ? result : NULL;
 }
 
 static void handleIncludeDirective(ParserContext *ctx, Token *d) {
@@ -675,7 +787,7 @@ static void handleIncludeDirective(ParserContext *ctx, Token *d) {
   Coordinates coords = { d, next };
 
   if (next->rawCode == STRING_LITERAL) {
-     fileName = next->value.text.v;
+     fileName = next->value.text->v;
      skipUntilEoL(ctx);
      dquoted = TRUE;
   } else if (next->rawCode == '<') {
@@ -730,6 +842,12 @@ static void handleIncludeDirective(ParserContext *ctx, Token *d) {
       return;
   }
 
+  const char *guardMacro = (const char *)getFromHashMap(ctx->includeGuardMap, (intptr_t)includePath);
+  if (guardMacro && findMacro(ctx, guardMacro)) {
+      // whole file is under '#ifndef guardMacro', no need to even read it
+      return;
+  }
+
   LexerState *newLex = loadFile(includePath, ctx->lexerState);
 
   if (newLex == NULL) {
@@ -746,7 +864,7 @@ static Boolean checkIsMacroParam(MacroParam *params, Token *t) {
    if (t->rawCode != IDENTIFIER) return FALSE;
 
    while (params) {
-       if (!strcmp(params->name, t->id)) {
+       if (params->name == t->id) {
            return TRUE;
        }
        params = params->next;
@@ -801,7 +919,7 @@ static MacroParam *parseMacroParam(ParserContext *ctx, Boolean *isVararg, Boolea
           }
       } else if (t->rawCode == ELLIPSIS) {
           *isVararg = TRUE;
-          MacroParam *p = parseVarargParam(ctx, defaultVarargName);
+          MacroParam *p = parseVarargParam(ctx, vaArgsAtom);
           if (!p) *hasError = TRUE;
           cur = cur->next = p;
           break;
@@ -909,7 +1027,7 @@ static void handleDefineDirective(ParserContext *ctx, Token *directive) {
       return;
   }
 
-  if (strcmp("defined", token->id) == 0) {
+  if (token->id == definedAtom) {
       reportDiagnostic(ctx, DIAG_PP_DEFINED_NOT_A_NAME, &coords);
       skipUntilEoL(ctx);
       return;
@@ -1005,45 +1123,37 @@ static void skipConditionalBlock(ParserContext *ctx) {
 
   int depth = 0;
 
-  Token *t = NULL;
   LexerState *lex = ctx->lexerState;
   assert(lex->state == LS_FILE);
 
   ctx->stateFlags.silentMode = 1;
 
-  for (;;) {
+  // only directive lines are tokenized, the rest is skipped by byte scanner
+  while (skipToDirectiveLine(ctx)) {
       unsigned pos = lex->fileContext.pos;
       unsigned vline = lex->fileContext.visibleLine;
       unsigned lineno = lex->fileContext.locInfo->fileInfo.lineno;
-      unsigned ls = lex->fileContext.atLineStart;
-
-      t = lexTokenNoSubstitute(ctx);
-
-      if (t->rawCode == END_OF_FILE) break;
-      if (t->rawCode == NEWLINE) continue;
-
-      if (t->startOfLine && t->rawCode == '#') {
-          Token *next = lexTokenNoSubstitute(ctx);
-          if (next->rawCode == IDENTIFIER) {
-              const char *id = next->id;
-              if (strcmp("if", id) == 0 || strcmp("ifdef", id) == 0 || strcmp("ifndef", id) == 0) {
-                  ++depth;
-              } else if (depth && strcmp("endif", id) == 0) {
-                  --depth;
-              } else if (depth == 0) {
-                  if (strcmp("elif", id) == 0 ||
-                      strcmp("else", id) == 0 ||
-                      strcmp("endif", id) == 0) {
-                      lex->fileContext.pos = pos;
-                      lex->fileContext.visibleLine = vline;
-                      lex->fileContext.locInfo->fileInfo.lineno = lineno;
-                      lex->fileContext.atLineStart = ls;
-                      goto done;
-                  }
+
+      Token *t = lexTokenNoSubstitute(ctx);
+      assert(t->rawCode == '#');
+
+      Token *next = lexTokenNoSubstitute(ctx);
+      if (next->rawCode == IDENTIFIER) {
+          const char *id = next->id;
+          if (id == ifAtom || id == ifdefAtom || id == ifndefAtom) {
+              ++depth;
+          } else if (depth && id == endifAtom) {
+              --depth;
+          } else if (depth == 0) {
+              if (id == elifAtom || id == elseAtom || id == endifAtom) {
+                  lex->fileContext.pos = pos;
+                  lex->fileContext.visibleLine = vline;
+                  lex->fileContext.locInfo->fileInfo.lineno = lineno;
+                  lex->fileContext.atLineStart = 1;
+                  goto done;
               }
           }
       }
-      skipUntilEoL(ctx);
   }
 
 
@@ -1058,7 +1168,7 @@ static Token *simplifyTokenSequence(ParserContext *ctx, Token *token) {
   Token head = { 0 };
   Token *cur = &head;
   while (token->rawCode != END_OF_FILE) {
-      if (token->rawCode == IDENTIFIER && strcmp("defined", token->id) == 0) {
+      if (token->rawCode == IDENTIFIER && token->id == definedAtom) {
           cur = cur->next = evaluateDefinedOp(ctx, token, FALSE, &token);
           continue;
       } else if (token->rawCode == IDENTIFIER) {
@@ -1073,14 +1183,190 @@ static Token *simplifyTokenSequence(ParserContext *ctx, Token *token) {
   return head.next;
 }
 
+// =========== Simple condition evaluator ===============================//
+
+/**
+ * Evaluates #if conditions made of signed integer constants, identifiers, 'defined' and
+ * the usual operators right on the token list. Anything else (unsigned or floating constants,
+ * division by zero, malformed input) is left to the full parser which also reports diagnostics.
+ */
+typedef struct _PPConditionEvaluator {
+  ParserContext *ctx;
+  Token *token;
+  Boolean failed;
+} PPConditionEvaluator;
+
+static sint64_const_t evalPPConditional(PPConditionEvaluator *e);
+
+static int ppBinaryPriority(int code) {
+  switch (code) {
+    case '*': case '/': case '%': return 10;
+    case '+': case '-': return 9;
+    case LEFT_OP: case RIGHT_OP: return 8;
+    case '<': case '>': case LE_OP: case GE_OP: return 7;
+    case EQ_OP: case NE_OP: return 6;
+    case '&': return 5;
+    case '^': return 4;
+    case '|': return 3;
+    case AND_OP: return 2;
+    case OR_OP: return 1;
+    default: return 0;
+  }
+}
+
+static sint64_const_t evalPPPrimary(PPConditionEvaluator *e) {
+  Token *t = e->token;
+  sint64_const_t v = 0;
+
+  switch (t->rawCode) {
+    case I_CONSTANT_RAW:
+      if (t->code != I_CONSTANT && t->code != L_CONSTANT) break;
+      e->token = t->next;
+      return (sint64_const_t)t->value.iv;
+    case IDENTIFIER:
+      if (t->id == definedAtom) {
+          Token *n = t->next;
+          Boolean isParened = n->rawCode == '(';
+          if (isParened) n = n->next;
+          if (n->rawCode != IDENTIFIER) break;
+          v = isMacro(e->ctx, n);
+          n = n->next;
+          if (isParened) {
+            if (n->rawCode != ')') break;
+            n = n->next;
+          }
+          e->token = n;
+          return v;
+      }
+      // Identifiers that are not macros, which are all considered to be the number zero.
+      e->token = t->next;
+      return 0;
+    case '(':
+      e->token = t->next;
+      v = evalPPConditional(e);
+      if (e->failed || e->token->rawCode != ')') break;
+      e->token = e->token->next;
+      return v;
+    case '+':
+    case '-':
+    case '~':
+    case '!':
+      e->token = t->next;
+      v = evalPPPrimary(e);
+      switch (t->rawCode) {
+        case '-': return (sint64_const_t)(0 - (int64_const_t)v);
+        case '~': return ~v;
+        case '!': return !v;
+        default: return v;
+      }
+    default:
+      break;
+  }
+
+  e->failed = TRUE;
+  return 0;
+}
+
+static sint64_const_t evalPPBinary(PPConditionEvaluator *e, int minPriority) {
+  sint64_const_t l = evalPPPrimary(e);
+
+  while (!e->failed) {
+      int code = e->token->rawCode;
+      int priority = ppBinaryPriority(code);
+      if (priority == 0 || priority < minPriority) return l;
+
+      e->token = e->token->next;
+      sint64_const_t r = evalPPBinary(e, priority + 1);
+      if (e->failed) break;
+
+      int64_const_t ul = (int64_const_t)l, ur = (int64_const_t)r;
+      switch (code) {
+        case '*': l = (sint64_const_t)(ul * ur); break;
+        case '/':
+        case '%':
+          if (r == 0) {
+              // leave division by zero diagnostic to the parser
+              e->failed = TRUE;
+          } else if (r == -1) {
+              l = code == '/' ? (sint64_const_t)(0 - ul) : 0;
+          } else {
+              l = code == '/' ? l / r : l % r;
+          }
+          break;
+        case '+': l = (sint64_const_t)(ul + ur); break;
+        case '-': l = (sint64_const_t)(ul - ur); break;
+        case LEFT_OP:
+        case RIGHT_OP:
+          if (r < 0 || r > 63) {
+              e->failed = TRUE;
+          } else {
+              l = code == LEFT_OP ? (sint64_const_t)(ul << r) : l >> r;
+          }
+          break;
+        case '<': l = l < r; break;
+        case '>': l = l > r; break;
+        case LE_OP: l = l <= r; break;
+        case GE_OP: l = l >= r; break;
+        case EQ_OP: l = l == r; break;
+        case NE_OP: l = l != r; break;
+        case '&': l = l & r; break;
+        case '^': l = l ^ r; break;
+        case '|': l = l | r; break;
+        case AND_OP: l = l && r; break;
+        case OR_OP: l = l || r; break;
+      }
+  }
+
+  return 0;
+}
+
+static sint64_const_t evalPPConditional(PPConditionEvaluator *e) {
+  sint64_const_t cond = evalPPBinary(e, 1);
+  if (e->failed || e->token->rawCode != '?') return cond;
+
+  e->token = e->token->next;
+  sint64_const_t ifTrue = evalPPConditional(e);
+  if (e->failed || e->token->rawCode != ':') {
+      e->failed = TRUE;
+      return 0;
+  }
+
+  e->token = e->token->next;
+  sint64_const_t ifFalse = evalPPConditional(e);
+
+  return cond ? ifTrue : ifFalse;
+}
+
+static Boolean evaluateSimpleCondition(ParserContext *ctx, Token *token, int *result) {
+  PPConditionEvaluator e = { ctx, token, FALSE };
+
+  sint64_const_t v = evalPPConditional(&e);
+  if (e.failed || e.token->rawCode != END_OF_FILE) return FALSE;
+
+  *result = v != 0;
+  return TRUE;
+}
+
+// =========== Simple condition evaluator ===============================//
+
 static int evaluateTokenSequence(ParserContext *ctx, Token *token, int *err) {
+  int cond = 0;
+  if (evaluateSimpleCondition(ctx, token, &cond)) {
+      return cond;
+  }
+
   token = simplifyTokenSequence(ctx, token);
 
   AstExpression *expr = parsePPExpression(ctx, token);
   AstConst *e = eval(ctx, expr);
 
   if (e) {
-      return e->i;
+      if (e->op == CK_FLOAT_CONST) {
+          // the controlling expression must be an integer one, the group is skipped
+          reportDiagnostic(ctx, DIAG_PP_FLOAT_IN_EXPRESSION, &expr->coordinates);
+          return 0;
+      }
+      return e->i != 0;
   }
 
   *err = 1;
@@ -1119,7 +1405,7 @@ static Token *fetchConditionExpression(ParserContext *ctx, Token *directive) {
 }
 
 static void handleIfDirective(ParserContext *ctx, Token *directive) {
-  assert(directive->rawCode == IDENTIFIER && strcmp("if", directive->id) == 0);
+  assert(directive->rawCode == IDENTIFIER && directive->id == ifAtom);
 
   LexerState *lex = ctx->lexerState;
   assert(lex->state == LS_FILE);
@@ -1145,7 +1431,7 @@ static void handleIfDirective(ParserContext *ctx, Token *directive) {
 }
 
 void handleElifDirective(ParserContext *ctx, Token *directive) {
-  assert(directive->rawCode == IDENTIFIER && strcmp("elif", directive->id) == 0);
+  assert(directive->rawCode == IDENTIFIER && directive->id == elifAtom);
 
   LexerState *lex = ctx->lexerState;
   assert(lex->state == LS_FILE);
@@ -1166,6 +1452,11 @@ void handleElifDirective(ParserContext *ctx, Token *directive) {
       return;
   }
 
+  if (frame == lex->fileContext.guardFrame) {
+      // '#ifndef X ... #else ... #endif' does not guard file
+      lex->fileContext.guardState = IGS_INVALID;
+  }
+
   if (frame->isTaking) {
       frame->isTaken = 1;
       frame->isTaking = 0;
@@ -1194,7 +1485,7 @@ void handleElifDirective(ParserContext *ctx, Token *directive) {
 }
 
 static void handleElseDirective(ParserContext *ctx, Token *directive) {
-  assert(directive->rawCode == IDENTIFIER && strcmp("else", directive->id) == 0);
+  assert(directive->rawCode == IDENTIFIER && directive->id == elseAtom);
 
   LexerState *lex = ctx->lexerState;
   assert(lex->state == LS_FILE);
@@ -1219,6 +1510,11 @@ static void handleElseDirective(ParserContext *ctx, Token *directive) {
       return;
   }
 
+  if (frame == lex->fileContext.guardFrame) {
+      // '#ifndef X ... #else ... #endif' does not guard file
+      lex->fileContext.guardState = IGS_INVALID;
+  }
+
   Token *nl = lexToken(ctx); // consume NEW_LINE
   if (nl->rawCode != NEWLINE && nl->rawCode != END_OF_FILE) {
       coords.left = coords.right = nl;
@@ -1243,7 +1539,7 @@ static void handleElseDirective(ParserContext *ctx, Token *directive) {
 }
 
 static void handleEndifDirective(ParserContext *ctx, Token *directive) {
-  assert(directive->rawCode == IDENTIFIER && strcmp("endif", directive->id) == 0);
+  assert(directive->rawCode == IDENTIFIER && directive->id == endifAtom);
 
   LexerState *lex = ctx->lexerState;
   assert(lex->state == LS_FILE);
@@ -1269,6 +1565,11 @@ static void handleEndifDirective(ParserContext *ctx, Token *directive) {
       skipUntilEoL(ctx);
   }
 
+  if (lex->fileContext.guardState == IGS_IN_GUARD && frame == lex->fileContext.guardFrame) {
+      lex->fileContext.guardState = IGS_AFTER_GUARD;
+      lex->fileContext.guardFrame = NULL;
+  }
+
   // pop off and release current if-endif block
   lex->fileContext.conditionStack = frame->prev;
   releaseHeap(frame);
@@ -1276,7 +1577,7 @@ static void handleEndifDirective(ParserContext *ctx, Token *directive) {
 
 void handleIfdefDirective(ParserContext *ctx, Token *directive, Boolean invert) {
 
-  assert(directive->rawCode == IDENTIFIER && strcmp(invert ? "ifndef" : "ifdef", directive->id) == 0);
+  assert(directive->rawCode == IDENTIFIER && directive->id == (invert ? ifndefAtom : ifdefAtom));
 
   LexerState *lex = ctx->lexerState;
   assert(lex->state == LS_FILE);
@@ -1315,17 +1616,23 @@ void handleIfdefDirective(ParserContext *ctx, Token *directive, Boolean invert)
 
   lex->fileContext.conditionStack = frame;
 
+  if (invert && lex->fileContext.guardState == IGS_START) {
+      lex->fileContext.guardState = IGS_IN_GUARD;
+      lex->fileContext.guardMacro = id->id;
+      lex->fileContext.guardFrame = frame;
+  }
+
   if (!cond) {
       skipConditionalBlock(ctx);
   }
 }
 
 static void handlePragmaDirective(ParserContext *ctx, Token *directive) {
-  assert(directive->rawCode == IDENTIFIER && strcmp("pragma", directive->id) == 0);
+  assert(directive->rawCode == IDENTIFIER && directive->id == pragmaAtom);
 
   Token *arg = lexNonExpand(ctx, FALSE);
 
-  if (arg->rawCode == IDENTIFIER && strcmp("once", arg->id) == 0) {
+  if (arg->rawCode == IDENTIFIER && arg->id == onceAtom) {
       const char *f = getFileName(ctx);
       putToHashMap(ctx->pragmaOnceMap, (intptr_t)f, (intptr_t)f);
   }
@@ -1344,16 +1651,6 @@ static LexerState *findFileLexer(ParserContext *ctx) {
   return NULL;
 }
 
-static LineChunk *newLineChunk(const char *file, unsigned newLineNumber, unsigned rawLine) {
-  LineChunk *newChunk = heapAllocate(sizeof(LineChunk));
-
-  newChunk->overrideFileName = file;
-  newChunk->overrideLineNumber = newLineNumber;
-  newChunk->posLineNumber = rawLine;
-
-  return newChunk;
-}
-
 #define TMP_SIZE 1024
 static void handleLineDirective(ParserContext *ctx, Token *directive) {
   Token *line = lexNonExpand(ctx, FALSE);
@@ -1377,7 +1674,7 @@ static void handleLineDirective(ParserContext *ctx, Token *directive) {
         return;
       }
   } else {
-      fileName = fileNameToken->value.text.v;
+      fileName = fileNameToken->value.text->v;
   }
 
   Token *el = lexNonExpand(ctx, FALSE); // consume \n
@@ -1393,9 +1690,7 @@ static void handleLineDirective(ParserContext *ctx, Token *directive) {
 
   assert(locInfo->kind == LIK_FILE);
 
-  LineChunk *chunk = newLineChunk(fileName, line->value.iv, locInfo->fileInfo.lineno - 1);
-  chunk->next = locInfo->fileInfo.chunks;
-  locInfo->fileInfo.chunks = chunk;
+  addLineChunk(locInfo, fileName, line->value.iv, locInfo->fileInfo.lineno - 1);
 }
 
 void handleDirective(ParserContext *ctx, Token *directive) {
@@ -1404,35 +1699,42 @@ void handleDirective(ParserContext *ctx, Token *directive) {
   Token tok = { 0 };
   tok.locInfo = locInfo;
 
+  if (lexState->fileContext.guardState != IGS_IN_GUARD) {
+      // only the opening '#ifndef' is allowed outside of include guard
+      Boolean mayOpenGuard = lexState->fileContext.guardState == IGS_START && directive->rawCode == IDENTIFIER && directive->id == ifndefAtom;
+      if (!mayOpenGuard) lexState->fileContext.guardState = IGS_INVALID;
+  }
+
   if (directive->rawCode == IDENTIFIER) {
-    if (!strcmp("include", directive->id)) {
+    const char *id = directive->id;
+    if (id == includeAtom) {
         return handleIncludeDirective(ctx, directive);
-    } else if (!strcmp("include_next", directive->id)) {
+    } else if (id == includeNextAtom) {
         Coordinates coords = { directive, directive };
         reportDiagnostic(ctx, DIAG_PP_UNSUPPORTED_DIRECTIVE, &coords, directive->id);
-    } else if (!strcmp("define", directive->id)) {
+    } else if (id == defineAtom) {
         return handleDefineDirective(ctx, directive);
-    } else if (!strcmp("undef", directive->id)) {
+    } else if (id == undefAtom) {
         return handleUndefDirective(ctx, directive);
-    } else if (!strcmp("if", directive->id)) {
+    } else if (id == ifAtom) {
         return handleIfDirective(ctx, directive);
-    } else if (!strcmp("elif", directive->id)) {
+    } else if (id == elifAtom) {
         return handleElifDirective(ctx, directive);
-    } else if (!strcmp("else", directive->id)) {
+    } else if (id == elseAtom) {
         return handleElseDirective(ctx, directive);
-    } else if (!strcmp("endif", directive->id)) {
+    } else if (id == endifAtom) {
         return handleEndifDirective(ctx, directive);
-    } else if (!strcmp("ifdef", directive->id)) {
+    } else if (id == ifdefAtom) {
         return handleIfdefDirective(ctx, directive, FALSE);
-    } else if (!strcmp("ifndef", directive->id)) {
+    } else if (id == ifndefAtom) {
         return handleIfdefDirective(ctx, directive, TRUE);
-    } else if (!strcmp("pragma", directive->id)) {
+    } else if (id == pragmaAtom) {
         return handlePragmaDirective(ctx, directive);
-    } else if (!strcmp("line", directive->id)) {
+    } else if (id == lineAtom) {
         return handleLineDirective(ctx, directive);
-    } else if (!strcmp("error", directive->id)) {
+    } else if (id == errorAtom) {
         return handleDiagnosticDirective(ctx, directive, DIAG_PP_ERROR);
-    } else if (!strcmp("warning", directive->id)) {
+    } else if (id == warningAtom) {
         return handleDiagnosticDirective(ctx, directive, DIAG_PP_WARNING);
     } else {
         Coordinates coords = { directive, directive };
@@ -1548,19 +1850,20 @@ static Boolean needExpansion(ParserContext *ctx, Token *arg) {
   return FALSE;
 }
 
-static Token *expandArgument(ParserContext *ctx, MacroDefinition *def, MacroArg *arg, Token *macro) {
+static Token *expandArgument(ParserContext *ctx, MacroState *macroState, MacroArg *arg) {
 
   Token *evaluated = arg->evaluated;
 
   if (!evaluated) {
-    LexerState *state = allocateMacroLexerState(NULL, macro);
-    Token *bodyCopy = arg->value;
-    state->macroContext.bodyStart = state->macroContext.bodyPtr = bodyCopy;
+    MacroDefinition *def = macroState->definition;
+    LexerState *state = allocateMacroLexerState(NULL, macroState->trigger);
+    state->macroContext.bodyPtr = arg->value;
 
     LexerState *old = state->virtPrev = ctx->lexerState;
     ctx->lexerState = state;
 
-    MacroState *ms = &state->macroContext;
+    // argument is expanded as if the macro is not entered yet
+    def->isEnabled = 1;
 
     Token head = { 0 };
     Token *cur = &head;
@@ -1570,6 +1873,7 @@ static Token *expandArgument(ParserContext *ctx, MacroDefinition *def, MacroArg
         cur = cur->next = t;
     }
 
+    def->isEnabled = 0;
     ctx->lexerState = old;
 
     evaluated = arg->evaluated = head.next;
@@ -1578,200 +1882,214 @@ static Token *expandArgument(ParserContext *ctx, MacroDefinition *def, MacroArg
   return evaluated;
 }
 
-static Token* expandArguments(ParserContext *ctx, MacroDefinition *def, MacroArg *args, Token *macro) {
+// operand of '#' and '##' is taken as is, without expansion
+static Token *operandSequence(ParserContext *ctx, Token *body, MacroArg *args) {
+  MacroArg *arg = findArgument(body, args);
+
+  if (arg == NULL) return copyToken(ctx, body);
+
+  return arg->value ? copySequence(ctx, arg->value) : NULL;
+}
+
+static Boolean isOperatorAt(Token *body, MacroArg *args) {
+  Token *next = body->next;
+
+  if (body->rawCode == DSHARP) return TRUE;
+  if (next == NULL) return FALSE;
+
+  return next->rawCode == DSHARP || body->rawCode == '#' && findArgument(next, args) != NULL;
+}
+
+// builds tokens of '#' and '##' starting at cursor and moves it past them
+static Token *expandOperators(ParserContext *ctx, MacroState *state) {
 
-  Token *body = def->body;
+  MacroArg *args = state->args;
+  Token *macro = state->trigger;
+  Token *body = state->bodyPtr;
 
   Token head = { 0 };
   Token *cur = &head;
 
   Coordinates coords = { macro, macro };
 
-  while (body) {
-      if (body->rawCode == '#') {
-          // stringify
-          Token *next = body->next;
-          if (next) {
-              MacroArg *arg = findArgument(next, args);
-              if (arg) {
-                  Token *argValue = arg->value;
-                  Token *evaluated = argValue ? stringifySequence(ctx, argValue) : stringToken(ctx, next, "");
+  if (body->rawCode == '#' && body->next && findArgument(body->next, args)) {
+      // stringify
+      Token *evaluated = stringifySequence(ctx, findArgument(body->next, args)->value, macro);
+      evaluated->hasLeadingSpace = body->hasLeadingSpace;
+      cur->next = evaluated;
+      body = body->next->next;
+  } else if (body->rawCode != DSHARP) {
+      cur->next = operandSequence(ctx, body, args);
+      body = body->next;
+  } else if (body == state->definition->body) {
+      reportDiagnostic(ctx, DIAG_PP_WRONG_CONCAT_OP_PLACE, &coords);
+      body = NULL;
+  }
+
+  for (; cur->next; cur = cur->next)
+    ;
 
-                  cur = cur->next = evaluated;
+  while (body && body->rawCode == DSHARP) {
+      // a##b##c
+      Token *next = body->next;
 
-                  evaluated->hasLeadingSpace = body->hasLeadingSpace;
+      if (next == NULL) {
+        reportDiagnostic(ctx, DIAG_PP_WRONG_CONCAT_OP_PLACE, &coords);
+        body = NULL;
+        break;
+      }
 
-                  for (; evaluated->rawCode != END_OF_FILE; evaluated = evaluated->next) {
-                      cur = evaluated;
-                  }
+      Token *rhs = operandSequence(ctx, next, args);
 
-                  cur->next = NULL;
+      if (rhs != NULL) {
+          if (cur == &head) {
+              cur->next = rhs;
+          } else {
+              Token *i = &head;
 
-                  body = next->next;
-                  continue;
-              }
-          }
-      }
+              while (i->next != cur) i = i->next;
 
-      if (body->rawCode == ',' && body->next && body->next->rawCode == DSHARP) {
-          // GNU COMMA ,##__VA_ARGS__
-          Token *comma = body;
-          Token *dsh = comma->next;
-          Token *next = dsh->next;
-
-          if (next && next->isMacroParam) {
-              MacroArg *arg = findArgument(next, args);
-              if (arg && arg->param->isVararg) {
-                  if (arg->value == NULL) {
-                      // expand to empty list
-                      body = next->next;
-                  } else {
-                      // TODO: check this
-                      Token *evaluated = copyToken(ctx, body);
-                      cur = cur->next = evaluated;
-                      body = next;
-                  }
-                  continue;
-              }
+              cur = i->next = concatTokens(ctx, macro, cur, rhs);
           }
 
+          for (; cur->next; cur = cur->next)
+            ;
       }
 
-      if (body->next && body->next->rawCode == DSHARP) {
-          MacroArg *lhsA = findArgument(body, args);
-          Token *lhs = NULL;
-
-          if (lhsA == NULL) {
-              lhs = copyToken(ctx, body);
-          } else {
-              lhs = lhsA->value ? copySequence(ctx, lhsA->value) : NULL;
-          }
+      body = next->next;
+  }
 
-          Token *sharpsharp = body->next;
-          Token *origRhs = sharpsharp->next;
-
-          if (origRhs) {
-            MacroArg *rhsA = findArgument(origRhs, args);
-            Token *rhs = NULL;
-            if (rhsA == NULL) {
-                rhs = copyToken(ctx, origRhs);
-            } else {
-                rhs = rhsA->value ? copySequence(ctx, rhsA->value) : NULL;
-            }
-
-            Token *evaluated = NULL;
-            if (rhs == NULL && lhs == NULL) {
-                body = origRhs->next;
-                continue;
-            } else if (rhs == NULL) {
-                evaluated = lhs;
-            } else if (lhs == NULL) {
-                evaluated = rhs;
-            } else {
-                evaluated = concatTokens(ctx, macro, lhs, rhs);
-            }
-
-            cur->next = evaluated;
-            for (cur = evaluated; evaluated; evaluated = evaluated->next) {
-                evaluated->expanded = macro;
-                cur = evaluated;
-            }
-
-            body = origRhs->next;
-            continue;
-          } else {
-              reportDiagnostic(ctx, DIAG_PP_WRONG_CONCAT_OP_PLACE, &coords);
-              break;
-          }
+  state->bodyPtr = body;
 
+  for (cur = head.next; cur; cur = cur->next) {
+      cur->expanded = macro;
+      if (cur->rawCode == DSHARP) {
+          // #define x # ## #
+          // neither pasted '##' nor one from argument is an operator
+          cur->rawCode = cur->code = BAD_CHARACTER;
       }
+  }
 
-      if (body->rawCode == DSHARP) { // pasting
-          // a##b##c
-          Token *next = body->next;
+  return head.next;
+}
 
-          if (next == NULL) {
-            reportDiagnostic(ctx, DIAG_PP_WRONG_CONCAT_OP_PLACE, &coords);
-            break;
-          }
+// arguments are not handed out as is, so their tokens are reused once expansion is over
+static void releaseArguments(ParserContext *ctx, MacroState *state) {
+  MacroArg *arg;
 
-          if (body == def->body) {
-            reportDiagnostic(ctx, DIAG_PP_WRONG_CONCAT_OP_PLACE, &coords);
-            break;
-          }
+  for (arg = state->args; arg; arg = arg->next) {
+      // pre-expansion links argument tokens into evaluated list
+      Token *t = arg->evaluated ? arg->evaluated : arg->value;
+      while (t) {
+          Token *next = t->next;
+          t->next = ctx->tokenWindow.freeList;
+          ctx->tokenWindow.freeList = t;
+          t = next;
+      }
+  }
 
-          Token *lhs = cur;
-          MacroArg *rhsA = findArgument(next, args);
-          Token *rhs = NULL;
+  state->args = NULL;
+}
 
-          if (rhsA == NULL) {
-              rhs = copyToken(ctx, next);
-          } else {
-              rhs = copySequence(ctx, rhsA->value);
-          }
+Token *peekMacroToken(ParserContext *ctx, MacroState *state) {
 
-          Token *evaluated = NULL;
-          if (rhs == NULL && lhs == &head) {
-              body = next->next;
-              continue;
-          } else if (lhs == &head) {
-              evaluated = rhs;
-          } else  if (rhs == NULL) {
-              evaluated = lhs;
-          } else {
-              evaluated = concatTokens(ctx, macro, lhs, rhs);
-          }
+  if (state->definition == NULL) {
+      // expansion of argument walks argument itself
+      return state->bodyPtr;
+  }
 
-          Token *i = &head;
+  for (;;) {
+      if (state->pending) return state->pending;
+      if (state->argPtr) return state->argPtr;
 
-          while (i->next) {
-              if (i->next == cur) break;
-              i = i->next;
-          }
+      Token *body = state->bodyPtr;
 
-          i->next = evaluated;
-          for (cur = evaluated; evaluated; evaluated = evaluated->next) {
-              evaluated->expanded = macro;
-              cur = evaluated;
-          }
+      if (body == NULL) {
+          releaseArguments(ctx, state);
+          return NULL;
+      }
 
-          body = next->next;
+      Token *next = body->next;
 
+      if (body->rawCode == ',' && next && next->rawCode == DSHARP && next->next && next->next->isMacroParam) {
+          // GNU COMMA ,##__VA_ARGS__
+          Token *param = next->next;
+          MacroArg *arg = findArgument(param, state->args);
+          if (arg && arg->param->isVararg) {
+              if (arg->value) {
+                  state->pending = copyToken(ctx, body);
+                  state->bodyPtr = param;
+              } else {
+                  // expand to empty list
+                  state->bodyPtr = param->next;
+              }
+              continue;
+          }
+      }
+
+      if (isOperatorAt(body, state->args)) {
+          state->pending = expandOperators(ctx, state);
           continue;
       }
 
       if (body->isMacroParam) {
-          MacroArg *arg = findArgument(body, args);
-          if (arg->value) {
-            if (needExpansion(ctx, arg->value)) {
-              Token *expanded = expandArgument(ctx, def, arg, macro);
-              cur = cur->next = copySequence(ctx, expanded);
-            } else {
-              cur = cur->next = copySequence(ctx, arg->value);
-            }
-
-            cur->hasLeadingSpace = body->hasLeadingSpace;
-            cur->startOfLine = body->startOfLine;
-
-            for (; cur->next; cur = cur->next) {
-                if (cur->rawCode == DSHARP) {
-                    // #define x(y) y
-                    // x(a##b) expands into 'a##b', not 'ab'
-                    cur->rawCode = cur->code = BAD_CHARACTER;
-                }
-            }
+          MacroArg *arg = findArgument(body, state->args);
+          if (arg && arg->value) {
+              state->argPtr = needExpansion(ctx, arg->value) ? expandArgument(ctx, state, arg) : arg->value;
+              state->argSite = body;
           }
-
-          body = body->next;
+          state->bodyPtr = next;
           continue;
       }
 
-      cur = cur->next = copyToken(ctx, body);
-      body = body->next;
+      return body;
   }
+}
 
-  return head.next;
+Token *nextMacroToken(ParserContext *ctx, MacroState *state) {
 
+  Token *t = peekMacroToken(ctx, state);
+
+  if (t == NULL) return eofToken(ctx);
+
+  if (state->definition == NULL) {
+      state->bodyPtr = t->next;
+      return t;
+  }
+
+  if (t == state->pending) {
+      // built for this expansion, hand it out as is
+      state->pending = t->next;
+  } else if (t == state->argPtr) {
+      state->argPtr = t->next;
+      t = copyToken(ctx, t);
+
+      if (t->rawCode == DSHARP) {
+          // #define x(y) y
+          // x(a##b) expands into 'a##b', not 'ab'
+          t->rawCode = t->code = BAD_CHARACTER;
+      }
+
+      if (state->argSite) {
+          t->hasLeadingSpace = state->argSite->hasLeadingSpace;
+          t->startOfLine = state->argSite->startOfLine;
+          state->argSite = NULL;
+      }
+  } else {
+      state->bodyPtr = t->next;
+      t = copyToken(ctx, t);
+  }
+
+  t->next = NULL;
+  t->expanded = state->trigger;
+
+  if (!state->isStarted) {
+      t->hasLeadingSpace = state->trigger->hasLeadingSpace;
+      t->startOfLine = state->trigger->startOfLine;
+      state->isStarted = 1;
+  }
+
+  return t;
 }
 
 void skipMacroArgs(ParserContext *ctx) {
@@ -1789,40 +2107,29 @@ void skipMacroArgs(ParserContext *ctx) {
 
 static void expandMacro(ParserContext *ctx, Token *t, MacroDefinition *def) {
 
-  Token *body = NULL;
+  MacroArg *args = NULL;
 
   if (def->isFunctional) {
-      MacroArg *args = parseMacroArgs(ctx, t, def);
-      if (def->isParamsUsed) {
-          body = expandArguments(ctx, def, args, t);
-      } else {
-          body = copySequence(ctx, def->body);
-      }
-  } else {
-      body = copySequence(ctx, def->body);
+      args = parseMacroArgs(ctx, t, def);
   }
 
-  if (!body) return;
-
-  body->hasLeadingSpace = t->hasLeadingSpace;
-  body->startOfLine = t->startOfLine;
+  if (!def->body) return;
 
+  // tokens are copied out of definition body one by one as they are lexed
   LexerState *lex = allocateMacroLexerState(def, t);
-  lex->macroContext.bodyStart = lex->macroContext.bodyPtr = body;
+  lex->macroContext.args = args;
+  lex->macroContext.bodyPtr = def->body;
 
   def->isEnabled = 0;
   lex->prev = lex->virtPrev = ctx->lexerState;
   ctx->lexerState = lex;
-
-  for (; body; body = body->next)
-    body->expanded = t;
 }
 
 // returns NULL if macro enqueued into expansion stack
 Token *handleIdentifier(ParserContext *ctx, Token *token) {
 
   if (ctx->stateFlags.inPPExpression) {
-      if (token->rawCode == IDENTIFIER && strcmp("defined", token->id) == 0) {
+      if (token->rawCode == IDENTIFIER && token->id == definedAtom) {
           ctx->stateFlags.afterPPDefined = 1;
           return token;
       }
@@ -553,7 +553,7 @@ static Boolean generateBlock(GeneratedFunction *f, AstBlock *block) {
 }
 
 static GeneratedFunction *generateFunction_riscv64(GenerationContext *ctx, AstFunctionDefinition *f) {
-  HashMap *labelMap = createHashMap(DEFAULT_MAP_CAPACITY, &stringHashCode, &stringCmp);
+  HashMap *labelMap = createHashMap(DEFAULT_MAP_CAPACITY, &atomHashCode, &atomCmp);
   ctx->labelMap = labelMap;
 
   assert(f->body->statementKind == SK_BLOCK);
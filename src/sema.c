@@ -91,6 +91,9 @@ static TypeEqualityKind valueTypeEquality(TypeRef *t1, TypeRef *t2) {
 }
 
 TypeEqualityKind typeEquality(TypeRef *t1, TypeRef *t2) {
+  // canonical types are constructed once so the same object is the common case
+  if (t1 == t2 && !isErrorType(t1)) return TEK_EQUAL;
+
   TypeEqualityKind equality = valueTypeEquality(t1, t2);
 
   if (equality != TEK_UNKNOWN) return equality;
@@ -484,7 +487,55 @@ int32_t effectiveMemberOffset(StructualMember *member) {
   return result;
 }
 
+#define MEMBER_INDEX_THRESHOLD 8
+
+static unsigned countStructualMembers(TypeDefiniton *definition) {
+  StructualMember *member = definition->members;
+  unsigned count = 0;
+
+  for (; member; member = member->next) {
+      if (member->name && member->name[0] == '$') {
+          count += countStructualMembers(member->type->descriptorDesc->typeDefinition);
+      }
+      ++count;
+  }
+
+  return count;
+}
+
+// first member with a name wins so the index agrees with linear lookup order
+static void addMembersToIndex(HashMap *index, TypeDefiniton *definition) {
+  StructualMember *member = definition->members;
+
+  for (; member; member = member->next) {
+      if (member->name == NULL) continue;
+      if (!getFromHashMap(index, (intptr_t)member->name)) {
+          putToHashMap(index, (intptr_t)member->name, (intptr_t)member);
+      }
+      if (member->name[0] == '$') {
+          addMembersToIndex(index, member->type->descriptorDesc->typeDefinition);
+      }
+  }
+}
+
+/**
+ * Builds name index for complete struct or union definition, members of anonymous members are flattened into
+ * it. Small definitions are cheaper to scan than to hash so they are left without index.
+ */
+void indexStructualMembers(ParserContext *ctx, TypeDefiniton *definition) {
+  unsigned count = countStructualMembers(definition);
+
+  if (count < MEMBER_INDEX_THRESHOLD) return;
+
+  definition->memberIndex = createArenaHashMap(ctx->memory.typeArena, count * 2, stringHashCode, stringCmp);
+  addMembersToIndex(definition->memberIndex, definition);
+}
+
 StructualMember *findStructualMember(TypeDefiniton *definition, const char *name) {
+  if (definition->memberIndex) {
+      return (StructualMember *)getFromHashMap(definition->memberIndex, (intptr_t)name);
+  }
+
   StructualMember *member = definition->members;
 
   while (member) {
@@ -1313,6 +1364,7 @@ static AstExpression *parenIfNeeded(ParserContext *ctx, AstExpression *expr) {
 
 static AstInitializer *typeInitializer(ParserContext *ctx, TypeRef *valueType, int32_t offset, unsigned flexible);
 static ParsedInitializer *finalizeInitializerInternal(ParserContext *ctx, ParsedInitializer *initializer, AstInitializer *semaInit, Boolean isTopLevel);
+static TypeRef *makeQualifiedArrayType(ParserContext *ctx, int size, TypeRef *elementType, unsigned flags, Boolean isStatic);
 
 static void fillInitializer(ParserContext *ctx, AstInitializer *semaInit) {
 
@@ -1529,6 +1581,11 @@ static AstInitializer *createSymbolInitNode(ParserContext *ctx, Coordinates *_co
    return init;
 }
 
+// incomplete array type may come from a typedef shared by several declarations, so it is never completed in place
+static TypeRef *completeArrayType(ParserContext *ctx, TypeRef *arrayType, int32_t size) {
+  return makeQualifiedArrayType(ctx, size, arrayType->arrayTypeDesc.elementType, arrayType->flags.storage, arrayType->arrayTypeDesc.isStatic);
+}
+
 static void stringLiteralToInitializer(ParserContext *ctx, AstInitializer *semaInit, Coordinates *coords, const char *s, size_t length) {
 
   TypeRef *charType = makePrimitiveType(ctx, T_S1, 0);
@@ -1549,7 +1606,7 @@ static void stringLiteralToInitializer(ParserContext *ctx, AstInitializer *semaI
       current->initializer = createSymbolInitNode(ctx, coords, charType, s[i], offset + i);
     }
 
-    arrayType->arrayTypeDesc.size = length;
+    semaInit->slotType = completeArrayType(ctx, arrayType, length);
     semaInit->initializerList = head.next;
   } else {
     AstInitializerList *current = semaInit->initializerList;
@@ -1585,11 +1642,8 @@ static AstInitializerList *findIncompleteArrayDesignatorWithFilling(ParserContex
   }
 
   TypeRef *arrayType = semaInit->slotType;
-  int32_t arraySize = arrayType->arrayTypeDesc.size;
 
 //  int a[] = { [1] = 10, [2] = 20, [1] = 30 };
-  int32_t newArraySize = max(arraySize, index + 1);
-  arrayType->arrayTypeDesc.size = newArraySize;
   TypeRef *elementType = arrayType->arrayTypeDesc.elementType;
 
   int32_t align = typeAlignment(elementType);
@@ -1673,7 +1727,7 @@ static ParsedInitializer *initializeIncompleteArray(ParserContext *ctx, ParsedIn
       AstInitializer *init = NULL;
       if (initializer->loc == PL_DESIGNATOR) {
           if (embraced) {
-              AstInitializerList *designated = findIncompleteArrayDesignatorWithFilling(ctx, semaInit, semaInit->initializerList, initializer, offset);
+              AstInitializerList *designated = findIncompleteArrayDesignatorWithFilling(ctx, semaInit, semaInit->initializerList, initializer, semaInit->offset);
               if (designated) {
                   current = designated;
                   init = designated->initializer;
@@ -1709,7 +1763,7 @@ static ParsedInitializer *initializeIncompleteArray(ParserContext *ctx, ParsedIn
   }
 
   semaInit->state = IS_INIT;
-  arrayType->arrayTypeDesc.size = arraySize;
+  semaInit->slotType = completeArrayType(ctx, arrayType, arraySize);
 
   return initializer;
 }
@@ -2490,7 +2544,7 @@ void verifyAndTransformCallAruments(ParserContext *ctx, Coordinates *coords, Typ
   }
 }
 
-static Boolean checkInSet(int v, unsigned caseLimit, int *caseSet) {
+static Boolean checkInSet(int64_t v, unsigned caseLimit, int64_t *caseSet) {
   unsigned i;
   for (i = 0; i < caseLimit; ++i) {
       if (caseSet[i] == v) return TRUE;
@@ -2499,7 +2553,7 @@ static Boolean checkInSet(int v, unsigned caseLimit, int *caseSet) {
   return FALSE;
 }
 
-static void verifySwtichCasesRec(ParserContext *ctx, AstStatement *stmt, unsigned caseCount, unsigned *caseIndex, int *caseSet, Boolean *hasDefault) {
+static void verifySwtichCasesRec(ParserContext *ctx, AstStatement *stmt, unsigned caseCount, unsigned *caseIndex, int64_t *caseSet, Boolean *hasDefault) {
   switch (stmt->statementKind) {
     case SK_BLOCK: {
         AstStatementList *node = stmt->block.stmts;
@@ -2580,7 +2634,7 @@ void verifyGotoExpression(ParserContext *ctx, AstExpression *expr) {
 }
 
 void verifySwitchCases(ParserContext *ctx, AstStatement *switchBody, unsigned caseCount) {
-  int *caseSet = heapAllocate(sizeof (int) * caseCount);
+  int64_t *caseSet = heapAllocate(sizeof (int64_t) * caseCount);
   unsigned caseIndex = 0;
   Boolean hasDefault = FALSE;
 
@@ -2612,11 +2666,13 @@ int stringCmp(intptr_t v1, intptr_t v2) {
 }
 
 Scope *newScope(ParserContext *ctx, Scope *parent) {
-  Scope *result = (Scope *)areanAllocate(ctx->memory.typeArena, sizeof (Scope));
+  // block scopes of a pipelined function body go away with it, symbols are kept since relocations refer to them
+  Arena *arena = ctx->memory.bodyArena ? ctx->memory.bodyArena : ctx->memory.typeArena;
+  Scope *result = (Scope *)areanAllocate(arena, sizeof (Scope));
   result->parent = parent;
-  result->symbols = createHashMap(DEFAULT_MAP_CAPACITY, stringHashCode, stringCmp);
-  result->next = ctx->scopeList;
-  ctx->scopeList = result;
+  // most of block scopes declare just a few symbols so start small and let the map grow if needed
+  int capacity = parent ? SCOPE_INITIAL_CAPACITY : DEFAULT_MAP_CAPACITY;
+  result->symbols = createArenaHashMap(arena, capacity, atomHashCode, atomCmp);
   return result;
 }
 
@@ -2957,30 +3013,136 @@ TypeRef *makePrimitiveType(ParserContext *ctx, TypeId id, unsigned flags) {
   return makeBasicType(ctx, desc, flags);
 }
 
-TypeRef *makeBasicType(ParserContext *ctx, TypeDesc *descriptor, unsigned flags) {
+// =========== Type uniquing ===============================//
+
+/**
+ * Value, pointer, complete array and function types are hash-consed, every distinct qualified type is
+ * allocated only once per context and equal types are the same object. Components are compared by identity
+ * so a type is canonical as long as its components are. Incomplete arrays are completed by initializer with
+ * a new type and VLA and bit-field types carry per-declaration state, they are always allocated fresh.
+ */
+
+int typeRefHashCode(intptr_t v) {
+  const TypeRef *t = (const TypeRef *)v;
+  unsigned h = mixHash(t->kind * 31 + t->flags.storage);
+
+  switch (t->kind) {
+    case TR_VALUE: return mixHash(h * 31 + (unsigned)(intptr_t)t->descriptorDesc);
+    case TR_POINTED: return mixHash(h * 31 + (unsigned)(intptr_t)t->pointed);
+    case TR_ARRAY:
+      h = mixHash(h * 31 + t->arrayTypeDesc.size * 2 + t->arrayTypeDesc.isStatic);
+      return mixHash(h * 31 + (unsigned)(intptr_t)t->arrayTypeDesc.elementType);
+    case TR_FUNCTION: {
+      const TypeList *param = t->functionTypeDesc.parameters;
+      h = mixHash(h * 31 + (unsigned)(intptr_t)t->functionTypeDesc.returnType) * 2 + t->functionTypeDesc.isVariadic;
+      for (; param; param = param->next) {
+          h = mixHash(h * 31 + (unsigned)(intptr_t)param->type);
+      }
+      return h;
+    }
+    default:
+      unreachable("type is not uniqued");
+      return h;
+  }
+}
+
+int typeRefCmp(intptr_t v1, intptr_t v2) {
+  const TypeRef *t1 = (const TypeRef *)v1;
+  const TypeRef *t2 = (const TypeRef *)v2;
+
+  if (t1->kind != t2->kind || t1->flags.storage != t2->flags.storage) return 1;
+
+  switch (t1->kind) {
+    case TR_VALUE: return t1->descriptorDesc != t2->descriptorDesc;
+    case TR_POINTED: return t1->pointed != t2->pointed;
+    case TR_ARRAY:
+      return t1->arrayTypeDesc.size != t2->arrayTypeDesc.size
+          || t1->arrayTypeDesc.isStatic != t2->arrayTypeDesc.isStatic
+          || t1->arrayTypeDesc.elementType != t2->arrayTypeDesc.elementType;
+    case TR_FUNCTION: {
+      const TypeList *p1 = t1->functionTypeDesc.parameters;
+      const TypeList *p2 = t2->functionTypeDesc.parameters;
+
+      if (t1->functionTypeDesc.isVariadic != t2->functionTypeDesc.isVariadic) return 1;
+      if (t1->functionTypeDesc.returnType != t2->functionTypeDesc.returnType) return 1;
+
+      for (; p1 && p2; p1 = p1->next, p2 = p2->next) {
+          if (p1->type != p2->type) return 1;
+      }
+
+      return p1 != p2;
+    }
+    default:
+      unreachable("type is not uniqued");
+      return 1;
+  }
+}
+
+// returns canonical type equal to probe, probe itself could live on stack
+static TypeRef *uniqueTypeRef(ParserContext *ctx, const TypeRef *probe) {
+  TypeRef *existed = (TypeRef *)getFromHashMap(ctx->typeTable, (intptr_t)probe);
+
+  if (existed) return existed;
+
   TypeRef *ref = (TypeRef *)areanAllocate(ctx->memory.typeArena, sizeof(TypeRef));
+  memcpy(ref, probe, sizeof(TypeRef));
+
+  if (ref->kind == TR_FUNCTION) {
+      const TypeList *param = probe->functionTypeDesc.parameters;
+      TypeList head = { 0 }, *cur = &head;
 
-  ref->kind = TR_VALUE;
-  ref->flags.storage = flags;
-  ref->descriptorDesc = descriptor;
+      for (; param; param = param->next) {
+          cur = cur->next = (TypeList*)areanAllocate(ctx->memory.typeArena, sizeof (TypeList));
+          cur->type = param->type;
+          cur->next = NULL;
+      }
+
+      ref->functionTypeDesc.parameters = head.next;
+  }
+
+  putToHashMap(ctx->typeTable, (intptr_t)ref, (intptr_t)ref);
 
   return ref;
 }
 
+TypeRef *makeBasicType(ParserContext *ctx, TypeDesc *descriptor, unsigned flags) {
+  TypeRef probe = { 0 };
+
+  probe.kind = TR_VALUE;
+  probe.flags.storage = flags;
+  probe.descriptorDesc = descriptor;
+
+  return uniqueTypeRef(ctx, &probe);
+}
+
 TypeRef* makePointedType(ParserContext *ctx, unsigned flags, const TypeRef *pointedTo) {
-    TypeRef *result = (TypeRef *)areanAllocate(ctx->memory.typeArena, sizeof(TypeRef));
-    result->kind = TR_POINTED;
-    result->flags.storage = flags;
-    result->pointed = (TypeRef *)pointedTo;
-    return result;
+    TypeRef probe = { 0 };
+    probe.kind = TR_POINTED;
+    probe.flags.storage = flags;
+    probe.pointed = (TypeRef *)pointedTo;
+    return uniqueTypeRef(ctx, &probe);
+}
+
+static TypeRef *makeQualifiedArrayType(ParserContext *ctx, int size, TypeRef *elementType, unsigned flags, Boolean isStatic) {
+    TypeRef probe = { 0 };
+    probe.kind = TR_ARRAY;
+    probe.flags.storage = flags;
+    probe.arrayTypeDesc.size = size;
+    probe.arrayTypeDesc.elementType = elementType;
+    probe.arrayTypeDesc.isStatic = isStatic;
+
+    if (size < 0) {
+        // incomplete arrays are not uniqued, initializer gives the declaration a new complete type
+        TypeRef *result = (TypeRef *)areanAllocate(ctx->memory.typeArena, sizeof(TypeRef));
+        memcpy(result, &probe, sizeof(TypeRef));
+        return result;
+    }
+
+    return uniqueTypeRef(ctx, &probe);
 }
 
 TypeRef *makeArrayType(ParserContext *ctx, int size, TypeRef *elementType) {
-    TypeRef *result = (TypeRef *)areanAllocate(ctx->memory.typeArena, sizeof(TypeRef));
-    result->kind = TR_ARRAY;
-    result->arrayTypeDesc.size = size;
-    result->arrayTypeDesc.elementType = elementType;
-    return result;
+    return makeQualifiedArrayType(ctx, size, elementType, 0, FALSE);
 }
 
 TypeRef *makeVLAType(ParserContext *ctx, AstExpression *sizeExpression, TypeRef *elementType) {
@@ -2991,28 +3153,36 @@ TypeRef *makeVLAType(ParserContext *ctx, AstExpression *sizeExpression, TypeRef
   return result;
 }
 
+#define FUNCTION_PROBE_PARAMS 16
+
 TypeRef *makeFunctionType(ParserContext *ctx, TypeRef *returnType, FunctionParams *params) {
-    TypeRef *result = (TypeRef *)areanAllocate(ctx->memory.typeArena, sizeof(TypeRef));
-    result->kind = TR_FUNCTION;
-    result->functionTypeDesc.isVariadic = params->isVariadic;
-    result->functionTypeDesc.returnType = returnType;
+    TypeRef probe = { 0 };
+    probe.kind = TR_FUNCTION;
+    probe.functionTypeDesc.isVariadic = params->isVariadic;
+    probe.functionTypeDesc.returnType = returnType;
 
     AstValueDeclaration *parameter = params->parameters;
 
+    // probe parameters live on stack unless there are too many of them
+    TypeList local[FUNCTION_PROBE_PARAMS];
     TypeList head = { 0 };
     TypeList *cur = &head;
+    unsigned count = 0;
 
-    SpecifierFlags flags = { 0 };
     while (parameter) {
-      cur = cur->next = (TypeList*)areanAllocate(ctx->memory.typeArena, sizeof (TypeList));
+      cur = cur->next = count < FUNCTION_PROBE_PARAMS ? &local[count] : (TypeList*)areanAllocate(ctx->memory.typeArena, sizeof (TypeList));
       cur->type = parameter->type;
+      cur->next = NULL;
       parameter = parameter->next;
+      ++count;
     }
-    result->functionTypeDesc.parameters = head.next;
+    probe.functionTypeDesc.parameters = head.next;
 
-    return result;
+    return uniqueTypeRef(ctx, &probe);
 }
 
+// =========== Type uniquing ===============================//
+
 void verifyFunctionReturnType(ParserContext *ctx, Declarator *declarator, TypeRef *returnType) {
   TypeRefKind returnRefKind = returnType->kind;
 
@@ -3070,8 +3240,11 @@ static TypeRef *makeArrayTypeFromDeclarator(ParserContext *ctx, TypeRef *element
       }
 
       if (elementType->kind != TR_VLA) {
-        result = makeArrayType(ctx, size, elementType);
-        result->arrayTypeDesc.isStatic = part->arrayDeclarator.isStatic;
+        SpecifierFlags flags = { 0 };
+        flags.bits.isConst = part->arrayDeclarator.isConst;
+        flags.bits.isRestrict = part->arrayDeclarator.isRestrict;
+        flags.bits.isVolatile = part->arrayDeclarator.isVolatile;
+        result = makeQualifiedArrayType(ctx, size, elementType, flags.storage, part->arrayDeclarator.isStatic);
       } else {
         AstExpression *evaluated = createAstConst2(ctx, &sizeExpession->coordinates, sizeExpession->type, e);
         result = makeVLAType(ctx, evaluated, elementType);
@@ -3087,9 +3260,11 @@ static TypeRef *makeArrayTypeFromDeclarator(ParserContext *ctx, TypeRef *element
       if (part->arrayDeclarator.isVolatile) reportDiagnostic(ctx, DIAG_ARRAY_MODIFIER_NOT_IN_PROTOTYPE, &part->coordinates, "volatile");
   }
 
-  result->flags.bits.isConst = part->arrayDeclarator.isConst;
-  result->flags.bits.isRestrict = part->arrayDeclarator.isRestrict;
-  result->flags.bits.isVolatile = part->arrayDeclarator.isVolatile;
+  if (result->kind == TR_VLA) {
+      result->flags.bits.isConst = part->arrayDeclarator.isConst;
+      result->flags.bits.isRestrict = part->arrayDeclarator.isRestrict;
+      result->flags.bits.isVolatile = part->arrayDeclarator.isVolatile;
+  }
 
   return result;
 }
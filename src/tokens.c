@@ -25,26 +25,53 @@ const char* tokenName(int token) {
   return tokenNameInBuffer(token, tmp_buffer);
 }
 
-unsigned tokenRawLine(Token *t) {
-  unsigned lineNum;
-  unsigned lineMax = t->locInfo->fileInfo.lineno;
-  unsigned *lineMap = t->locInfo->fileInfo.linesPos;
-  unsigned pos = t->pos - t->locInfo->buffer;
-
-  for (lineNum = 0; lineNum < lineMax; ++lineNum) {
-      unsigned lineOffset = lineMap[lineNum];
-      if (pos < lineOffset) break;
+// returns 1-based number of line containing pos, i.e. count of line starts at or before pos
+unsigned lineTableLookup(LineTable *lines, unsigned pos) {
+  unsigned *positions = lines->positions;
+  unsigned count = lines->count;
+  unsigned hit = lines->lastHit;
+
+  // lookups tend to go forward through the file, so try the last hit and the line after it first
+  if (hit > 0 && hit <= count && positions[hit - 1] <= pos) {
+      if (hit == count || pos < positions[hit]) return hit;
+      if (hit + 1 == count || pos < positions[hit + 1]) return lines->lastHit = hit + 1;
   }
 
-  return lineNum;
+  unsigned lo = 0, hi = count;
+
+  while (lo < hi) {
+      unsigned mid = lo + ((hi - lo) >> 1);
+      if (pos < positions[mid]) {
+          hi = mid;
+      } else {
+          lo = mid + 1;
+      }
+  }
+
+  return lines->lastHit = lo;
 }
 
-void findFileAndLine(LocationInfo *locInfo, unsigned origLine, unsigned *linePtr, const char **filePtr) {
-  LineChunk *chunk = locInfo->fileInfo.chunks;
+unsigned tokenRawLine(Token *t) {
+  return lineTableLookup(t->locInfo->fileInfo.lines, t->pos - t->locInfo->buffer);
+}
 
-  for (; chunk->posLineNumber > origLine; chunk = chunk->next);
+void findFileAndLine(LocationInfo *locInfo, unsigned origLine, unsigned *linePtr, const char **filePtr) {
+  LineChunk *chunks = locInfo->fileInfo.chunks.items;
+  unsigned lo = 0, hi = locInfo->fileInfo.chunks.count;
+
+  assert(hi > 0);
+
+  // last chunk started at or before origLine
+  while (hi - lo > 1) {
+      unsigned mid = lo + ((hi - lo) >> 1);
+      if (chunks[mid].posLineNumber > origLine) {
+          hi = mid;
+      } else {
+          lo = mid;
+      }
+  }
 
-  assert(chunk != NULL);
+  LineChunk *chunk = &chunks[lo];
 
   int32_t diff = origLine - chunk->posLineNumber - 1;
   *linePtr = chunk->overrideLineNumber + diff;
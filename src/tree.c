@@ -112,6 +112,15 @@ Boolean isAssignmentArith(ExpressionType op) {
   return EB_ASG_ADD <= op && op <= EB_ASG_OR;
 }
 
+Arena *astNodeArena(ParserContext *ctx) {
+  return ctx->memory.bodyArena ? ctx->memory.bodyArena : ctx->memory.astArena;
+}
+
+// nodes of a pipelined function body are gone before the token window is recycled
+static void retainNodeCoordinates(ParserContext *ctx, Arena *arena, Coordinates *coords) {
+  if (arena == ctx->memory.astArena) retainCoordinates(ctx, coords);
+}
+
 DeclaratorPart *allocateDeclaratorPart(ParserContext *ctx) {
   return (DeclaratorPart *)areanAllocate(ctx->memory.tokenArena, sizeof(DeclaratorPart));
 }
@@ -130,6 +139,7 @@ AstIdentifierList *createIdentifierList(ParserContext *ctx, Coordinates *coords,
   AstIdentifierList *result = areanAllocate(ctx->memory.astArena, sizeof(AstIdentifierList));
 
   result->coordinates = *coords;
+  retainCoordinates(ctx, &result->coordinates);
   result->name = name;
 
   return result;
@@ -139,6 +149,7 @@ AstAttributeList *createAttributeList(ParserContext *ctx, Coordinates *coords, c
   AstAttributeList *result = areanAllocate(ctx->memory.astArena, sizeof(AstAttributeList));
 
   result->coordinates = *coords;
+  retainCoordinates(ctx, &result->coordinates);
   result->attribName = attribName;
   result->argument = argument;
 
@@ -149,6 +160,7 @@ AstAttribute *createAttribute(ParserContext *ctx, Coordinates *coords, AstAttrib
   AstAttribute *result = areanAllocate(ctx->memory.astArena, sizeof(AstAttribute));
 
   result->coordinates = *coords;
+  retainCoordinates(ctx, &result->coordinates);
   result->attributeList = attrList;
 
   return result;
@@ -157,10 +169,15 @@ AstAttribute *createAttribute(ParserContext *ctx, Coordinates *coords, AstAttrib
 // declarations
 
 AstValueDeclaration *createAstValueDeclaration(ParserContext *ctx, Coordinates *coords, ValueKind kind, TypeRef *type, const char *name, unsigned index, unsigned flags, AstInitializer *initializer) {
-    AstValueDeclaration *result = (AstValueDeclaration *)areanAllocate(ctx->memory.astArena, sizeof (AstValueDeclaration));
+    SpecifierFlags storage = { flags };
+    // only automatic locals die together with the function body
+    Boolean isAutomatic = kind == VD_VARIABLE && !storage.bits.isStatic && !storage.bits.isExternal;
+    Arena *arena = isAutomatic ? astNodeArena(ctx) : ctx->memory.astArena;
+    AstValueDeclaration *result = (AstValueDeclaration *)areanAllocate(arena, sizeof (AstValueDeclaration));
 
     result->coordinates.left = coords->left;
     result->coordinates.right = coords->right;
+    retainNodeCoordinates(ctx, arena, &result->coordinates);
 
     result->kind = kind;
     result->name = name;
@@ -201,18 +218,24 @@ AstTranslationUnit *createTranslationUnit(ParserContext *ctx, AstDeclaration *de
 }
 
 AstInitializerList *createAstInitializerList(ParserContext *ctx) {
-    return (AstInitializerList*)areanAllocate(ctx->memory.astArena, sizeof(AstInitializerList));
+    return (AstInitializerList*)areanAllocate(astNodeArena(ctx), sizeof(AstInitializerList));
 }
 
 AstInitializer *createEmptyInitializer(ParserContext *ctx) {
-  return areanAllocate(ctx->memory.astArena, sizeof (AstInitializer));
+  Arena *arena = astNodeArena(ctx);
+  AstInitializer *result = areanAllocate(arena, sizeof (AstInitializer));
+  // coordinates are filled by caller
+  retainNodeCoordinates(ctx, arena, &result->coordinates);
+  return result;
 }
 
 AstInitializer *createAstInitializer(ParserContext *ctx, Coordinates *coords, InitializerKind kind) {
-    AstInitializer* result = (AstInitializer*)areanAllocate(ctx->memory.astArena, sizeof(AstInitializer));
+    Arena *arena = astNodeArena(ctx);
+    AstInitializer* result = (AstInitializer*)areanAllocate(arena, sizeof(AstInitializer));
 
     result->coordinates.left = coords->left;
     result->coordinates.right = coords->right;
+    retainNodeCoordinates(ctx, arena, &result->coordinates);
 
     result->kind = kind;
 
@@ -232,6 +255,7 @@ AstFunctionDeclaration *createFunctionDeclaration(ParserContext *ctx, Coordinate
 
   result->coordinates.left = coords->left;
   result->coordinates.right = coords->right;
+  retainCoordinates(ctx, &result->coordinates);
 
   result->flags.storage = flags;
   result->name = name;
@@ -256,19 +280,23 @@ AstFunctionDefinition *createFunctionDefinition(ParserContext *ctx, AstFunctionD
 
 
 static AstExpression *allocAstExpression(ParserContext *ctx, Coordinates *coords) {
-  AstExpression *result = (AstExpression *)areanAllocate(ctx->memory.astArena, sizeof(AstExpression));
+  Arena *arena = astNodeArena(ctx);
+  AstExpression *result = (AstExpression *)areanAllocate(arena, sizeof(AstExpression));
 
   result->coordinates.left = coords->left;
   result->coordinates.right = coords->right;
+  retainNodeCoordinates(ctx, arena, &result->coordinates);
 
   return result;
 }
 
 static AstStatement *allocAstStatement(ParserContext *ctx, Coordinates *coords) {
-  AstStatement *result = (AstStatement *)areanAllocate(ctx->memory.astArena, sizeof(AstStatement));
+  Arena *arena = astNodeArena(ctx);
+  AstStatement *result = (AstStatement *)areanAllocate(arena, sizeof(AstStatement));
 
   result->coordinates.left = coords->left;
   result->coordinates.right = coords->right;
+  retainNodeCoordinates(ctx, arena, &result->coordinates);
 
   return result;
 }
@@ -454,7 +482,7 @@ AstStatement *createExprStatement(ParserContext *ctx, AstExpression* expression)
     return result;
 }
 
-AstStatement *createLabelStatement(ParserContext *ctx, Coordinates *coords, LabelKind labelKind, AstStatement *body, const char *label, int c) {
+AstStatement *createLabelStatement(ParserContext *ctx, Coordinates *coords, LabelKind labelKind, AstStatement *body, const char *label, int64_t c) {
     AstStatement *result = allocAstStatement(ctx, coords);
 
     result->statementKind = SK_LABEL;
@@ -558,6 +586,7 @@ EnumConstant *createEnumConstant(ParserContext *ctx, Coordinates *coords, const
 
   def->coordinates.left = coords->left;
   def->coordinates.right = coords->right;
+  retainCoordinates(ctx, &def->coordinates);
 
   def->name = name;
   def->value = v;
@@ -570,6 +599,7 @@ StructualMember *createStructualMember(ParserContext *ctx, Coordinates *coords,
 
   def->coordinates.left = coords->left;
   def->coordinates.right = coords->right;
+  retainCoordinates(ctx, &def->coordinates);
 
   def->name = name;
   def->type = type;
@@ -581,6 +611,7 @@ StructualMember *createStructualMember(ParserContext *ctx, Coordinates *coords,
 TypeDefiniton *createTypeDefiniton(ParserContext *ctx, enum TypeDefinitionKind kind, Coordinates *coords, const char *name) {
   TypeDefiniton *def = areanAllocate(ctx->memory.typeArena, sizeof(TypeDefiniton));
   def->coordinates = *coords;
+  retainCoordinates(ctx, &def->coordinates);
   def->name = name;
   def->kind = kind;
   def->scope = ctx->currentScope;
@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "mem.h"
 #include "utils.h"
@@ -120,131 +123,292 @@ void popOffStack(Vector *v, size_t pops) {
 // =====================================================
 
 
-struct LinkedNode {
-    struct LinkedNode* next;
+/**
+ * Open addressing hash table with linear probing. Keys, values and hashes are kept inline in
+ * the slot array which is resized when load factor exceeds 3/4. Removed entries are marked as
+ * deleted instead of shifting the neighbours so it is safe to remove entries while iterating over map.
+ */
+
+enum SlotState {
+  SS_EMPTY = 0,
+  SS_USED,
+  SS_DELETED
+};
+
+struct HashSlot {
     intptr_t key;
     intptr_t value;
+    unsigned hash;
+    unsigned state;
 };
 
 struct _HashMap {
-    int capacity;
-    struct LinkedNode** storage;
+    unsigned capacity; // always power of two
+    unsigned count;
+    unsigned deleted;
+    struct HashSlot *storage;
 
     hashCode_fun hashCode;
     compare_fun compare;
+
+    Arena *arena; // if not NULL map and its storage live in the arena
 };
 
+#define MIN_MAP_CAPACITY 8
+
+static unsigned mapCapacityFor(int capacity) {
+    unsigned result = MIN_MAP_CAPACITY;
+    while (result < capacity) result <<= 1;
+    return result;
+}
+
+static struct HashSlot *allocateSlots(HashMap *map, unsigned capacity) {
+    size_t size = sizeof(struct HashSlot) * capacity;
+    return (struct HashSlot *)(map->arena ? areanAllocate(map->arena, size) : heapAllocate(size));
+}
+
+unsigned mixHash(unsigned h) {
+    h ^= h >> 16;
+    h *= 0x45d9f3bU;
+    h ^= h >> 16;
+    return h;
+}
 
-struct _HashMap* createHashMap(int capacity, hashCode_fun hc, compare_fun cmp) {
-    struct _HashMap* map = (struct _HashMap*)heapAllocate(sizeof(struct _HashMap));
+static struct HashSlot *findSlot(HashMap *map, intptr_t key, unsigned hash) {
+    unsigned mask = map->capacity - 1;
+    unsigned idx = hash & mask;
+
+    for (;;) {
+        struct HashSlot *slot = &map->storage[idx];
+        if (slot->state == SS_EMPTY) return NULL;
+        if (slot->state == SS_USED && slot->hash == hash && map->compare(slot->key, key) == 0) return slot;
+        idx = (idx + 1) & mask;
+    }
+}
+
+static void rehashMap(HashMap *map, unsigned newCapacity) {
+    struct HashSlot *oldStorage = map->storage;
+    unsigned oldCapacity = map->capacity;
+    unsigned mask = newCapacity - 1;
+    unsigned i;
+
+    map->storage = allocateSlots(map, newCapacity);
+    map->capacity = newCapacity;
+    map->deleted = 0;
+
+    for (i = 0; i < oldCapacity; ++i) {
+        struct HashSlot *old = &oldStorage[i];
+        if (old->state != SS_USED) continue;
+        unsigned idx = old->hash & mask;
+        while (map->storage[idx].state != SS_EMPTY) idx = (idx + 1) & mask;
+        map->storage[idx] = *old;
+    }
+
+    if (!map->arena) releaseHeap(oldStorage);
+}
+
+static HashMap *initHashMap(HashMap *map, int capacity, hashCode_fun hc, compare_fun cmp) {
     map->hashCode = hc;
     map->compare = cmp;
-    map->capacity = capacity;
-    map->storage = (struct LinkedNode**)heapAllocate(sizeof(struct LinkedNode*) * capacity);;
+    map->capacity = mapCapacityFor(capacity);
+    map->storage = allocateSlots(map, map->capacity);
 
     return map;
 }
 
-intptr_t putToHashMap(HashMap* map, intptr_t key, intptr_t value) {
-    unsigned hc = map->hashCode(key);
-    unsigned idx = hc % map->capacity;
-    struct LinkedNode* list = map->storage[idx];
-
-    while (list != NULL) {
-        if (map->compare(list->key, key) == 0) {
-            intptr_t oldValue = list->value;
-            list->value = value;
-            return oldValue;
-        }
-        list = list->next;
-    }
-
-    struct LinkedNode* newNode = (struct LinkedNode*)heapAllocate(sizeof(struct LinkedNode));
-    newNode->key = key;
-    newNode->value = value;
-    newNode->next = map->storage[idx];
-    map->storage[idx] = newNode;
+HashMap *createHashMap(int capacity, hashCode_fun hc, compare_fun cmp) {
+    HashMap *map = (HashMap *)heapAllocate(sizeof(HashMap));
+    return initHashMap(map, capacity, hc, cmp);
+}
 
-    return 0;
+HashMap *createArenaHashMap(Arena *arena, int capacity, hashCode_fun hc, compare_fun cmp) {
+    HashMap *map = (HashMap *)areanAllocate(arena, sizeof(HashMap));
+    map->arena = arena;
+    return initHashMap(map, capacity, hc, cmp);
 }
 
+intptr_t putToHashMap(HashMap* map, intptr_t key, intptr_t value) {
+    unsigned hash = mixHash(map->hashCode(key));
+    struct HashSlot *slot = findSlot(map, key, hash);
 
-intptr_t getFromHashMap(HashMap* map, intptr_t key) {
-    unsigned hc = map->hashCode(key);
-    unsigned idx = hc % map->capacity;
-    struct LinkedNode* list = map->storage[idx];
+    if (slot) {
+        intptr_t oldValue = slot->value;
+        slot->value = value;
+        return oldValue;
+    }
 
-    while (list != NULL) {
-        if (map->compare(list->key, key) == 0) {
-            return list->value;
-        }
-        list = list->next;
+    if ((map->count + map->deleted + 1) * 4 > map->capacity * 3) {
+        // if most of occupied slots are deleted just clean them up
+        unsigned newCapacity = (map->count + 1) * 2 > map->capacity ? map->capacity << 1 : map->capacity;
+        rehashMap(map, newCapacity);
     }
 
+    unsigned mask = map->capacity - 1;
+    unsigned idx = hash & mask;
+    while (map->storage[idx].state == SS_USED) idx = (idx + 1) & mask;
+
+    slot = &map->storage[idx];
+    if (slot->state == SS_DELETED) map->deleted--;
+
+    slot->key = key;
+    slot->value = value;
+    slot->hash = hash;
+    slot->state = SS_USED;
+    map->count++;
+
     return 0;
 }
 
+intptr_t getFromHashMap(HashMap* map, intptr_t key) {
+    struct HashSlot *slot = findSlot(map, key, mixHash(map->hashCode(key)));
+    return slot ? slot->value : 0;
+}
 
 intptr_t removeFromHashMap(HashMap* map, intptr_t key) {
-    unsigned hc = map->hashCode(key);
-    unsigned idx = hc % map->capacity;
-    struct LinkedNode** prev = &(map->storage[idx]);
-    struct LinkedNode* list = *prev;
-
-    while (list != NULL) {
-        if (map->compare(list->key, key) == 0) {
-            *prev = list->next;
-            intptr_t oldValue = list->value;
-            releaseHeap(list);
-            return oldValue;
-        }
-        prev = &list->next;
-        list = *prev;
-    }
+    struct HashSlot *slot = findSlot(map, key, mixHash(map->hashCode(key)));
 
-    return 0;
+    if (slot == NULL) return 0;
+
+    intptr_t oldValue = slot->value;
+    slot->state = SS_DELETED;
+    slot->key = slot->value = 0;
+    map->count--;
+    map->deleted++;
+
+    return oldValue;
 }
 
 void foreachHashMap(HashMap *map, void (*func)(intptr_t, intptr_t, void*), void *ctx) {
-    for (unsigned idx = 0; idx < map->capacity; ++idx) {
-        struct LinkedNode *node = map->storage[idx];
-        while (node != NULL) {
-            func(node->key, node->value, ctx);
-            node = node->next;
+    unsigned idx;
+    for (idx = 0; idx < map->capacity; ++idx) {
+        struct HashSlot *slot = &map->storage[idx];
+        if (slot->state == SS_USED) {
+            func(slot->key, slot->value, ctx);
         }
     }
 }
 
 int isInHashMap(HashMap* map, intptr_t key) {
-    unsigned hc = map->hashCode(key);
-    unsigned idx = hc % map->capacity;
-    struct LinkedNode* list = map->storage[idx];
-
-    while (list != NULL) {
-        if (map->compare(list->key, key) == 0) {
-            return TRUE;
-        }
-        list = list->next;
-    }
+    return findSlot(map, key, mixHash(map->hashCode(key))) != NULL;
+}
 
-    return FALSE;
+unsigned hashMapSize(HashMap *map) {
+    return map->count;
 }
 
 void releaseHashMap(HashMap *map) {
-  unsigned i;
-  for (i = 0; i < map->capacity; ++i) {
-      struct LinkedNode *list = map->storage[i];
-      while (list) {
-          struct LinkedNode *next = list->next;
-          releaseHeap(list);
-          list = next;
-      }
-      map->storage[i] = NULL;
-  }
+  if (map->arena) return;
   releaseHeap(map->storage);
   releaseHeap(map);
 }
 
+// =========== Atoms ===============================//
+
+typedef struct _Atom {
+  unsigned hash;
+  unsigned length;
+  // followed by NUL-terminated text
+} Atom;
+
+#define ATOM_TEXT(atom) ((char *)((atom) + 1))
+#define TEXT_ATOM(text) (((const Atom *)(text)) - 1)
+
+#define INITIAL_ATOM_TABLE_CAPACITY 4096
+
+static struct {
+  Arena *arena;
+  Atom **slots;
+  size_t capacity; // always a power of 2
+  size_t count;
+} atomTable;
+
+static unsigned hashBytes(const char *s, size_t length) {
+  // FNV-1a
+  unsigned h = 2166136261U;
+  size_t i;
+  for (i = 0; i < length; ++i) {
+      h ^= (unsigned char)s[i];
+      h *= 16777619U;
+  }
+  return h;
+}
+
+static void growAtomTable() {
+  size_t newCapacity = atomTable.capacity ? atomTable.capacity << 1 : INITIAL_ATOM_TABLE_CAPACITY;
+  size_t mask = newCapacity - 1;
+  Atom **newSlots = (Atom **)heapAllocate(sizeof(Atom *) * newCapacity);
+  size_t i;
+
+  for (i = 0; i < atomTable.capacity; ++i) {
+      Atom *atom = atomTable.slots[i];
+      if (atom) {
+          size_t idx = atom->hash & mask;
+          while (newSlots[idx]) idx = (idx + 1) & mask;
+          newSlots[idx] = atom;
+      }
+  }
+
+  releaseHeap(atomTable.slots);
+  atomTable.slots = newSlots;
+  atomTable.capacity = newCapacity;
+
+  if (atomTable.arena == NULL) {
+      atomTable.arena = createArena("Atoms Arena", 4 * DEFAULT_CHUNCK_SIZE);
+  }
+}
+
+const char *internString(const char *s, size_t length) {
+  // keep load factor below 1/2 to make probe sequences short
+  if ((atomTable.count + 1) * 2 > atomTable.capacity) {
+      growAtomTable();
+  }
+
+  unsigned hash = hashBytes(s, length);
+  size_t mask = atomTable.capacity - 1;
+  size_t idx = hash & mask;
+  Atom *atom;
+
+  while ((atom = atomTable.slots[idx]) != NULL) {
+      if (atom->hash == hash && atom->length == length && memcmp(ATOM_TEXT(atom), s, length) == 0) {
+          return ATOM_TEXT(atom);
+      }
+      idx = (idx + 1) & mask;
+  }
+
+  atom = (Atom *)areanAllocate(atomTable.arena, sizeof(Atom) + length + 1);
+  atom->hash = hash;
+  atom->length = length;
+  memcpy(ATOM_TEXT(atom), s, length);
+  ATOM_TEXT(atom)[length] = '\0';
+
+  atomTable.slots[idx] = atom;
+  atomTable.count += 1;
+
+  return ATOM_TEXT(atom);
+}
+
+const char *internCString(const char *s) {
+  return internString(s, strlen(s));
+}
+
+int atomHashCode(intptr_t v) {
+  assert(v != 0 && "hashMap key is NULL");
+  return (int)TEXT_ATOM((const char *)v)->hash;
+}
+
+int atomCmp(intptr_t v1, intptr_t v2) {
+  return v1 != v2;
+}
+
+void printAtomsStatistic(FILE *output) {
+  fprintf(output, "Atoms: interned = %lu, table capacity = %lu\n", atomTable.count, atomTable.capacity);
+  if (atomTable.arena) {
+    printArenaStatistic(output, atomTable.arena);
+  }
+}
+
+// =========== Atoms ===============================//
+
 LinkedListNode *addNodeToListHead(LinkedList *list, LinkedListNode *node) {
     LinkedListNode *head = node->next = list->head;
 
@@ -424,42 +588,52 @@ unsigned countLines(FILE* file) {
   return result;
 }
 
-unsigned countLinesInBuffer(const char *buffer) {
-  unsigned result = 1;
-  unsigned idx = 0;
-
-  while (buffer[idx]) {
-    int ch = buffer[idx++];
-    if(ch == '\n') {
-      result++;
-    }
-  }
-
-  return result;
-}
-
-char *readFileToBuffer(const char *fileName, size_t *bufferSize) {
+/**
+ * Maps file into memory read-only. Lexer relies on '\0' sentinel right after the content,
+ * mmap zero-fills the tail of the last page, so only files which end exactly at page
+ * boundary (or empty ones) have to be copied into heap buffer to get room for sentinel.
+ */
+const char *readFileToBuffer(const char *fileName, size_t *bufferSize) {
 
-  FILE* opened = fopen(fileName, "r");
+  int fd = open(fileName, O_RDONLY);
 
-  if (opened == NULL) return NULL;
+  if (fd < 0) return NULL;
 
-  fseek(opened, 0L, SEEK_END);
-  size_t size = ftell(opened);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+      close(fd);
+      return NULL;
+  }
 
-  rewind(opened);
+  size_t size = st.st_size;
+  long pageSize = sysconf(_SC_PAGESIZE);
+  const char *result = NULL;
 
-  char *b = heapAllocate(size + 1);
+  if (size % pageSize) {
+      void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+          result = (const char *)mapped;
+      }
+  }
 
-  size_t readed = fread(b, 1, size, opened);
+  if (result == NULL) {
+      char *b = heapAllocate(size + 1);
+      size_t readed = 0;
+      while (readed < size) {
+          ssize_t r = read(fd, b + readed, size - readed);
+          if (r <= 0) break;
+          readed += r;
+      }
 
-  assert(readed == size);
+      assert(readed == size);
+      result = b;
+  }
 
-  fclose(opened);
+  close(fd);
 
   *bufferSize = size + 1;
 
-  return b;
+  return result;
 }
 
 void putSymbol(StringBuffer *b, char c) {
@@ -472,6 +646,17 @@ void putSymbol(StringBuffer *b, char c) {
   b->ptr[b->idx++] = c;
 }
 
+void putSymbols(StringBuffer *b, const char *s, size_t n) {
+  if (b->idx + n > b->size) {
+      size_t newSize = (b->size + n + 512) << 1;
+      b->ptr = heapReallocate(b->ptr, b->size, newSize);
+      b->size = newSize;
+  }
+
+  memcpy(b->ptr + b->idx, s, n);
+  b->idx += n;
+}
+
 void unreachable(const char *msg) {
   fprintf(stderr, "Unreachable execution: %s\n", msg);
   abort();
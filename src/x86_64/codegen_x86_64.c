@@ -44,7 +44,7 @@ static void disassemble(FILE *output, uint8_t *buffer, size_t size) {
 }
 
 static struct Label *allocateLabel(GenerationContext *ctx) {
-  return areanAllocate(ctx->codegenArena, sizeof (struct Label));
+  return areanAllocate(ctx->scratchArena, sizeof (struct Label));
 }
 
 void emitPushRegF(GeneratedFunction *f, enum Registers r) {
@@ -291,7 +291,10 @@ static Boolean emitFloatConst(GeneratedFunction *f, AstConst *_const, TypeId tid
       emitFloatIntoSection(rodata, tid, _const->f);
 
       HashMap *cache = floatCache(ctx, tid);
-      putToHashMap(cache, (intptr_t)&_const->f, offset + 1);
+      // the key has to outlive a function body AST
+      float80_const_t *key = (float80_const_t *)areanAllocate(ctx->codegenArena, sizeof (float80_const_t));
+      *key = _const->f;
+      putToHashMap(cache, (intptr_t)key, offset + 1);
   }
 
   Relocation *reloc = allocateRelocation(ctx);
@@ -353,10 +356,12 @@ static void emitConst(GeneratedFunction *f, AstConst *_const, TypeId tid) {
 }
 
 static void bindLabel(GeneratedFunction *f, struct Label *l) {
+  peepholeBarrier(f); // code before a jump target must stay as emitted
   l->label_cp = f->section->pc - f->section->start;
   l->binded = 1;
   struct LabelJump *jump = l->jumps;
   while (jump) {
+      jump->target_cp = l->label_cp;
       patchJumpTo(f, jump->instruction_cp, jump->instSize, l->label_cp);
       jump = jump->next;
   }
@@ -364,7 +369,8 @@ static void bindLabel(GeneratedFunction *f, struct Label *l) {
   struct LabelRef *ref = l->refs;
 
   while (ref) {
-    patchRefTo(f, ref->offset_cp, l->label_cp);
+    ref->target_cp = l->label_cp;
+    patchRefTo(f, ref->offset_cp, ref->origin_cp, l->label_cp);
     ref = ref->next;
   }
   l->refs = NULL;
@@ -412,6 +418,52 @@ static enum JumpCondition generateCondition(GeneratedFunction *f, AstExpression
 static void translateAddress(GeneratedFunction *f, AstExpression *expression, Address *addr);
 static Boolean generateStatement(GeneratedFunction *f, AstStatement *stmt);
 static Boolean generateBlock(GeneratedFunction *f, AstBlock *block);
+static void copyStructTo(GeneratedFunction *f, TypeRef *type, Address *src, Address *dst);
+static void emitBlockZero(GeneratedFunction *f, Address *dst, int32_t size);
+
+static const enum Registers calleeSavedRegs[R_CALLEE_SAVED_COUNT] = { R_EBX, R_R12, R_R13, R_R14, R_R15 };
+
+// register which holds the named local or R_BAD if the local lives in memory
+static enum Registers promotedRegister(AstExpression *expr) {
+  if (expr->op != E_NAMEREF) return R_BAD;
+  Symbol *s = expr->nameRefExpr.s;
+  if (s->kind != ValueSymbol || !s->variableDesc->flags.bits.isLocal) return R_BAD;
+  GeneratedVariable *gv = s->variableDesc->gen;
+  return gv && gv->isPromoted ? (enum Registers)gv->reg : R_BAD;
+}
+
+// callee-saved registers are spilled right below the saved rbp
+static void saveCalleeSaved(GeneratedFunction *f) {
+  Address addr = { R_EBP, R_BAD, 0, 0, NULL, NULL };
+  unsigned i;
+  for (i = 0; i < f->savedRegCount; ++i) {
+      addr.imm = -(int32_t)((i + 1) * sizeof(intptr_t));
+      emitMoveRA(f, calleeSavedRegs[i], &addr, sizeof(intptr_t));
+  }
+}
+
+static void restoreCalleeSaved(GeneratedFunction *f) {
+  Address addr = { R_EBP, R_BAD, 0, 0, NULL, NULL };
+  unsigned i;
+  for (i = 0; i < f->savedRegCount; ++i) {
+      addr.imm = -(int32_t)((i + 1) * sizeof(intptr_t));
+      emitMoveAR(f, &addr, calleeSavedRegs[i], sizeof(intptr_t));
+  }
+}
+
+// `*x` where x is a promoted local
+static enum Registers promotedLoad(AstExpression *expr) {
+  return expr->op == EU_DEREF ? promotedRegister(expr->unaryExpr.argument) : R_BAD;
+}
+
+// `*x` where x is a variable in memory, its address is known without evaluating anything
+static Boolean isNamedLoad(AstExpression *expr) {
+  if (expr->op != EU_DEREF) return FALSE;
+  if (expr->type->kind != TR_VALUE && expr->type->kind != TR_POINTED) return FALSE;
+  if (isCompositeType(expr->type)) return FALSE;
+  AstExpression *arg = expr->unaryExpr.argument;
+  return arg->op == E_NAMEREF && promotedRegister(arg) == R_BAD;
+}
 
 static void emitSymbolCall(GeneratedFunction *f, Symbol *s) {
   Relocation *newReloc = allocateRelocation(f->context);
@@ -425,34 +477,6 @@ static void emitSymbolCall(GeneratedFunction *f, Symbol *s) {
   emitCallLiteral(f, newReloc);
 }
 
-static void copyStructTo(GeneratedFunction *f, TypeRef *type, Address *src, Address *dst) {
-
-  assert(isCompositeType(type));
-
-  int32_t align = type->descriptorDesc->typeDefinition->align;
-  int32_t size = computeTypeSize(type);
-  int32_t copied = 0;
-
-  while (copied < size) {
-      int32_t chunkSize;
-      int32_t left = size - copied;
-
-      if (left >= 8) chunkSize = sizeof(int64_t);
-      else if (left >= 4) chunkSize = sizeof(int32_t);
-      else if (left >= 2) chunkSize = sizeof(int16_t);
-      else chunkSize = sizeof(int8_t);
-
-      chunkSize = min(align, chunkSize);
-
-      emitMoveAR(f, src, R_TMP, chunkSize);
-      emitMoveRA(f, R_TMP, dst, chunkSize);
-
-      src->imm += chunkSize;
-      dst->imm += chunkSize;
-      copied += chunkSize;
-  }
-}
-
 static size_t emitInitializerImpl(GeneratedFunction *f, int32_t typeSize, Address *dst, AstInitializer *initializer, Boolean skipNull) {
   size_t emitted = 0;
 
@@ -529,34 +553,14 @@ static void emitLocalInitializer(GeneratedFunction *f, TypeRef* type, int32_t fr
   Address addr = { R_EBP, R_BAD, 0, frameOffset };
 
   size_t typeSize = computeTypeSize(type);
-  int32_t align = typeAlignment(type);
+  Boolean isWhole = initializer->kind == IK_EXPRESSION && computeTypeSize(initializer->expression->type) >= typeSize;
 
-  if (typeSize >= 16) {
-      emitLea(f, &addr, R_ARG_0);
-      emitArithRR(f, OP_XOR, R_ARG_1, R_ARG_1, sizeof (intptr_t));
-      emitMoveCR(f, typeSize, R_ARG_2, T_U8);
-      emitSymbolCall(f, f->context->memsetSymbol);
+  if (isFlatType(type) && !isWhole) {
+      // elements and members without an initializer, padding and the tail of a string have to be zero
+      emitBlockZero(f, &addr, typeSize);
       emitInitializerImpl(f, typeSize, &addr, initializer, TRUE);
   } else {
-
-    size_t emitted = emitInitializerImpl(f, typeSize, &addr, initializer, FALSE);
-
-    if (isCompositeType(type) && emitted < typeSize) {
-        addr.imm += emitted;
-        emitArithRR(f, OP_XOR, R_ACC, R_ACC, sizeof (intptr_t));
-        int32_t delta1 = ALIGN_SIZE(emitted, sizeof (intptr_t));
-        while (emitted < delta1 && emitted < typeSize) {
-            emitMoveRA(f, R_ACC, &addr, sizeof(uint8_t));
-            addr.imm += sizeof(uint8_t);
-            emitted += sizeof(uint8_t);
-        }
-
-        while (emitted < typeSize) {
-          emitMoveRA(f, R_ACC, &addr, sizeof(intptr_t));
-          addr.imm += sizeof(intptr_t);
-          emitted += sizeof(intptr_t);
-        }
-    }
+      emitInitializerImpl(f, typeSize, &addr, initializer, FALSE);
   }
 }
 
@@ -1133,6 +1137,23 @@ static void generateCast(GeneratedFunction *f, AstCastExpression *cast) {
     }
 }
 
+static Boolean isSimpleOperand(AstExpression *expr) {
+  return expr->op == E_CONST || promotedLoad(expr) != R_BAD || isNamedLoad(expr);
+}
+
+static Boolean isSwappableOp(ExpressionType op) {
+  switch (op) {
+  case EB_ADD:
+  case EB_MUL:
+  case EB_AND:
+  case EB_OR:
+  case EB_XOR:
+      return TRUE;
+  default:
+      return FALSE;
+  }
+}
+
 static void generateBinary(GeneratedFunction *f, AstExpression *binOp) {
   assert(isBinOp(binOp->op));
   AstExpression *left = binOp->binaryExpr.left;
@@ -1141,9 +1162,6 @@ static void generateBinary(GeneratedFunction *f, AstExpression *binOp) {
   size_t opSize = computeTypeSize(binOp->type);
   Boolean isFP = isRealType(left->type);
 
-  // TODO: optimize memory operations
-  generateExpression(f, left);
-
   AstExpression *right = binOp->binaryExpr.right;
   assert(right);
   assert(isFP == isRealType(right->type));
@@ -1152,7 +1170,17 @@ static void generateBinary(GeneratedFunction *f, AstExpression *binOp) {
   TypeId lid = typeToId(left->type);
   TypeId rid = typeToId(right->type);
 
+  if (!isFP && lid == rid && isSwappableOp(binOp->op) && isSimpleOperand(left) && !isSimpleOperand(right)) {
+      // evaluate the complex operand first so the simple one does not have to be saved on stack
+      AstExpression *tmp = left;
+      left = right;
+      right = tmp;
+  }
+
+  generateExpression(f, left);
+
   enum Opcodes opcode = selectOpcode(binOp->op, binOp->type);
+  enum Registers rightReg = promotedLoad(right);
 
   if (rid == T_F10) {
       // TODO: probably it worth to be poped and pushed after evaluation to FP stack
@@ -1167,6 +1195,13 @@ static void generateBinary(GeneratedFunction *f, AstExpression *binOp) {
         uint64_t cnst = right->constExpr.i;
         emitArithConst(f, opcode, R_ACC, cnst, tid);
       }
+  } else if (rightReg != R_BAD && (lid == rid || isShiftOp(binOp->op))) {
+      emitArithRR(f, opcode, R_ACC, rightReg, opSize);
+  } else if (isNamedLoad(right) && !isShiftOp(binOp->op) && lid == rid) {
+      // variable address is computed without touching the accumulator
+      Address addr = { 0 };
+      translateAddress(f, right->unaryExpr.argument, &addr);
+      emitArithAR(f, opcode, isFP ? R_FACC : R_ACC, &addr, opSize);
   } else {
     if (isFP) {
       emitPushRegF(f, R_FACC);
@@ -1224,19 +1259,27 @@ static void generateDiv(GeneratedFunction *f, AstExpression *binOp) {
 
   generateExpression(f, left);
 
-  emitPushReg(f, R_ACC);
-
   AstExpression *right = binOp->binaryExpr.right;
   Boolean isRU = isUnsignedType(right->type);
 
   TypeId lid = typeToId(left->type);
   TypeId rid = typeToId(right->type);
 
+  enum Registers rightReg = promotedLoad(right);
+
   enum Opcodes opcode;
-  if (right->op == EU_DEREF && lid == rid) {
+  if (rightReg != R_BAD && lid == rid) {
+      if (isU) {
+        emitArithRR(f, OP_XOR, R_EDX, R_EDX, opSize);
+        opcode = OP_UDIV;
+      } else {
+        emitConvertWDQ(f, 0x99, opSize);
+        opcode = OP_SDIV;
+      }
+      emitArithRR(f, opcode, R_ACC, rightReg, opSize);
+  } else if (isNamedLoad(right) && lid == rid) {
       Address addr = { 0 };
       translateAddress(f, right->unaryExpr.argument, &addr);
-      emitPopReg(f, R_ACC);
 
       if (isU) {
         emitArithRR(f, OP_XOR, R_EDX, R_EDX, opSize);
@@ -1245,8 +1288,9 @@ static void generateDiv(GeneratedFunction *f, AstExpression *binOp) {
         emitConvertWDQ(f, 0x99, opSize);
         opcode = OP_SDIV;
       }
-      emitArithAR(f, OP_SDIV, R_ACC, &addr, opSize);
+      emitArithAR(f, opcode, R_ACC, &addr, opSize);
   } else {
+      emitPushReg(f, R_ACC);
       generateExpression(f, right);
       emitMoveRR(f, R_ACC, R_TMP2, opSize);
       emitPopReg(f, R_ACC);
@@ -1353,6 +1397,7 @@ static void storeBitField(GeneratedFunction *f, TypeRef *t, enum Registers from,
 }
 
 static void localVarAddress(const Symbol *s, Address *addr) {
+  assert(!s->variableDesc->gen->isPromoted);
   addr->base = R_EBP;
   addr->index = R_BAD;
   addr->imm = s->variableDesc->gen->baseOffset;
@@ -1368,6 +1413,91 @@ static void leaRelocatable(GeneratedFunction *f, Address *addr, enum Registers r
   }
 }
 
+// =========== Block memory operations ===============================//
+
+#define INLINE_BLOCK_LIMIT 128 // bigger blocks are handed to memcpy/memset
+
+static void emitAlignedSymbolCall(GeneratedFunction *f, Symbol *s) {
+  // the call may happen in the middle of an expression with something pushed
+  Boolean misaligned = (f->stackOffset / (int32_t)sizeof(intptr_t)) % 2 != 0;
+
+  if (misaligned) emitArithConst(f, OP_SUB, R_ESP, sizeof(intptr_t), T_S8);
+  emitSymbolCall(f, s);
+  if (misaligned) emitArithConst(f, OP_ADD, R_ESP, sizeof(intptr_t), T_S8);
+}
+
+static void emitBlockChunk(GeneratedFunction *f, Address *src, Address *dst, int32_t offset, int32_t chunk) {
+  Address s = { 0 }, d = *dst;
+  d.imm += offset;
+
+  if (src) {
+    s = *src;
+    s.imm += offset;
+  }
+
+  if (chunk == 16) {
+    if (src) emitMovupsAR(f, &s, R_FBLOCK);
+    emitMovupsRA(f, R_FBLOCK, &d);
+  } else {
+    if (src) emitMoveAR(f, &s, R_TMP, chunk);
+    emitMoveRA(f, R_TMP, &d, chunk);
+  }
+}
+
+// copies (or zeroes if there is no src) in the widest chunks, the last chunk overlaps its predecessor instead of narrowing
+static void emitBlockInline(GeneratedFunction *f, Address *src, Address *dst, int32_t size) {
+  if (size == 0) return;
+
+  int32_t chunk = size >= 16 ? 16 : size >= 8 ? 8 : size >= 4 ? 4 : size >= 2 ? 2 : 1;
+
+  if (src) {
+    leaRelocatable(f, src, R_R11);
+  } else if (chunk == 16) {
+    emitArithRR(f, OP_PXOR, R_FBLOCK, R_FBLOCK, sizeof(double));
+  } else {
+    emitArithRR(f, OP_XOR, R_TMP, R_TMP, sizeof(int32_t));
+  }
+
+  leaRelocatable(f, dst, R_R10);
+
+  for (int32_t offset = 0; offset < size; offset += chunk) {
+    if (offset + chunk > size) offset = size - chunk;
+    emitBlockChunk(f, src, dst, offset, chunk);
+  }
+}
+
+// clobbers caller-saved registers
+static void emitBlockMove(GeneratedFunction *f, Address *src, Address *dst, int32_t size) {
+  if (size > INLINE_BLOCK_LIMIT) {
+    emitLea(f, src, R_R11);
+    emitLea(f, dst, R_ARG_0);
+    emitMoveRR(f, R_R11, R_ARG_1, sizeof(intptr_t));
+    emitMoveCR(f, size, R_ARG_2, T_U8);
+    emitAlignedSymbolCall(f, f->context->memcpySymbol);
+  } else {
+    emitBlockInline(f, src, dst, size);
+  }
+}
+
+// clobbers caller-saved registers
+static void emitBlockZero(GeneratedFunction *f, Address *dst, int32_t size) {
+  if (size > INLINE_BLOCK_LIMIT) {
+    emitLea(f, dst, R_ARG_0);
+    emitArithRR(f, OP_XOR, R_ARG_1, R_ARG_1, sizeof(intptr_t));
+    emitMoveCR(f, size, R_ARG_2, T_U8);
+    emitAlignedSymbolCall(f, f->context->memsetSymbol);
+  } else {
+    emitBlockInline(f, NULL, dst, size);
+  }
+}
+
+static void copyStructTo(GeneratedFunction *f, TypeRef *type, Address *src, Address *dst) {
+  assert(isCompositeType(type));
+  emitBlockMove(f, src, dst, computeTypeSize(type));
+}
+
+// =========== Block memory operations ===============================//
+
 static void translateAddress(GeneratedFunction *f, AstExpression *expression, Address *addr) {
 
   if (expression->op == E_COMPOUND && isScalarType(expression->type)) {
@@ -1498,11 +1628,35 @@ static Boolean isShiftLikeOp(ExpressionType op) {
   return FALSE;
 }
 
+static void generatePromotedAssign(GeneratedFunction *f, AstExpression *expression, enum Registers reg) {
+  AstExpression *rvalue = expression->binaryExpr.right;
+  TypeRef *lType = expression->binaryExpr.left->type;
+  size_t typeSize = computeTypeSize(lType);
+
+  if (expression->op == EB_ASSIGN) {
+      generateExpression(f, rvalue);
+  } else if (rvalue->op == E_CONST) {
+      emitMoveRR(f, reg, R_ACC, typeSize);
+      emitArithConst(f, selectAssignOpcode(expression->op, lType), R_ACC, rvalue->constExpr.i, typeToId(lType));
+  } else {
+      generateExpression(f, rvalue);
+      // ECX because of shift instructions
+      emitMoveRR(f, R_ACC, R_ECX, sizeof(intptr_t));
+      emitMoveRR(f, reg, R_ACC, typeSize);
+      emitArithRR(f, selectAssignOpcode(expression->op, lType), R_ACC, R_ECX, typeSize);
+  }
+
+  emitMoveRR(f, R_ACC, reg, typeSize);
+}
+
 static void generateAssign(GeneratedFunction *f, AstExpression *expression) {
   AstExpression *lvalue = expression->binaryExpr.left;
   AstExpression *rvalue = expression->binaryExpr.right;
   ExpressionType op = expression->op;
 
+  enum Registers promoted = promotedLoad(lvalue);
+  if (promoted != R_BAD) return generatePromotedAssign(f, expression, promoted);
+
   generateExpression(f, rvalue);
 
   TypeRef *lType = lvalue->type;
@@ -1674,8 +1828,6 @@ static void generateAssignDiv(GeneratedFunction *f, AstExpression *expression) {
 
   generateExpression(f, rvalue);
 
-  emitPushReg(f, R_ACC);
-
   TypeRef *lType = lvalue->type;
   TypeRef *rType = rvalue->type;
   Address addr = { 0 };
@@ -1688,11 +1840,36 @@ static void generateAssignDiv(GeneratedFunction *f, AstExpression *expression) {
   size_t typeSize = computeTypeSize(type);
   Boolean isU = isUnsignedType(type);
 
+  enum Opcodes opcode;
+  enum Registers promoted = promotedLoad(lvalue);
+  if (promoted != R_BAD) {
+      emitMoveRR(f, R_ACC, R_TMP2, typeSize);
+      emitMoveRR(f, promoted, R_ACC, typeSize);
+
+      if (isU) {
+        emitArithRR(f, OP_XOR, R_EDX, R_EDX, typeSize);
+        opcode = OP_UDIV;
+      } else {
+        emitConvertWDQ(f, 0x99, typeSize);
+        opcode = OP_SDIV;
+      }
+
+      emitArithRR(f, opcode, R_ACC, R_TMP2, typeSize);
+
+      if (expression->op == EB_ASG_MOD) {
+          emitMoveRR(f, R_EDX, R_ACC, typeSize);
+      }
+
+      emitMoveRR(f, R_ACC, promoted, typeSize);
+      return;
+  }
+
+  emitPushReg(f, R_ACC);
+
   assert(lvalue->op == EU_DEREF);
   translateAddress(f, lvalue->unaryExpr.argument, &addr);
   leaRelocatable(f, &addr, R_EDI);
 
-  enum Opcodes opcode;
   if (lType->kind == TR_BITFIELD) {
       TypeRef *storageType = lType->bitFieldDesc.storageType;
 
@@ -1775,41 +1952,50 @@ static void generateAllocaImpl(GeneratedFunction *f, AstExpression *size) {
   // R_EAX, R_ECX, R_EDX, R_ESI, R_EDI, R_R8, R_R9, R_R10, R_R11
 
   enum Registers delta = R_EAX;
-  enum Registers r_sab = R_ECX; // R_ECX - Stack Alloca Border
+  enum Registers r_end = R_ECX; // new alloca border, the moved data ends there
   enum Registers to = R_EDX;
   enum Registers from = R_ESI;
+  enum Registers tmp = R_EDI;
 
   Address sabAddress = { R_EBP, R_BAD, 0, f->allocaOffset, NULL, NULL };
-  emitMoveAR(f, &sabAddress, r_sab, dataSize);
+  emitMoveAR(f, &sabAddress, r_end, dataSize);
+  emitArithRR(f, OP_SUB, r_end, delta, dataSize);
 
   emitMoveRR(f, R_ESP, from, dataSize);
   emitMoveRR(f, R_ESP, to, dataSize);
   emitArithRR(f, OP_SUB, to, delta, dataSize);
 
-  struct Label head = { 0 }, tail = { 0 };
-
-  bindLabel(f, &head);
-  // x < y -> cmp, x, y
-  emitArithRR(f, OP_CMP, to, r_sab, dataSize);
-  emitCondJump(f, &tail, JC_NOT_L, TRUE);
+  struct Label head = { 0 }, tail = { 0 }, done = { 0 };
 
   Address fromAddr = { from, R_BAD, 0, 0, NULL, NULL };
   Address toAddr = { to, R_BAD, 0, 0, NULL, NULL };
+  Address nextAddr = { to, R_BAD, 0, 2 * dataSize, NULL, NULL };
 
-  enum Registers tmp = R_EDI;
-  emitMoveAR(f, &fromAddr, tmp, dataSize);
-  emitMoveRA(f, tmp, &toAddr, dataSize);
+  // delta is a multiple of 16 so a 16-byte chunk is always read before it gets overwritten
+  bindLabel(f, &head);
+  emitLea(f, &nextAddr, tmp);
+  emitArithRR(f, OP_CMP, tmp, r_end, dataSize);
+  emitCondJump(f, &tail, JC_G, TRUE);
 
-  emitArithConst(f, OP_ADD, to, dataSize, T_S8);
-  emitArithConst(f, OP_ADD, from, dataSize, T_S8);
+  emitMovupsAR(f, &fromAddr, R_FBLOCK);
+  emitMovupsRA(f, R_FBLOCK, &toAddr);
+
+  emitArithConst(f, OP_ADD, to, 2 * dataSize, T_S8);
+  emitArithConst(f, OP_ADD, from, 2 * dataSize, T_S8);
 
   emitJumpTo(f, &head, TRUE);
 
+  // pushed data is 8-byte granular so at most one word is left
   bindLabel(f, &tail);
+  emitArithRR(f, OP_CMP, to, r_end, dataSize);
+  emitCondJump(f, &done, JC_NOT_L, TRUE);
+  emitMoveAR(f, &fromAddr, tmp, dataSize);
+  emitMoveRA(f, tmp, &toAddr, dataSize);
+
+  bindLabel(f, &done);
 
   emitArithRR(f, OP_SUB, R_ESP, delta, dataSize);
-  emitNegR(f, delta, dataSize);
-  emitArithRR(f, OP_ADD, delta, r_sab, dataSize);
+  emitMoveRR(f, r_end, R_ACC, dataSize);
   emitMoveRA(f, R_ACC, &sabAddress, dataSize);
 }
 
@@ -2280,16 +2466,23 @@ static void generateExpression(GeneratedFunction *f, AstExpression *expression)
       translateAddress(f, expression->unaryExpr.argument, &addr);
       emitLea(f, &addr, R_ACC);
       break;
-    case EU_DEREF:
+    case EU_DEREF: {
+      enum Registers promoted = promotedLoad(expression);
+      if (promoted != R_BAD) {
+        emitMoveRR(f, promoted, R_ACC, typeIdSize(typeId));
+        break;
+      }
       translateAddress(f, expression->unaryExpr.argument, &addr);
       if (isFlatType(expression->type) || expression->type->kind == TR_FUNCTION) {
         if (!(addr.base == R_ACC && addr.index == R_BAD && addr.imm == 0)) {
           emitLea(f, &addr, R_ACC);
         }
       } else {
+        if (expression->type->flags.bits.isVolatile) peepholeBarrier(f); // has to be reread from memory
         emitLoad(f, &addr, R_ACC, typeId);
       }
       break;
+    }
     case EU_PLUS:
       generateExpression(f, expression->unaryExpr.argument);
       break;
@@ -2420,6 +2613,69 @@ static unsigned walkCaseLabels(AstStatement *body, struct CaseLabel *caseLabels,
 
 }
 
+static void emitJumpTable(GeneratedFunction *f, SwitchCase *cases, unsigned count, struct Label *defaultLabel, TypeId tid) {
+  uint64_t span = cases[count - 1].key - cases[0].key;
+  struct Label table = { 0 };
+
+  // index = cond - low, unsigned compare also catches values below low
+  if (cases[0].value) {
+    emitArithConst(f, OP_SUB, R_ACC, cases[0].value, tid);
+  }
+  emitArithConst(f, OP_CMP, R_ACC, span, tid);
+  emitCondJump(f, defaultLabel, JC_A, FALSE);
+
+  // table holds offsets of case labels from the table itself
+  Address tableAddr = { R_RIP, R_BAD, 0, 0, NULL, &table };
+  emitLea(f, &tableAddr, R_TMP);
+
+  Address entry = { R_TMP, R_ACC, 2, 0, NULL, NULL };
+  emitMoveAR(f, &entry, R_ACC, sizeof(int32_t));
+  emitMovsxdRR(f, R_ACC, R_ACC, sizeof(int64_t));
+  emitArithRR(f, OP_ADD, R_ACC, R_TMP, sizeof(intptr_t));
+  emitJumpByReg(f, R_ACC);
+
+  bindLabel(f, &table);
+
+  uint64_t slot;
+  unsigned next = 0;
+  for (slot = 0; slot <= span; ++slot) {
+      struct Label *target = defaultLabel;
+      if (next < count && cases[next].key - cases[0].key == slot) {
+        target = cases[next++].label;
+      }
+      emitJumpTableEntry(f, target, table.label_cp);
+  }
+}
+
+static void emitSwitchDispatch(GeneratedFunction *f, SwitchCase *cases, unsigned count, struct Label *defaultLabel, TypeId tid) {
+  unsigned i;
+
+  switch (selectSwitchStrategy(cases, count)) {
+  case SS_LINEAR:
+      for (i = 0; i < count; ++i) {
+          emitArithConst(f, OP_CMP, R_ACC, cases[i].value, tid);
+          emitCondJump(f, cases[i].label, JC_EQ, FALSE);
+      }
+      emitJumpTo(f, defaultLabel, FALSE);
+      break;
+  case SS_TABLE:
+      emitJumpTable(f, cases, count, defaultLabel, tid);
+      break;
+  case SS_SPLIT: {
+      struct Label upper = { 0 };
+      unsigned split = splitSwitchCases(cases, count);
+      Boolean isU = tid == T_U4 || tid == T_U8;
+
+      emitArithConst(f, OP_CMP, R_ACC, cases[split].value, tid);
+      emitCondJump(f, &upper, isU ? JC_A_E : JC_GE, FALSE);
+      emitSwitchDispatch(f, cases, split, defaultLabel, tid);
+      bindLabel(f, &upper);
+      emitSwitchDispatch(f, cases + split, count - split, defaultLabel, tid);
+      break;
+  }
+  }
+}
+
 static void generateSwitchStatement(GeneratedFunction *f, AstSwitchStatement *stmt) {
   GenerationContext *ctx = f->context;
   struct Label *oldBreak = ctx->breakLabel;
@@ -2446,22 +2702,14 @@ static void generateSwitchStatement(GeneratedFunction *f, AstSwitchStatement *st
   assert(condition->type->kind == TR_VALUE);
   generateExpression(f, condition);
 
-  size_t condTypeSize = computeTypeSize(condition->type);
+  // condition is already extended to at least int in the accumulator
+  TypeId tid = typeToId(condition->type);
+  if (typeIdSize(tid) < sizeof(int32_t)) tid = T_S4;
 
-  int i;
-
-  for (i = 0; i < visited; ++i) {
-      int64_t caseConst = caseLabels[i].caseConst;
-      struct Label *caseLabel = &caseLabels[i].label;
-      emitArithConst(f, OP_CMP, R_ACC, caseConst, typeToId(condition->type));
-      emitCondJump(f, caseLabel, JC_EQ, FALSE);
-  }
+  SwitchCase *cases = alloca(sizeof(SwitchCase) * visited);
+  sortSwitchCases(cases, caseLabels, visited, tid);
 
-  if (stmt->hasDefault) {
-      emitJumpTo(f, &defaultLabel, FALSE);
-  } else {
-      emitJumpTo(f, &switchBreak, FALSE);
-  }
+  emitSwitchDispatch(f, cases, visited, stmt->hasDefault ? &defaultLabel : &switchBreak, tid);
 
   generateStatement(f, stmt->body);
 
@@ -2579,9 +2827,19 @@ static enum JumpCondition generateUnsignedCondition(GeneratedFunction *f, AstExp
 
   generateExpression(f, left);
 
+  enum Registers rightReg = promotedLoad(right);
+
   if (right->op == E_CONST && !swap) {
     uint64_t cnst = right->constExpr.i;
     emitArithConst(f, OP_CMP, R_ACC, cnst, lid);
+  } else if (rightReg != R_BAD && lid == rid) {
+    enum Registers l = swap ? rightReg : R_ACC;
+    enum Registers r = swap ? R_ACC : rightReg;
+    emitArithRR(f, OP_CMP, l, r, opSize);
+  } else if (isNamedLoad(right) && lid == rid && !swap) {
+    Address addr = { 0 };
+    translateAddress(f, right->unaryExpr.argument, &addr);
+    emitArithAR(f, OP_CMP, R_ACC, &addr, opSize);
   } else {
     emitPushReg(f, R_ACC);
 
@@ -2621,9 +2879,17 @@ static enum JumpCondition generateSignedCondition(GeneratedFunction *f, AstExpre
 
   generateExpression(f, left);
 
+  enum Registers rightReg = promotedLoad(right);
+
   if (right->op == E_CONST) {
     uint64_t cnst = right->constExpr.i;
     emitArithConst(f, OP_CMP, R_ACC, cnst, lid);
+  } else if (rightReg != R_BAD && lid == rid) {
+    emitArithRR(f, OP_CMP, R_ACC, rightReg, opSize);
+  } else if (isNamedLoad(right) && lid == rid) {
+    Address addr = { 0 };
+    translateAddress(f, right->unaryExpr.argument, &addr);
+    emitArithAR(f, OP_CMP, R_ACC, &addr, opSize);
   } else {
     emitPushReg(f, R_ACC);
 
@@ -2810,7 +3076,12 @@ static Boolean generateStatement(GeneratedFunction *f, AstStatement *stmt) {
             if (v->type->kind == TR_VLA) {
                 allocateVLAMemory(f, v->gen, v->initializer, v->type);
             } else {
-              if (v->initializer) {
+              if (v->gen->isPromoted) {
+                  if (v->initializer) {
+                    generateExpression(f, v->initializer->expression);
+                    emitMoveRR(f, R_ACC, (enum Registers)v->gen->reg, typeSize);
+                  }
+              } else if (v->initializer) {
                   emitLocalInitializer(f, v->type, v->gen->baseOffset, v->initializer);
               }
             }
@@ -2863,7 +3134,7 @@ static Boolean generateStatement(GeneratedFunction *f, AstStatement *stmt) {
 
               Address dst = { R_EDI, R_BAD, 0, 0, NULL, NULL };
               copyStructTo(f, retExpr->type, &src, &dst);
-              emitMoveRR(f, R_EDI, R_ACC, sizeof(intptr_t));
+              emitMoveAR(f, &addr, R_ACC, sizeof(intptr_t));
             } else {
               emitMoveAR(f, &src, R_ACC, retSize);
             }
@@ -2871,6 +3142,7 @@ static Boolean generateStatement(GeneratedFunction *f, AstStatement *stmt) {
             generateExpression(f, retExpr);
           }
       }
+      restoreCalleeSaved(f);
       emitLeave(f);
       emitRet(f, 0);
       return TRUE;
@@ -2931,6 +3203,220 @@ static void popFrame(GeneratedFunction *f) {
   emitLeave(f);
 }
 
+// =========== Register promotion ===============================//
+
+static void collectExpressionUses(AstExpression *expr, unsigned depth);
+static void collectStatementUses(AstStatement *stmt, unsigned depth);
+
+static GeneratedVariable *localOf(AstExpression *nameRef) {
+  Symbol *s = nameRef->nameRefExpr.s;
+  if (s->kind != ValueSymbol || !s->variableDesc->flags.bits.isLocal) return NULL;
+  return s->variableDesc->gen;
+}
+
+static void collectInitializerUses(AstInitializer *init, unsigned depth) {
+  if (init->kind == IK_EXPRESSION) {
+      collectExpressionUses(init->expression, depth);
+  } else {
+      AstInitializerList *list = init->initializerList;
+      for (; list; list = list->next) {
+          collectInitializerUses(list->initializer, depth);
+      }
+  }
+}
+
+static void collectExpressionUses(AstExpression *expr, unsigned depth) {
+  if (expr == NULL) return;
+
+  switch (expr->op) {
+  case E_CONST:
+  case E_LABEL_REF:
+  case E_ERROR:
+      return;
+  case E_NAMEREF: {
+      // address of the variable is used directly
+      GeneratedVariable *gv = localOf(expr);
+      if (gv) gv->isEscaped = 1;
+      return;
+  }
+  case EU_DEREF: {
+      AstExpression *arg = expr->unaryExpr.argument;
+      GeneratedVariable *gv = arg->op == E_NAMEREF ? localOf(arg) : NULL;
+      if (gv) {
+          if (typeToId(expr->type) == typeToId(arg->nameRefExpr.s->variableDesc->type)) {
+            // each loop level counts as four accesses
+            unsigned shift = min(2 * depth, 8);
+            gv->useWeight += 1 << shift;
+          } else {
+            gv->isEscaped = 1;
+          }
+      } else {
+          collectExpressionUses(arg, depth);
+      }
+      return;
+  }
+  case E_PAREN:
+      return collectExpressionUses(expr->parened, depth);
+  case E_BLOCK:
+      return collectStatementUses(expr->block, depth);
+  case E_COMPOUND:
+      return collectInitializerUses(expr->compound, depth);
+  case E_CALL: {
+      AstExpressionList *args = expr->callExpr.arguments;
+      collectExpressionUses(expr->callExpr.callee, depth);
+      for (; args; args = args->next) {
+          collectExpressionUses(args->expression, depth);
+      }
+      return;
+  }
+  case E_TERNARY:
+      collectExpressionUses(expr->ternaryExpr.condition, depth);
+      collectExpressionUses(expr->ternaryExpr.ifTrue, depth);
+      return collectExpressionUses(expr->ternaryExpr.ifFalse, depth);
+  case E_CAST:
+      return collectExpressionUses(expr->castExpr.argument, depth);
+  case E_BIT_EXTEND:
+      return collectExpressionUses(expr->extendExpr.argument, depth);
+  case E_VA_ARG:
+      return collectExpressionUses(expr->vaArg.va_list, depth);
+  case EF_DOT:
+  case EF_ARROW:
+      return collectExpressionUses(expr->fieldExpr.recevier, depth);
+  default:
+      if (isBinary(expr->op) || isAssignmentOp(expr->op) || expr->op == EB_COMMA || expr->op == EB_A_ACC) {
+          collectExpressionUses(expr->binaryExpr.left, depth);
+          collectExpressionUses(expr->binaryExpr.right, depth);
+      } else {
+          collectExpressionUses(expr->unaryExpr.argument, depth);
+      }
+      return;
+  }
+}
+
+static void collectStatementUses(AstStatement *stmt, unsigned depth) {
+  if (stmt == NULL) return;
+
+  switch (stmt->statementKind) {
+  case SK_BLOCK: {
+      AstStatementList *list = stmt->block.stmts;
+      for (; list; list = list->next) {
+          collectStatementUses(list->stmt, depth);
+      }
+      return;
+  }
+  case SK_EXPR_STMT:
+      return collectExpressionUses(stmt->exprStmt.expression, depth);
+  case SK_LABEL:
+      return collectStatementUses(stmt->labelStmt.body, depth);
+  case SK_DECLARATION: {
+      AstDeclaration *d = stmt->declStmt.declaration;
+      if (d->kind != DK_VAR) return;
+      AstValueDeclaration *v = d->variableDeclaration;
+      AstInitializer *init = v->initializer;
+      if (!v->flags.bits.isLocal || init == NULL) return;
+      if (v->gen && (init->kind != IK_EXPRESSION || init->expression->op == E_COMPOUND)) {
+          // initialized in place
+          v->gen->isEscaped = 1;
+      }
+      return collectInitializerUses(init, depth);
+  }
+  case SK_IF:
+      collectExpressionUses(stmt->ifStmt.condition, depth);
+      collectStatementUses(stmt->ifStmt.thenBranch, depth);
+      return collectStatementUses(stmt->ifStmt.elseBranch, depth);
+  case SK_SWITCH:
+      collectExpressionUses(stmt->switchStmt.condition, depth);
+      return collectStatementUses(stmt->switchStmt.body, depth);
+  case SK_WHILE:
+  case SK_DO_WHILE:
+      collectExpressionUses(stmt->loopStmt.condition, depth + 1);
+      return collectStatementUses(stmt->loopStmt.body, depth + 1);
+  case SK_FOR: {
+      AstStatementList *list = stmt->forStmt.initial;
+      for (; list; list = list->next) {
+          collectStatementUses(list->stmt, depth);
+      }
+      collectExpressionUses(stmt->forStmt.condition, depth + 1);
+      collectExpressionUses(stmt->forStmt.modifier, depth + 1);
+      return collectStatementUses(stmt->forStmt.body, depth + 1);
+  }
+  case SK_GOTO_P:
+  case SK_RETURN:
+      return collectExpressionUses(stmt->jumpStmt.expression, depth);
+  default:
+      return;
+  }
+}
+
+static Boolean isPromotable(AstValueDeclaration *v) {
+  TypeRef *type = v->type;
+  if (v->gen->isEscaped || v->gen->useWeight <= 2) return FALSE;
+  if (type->kind != TR_VALUE && type->kind != TR_POINTED) return FALSE;
+  if (type->flags.bits.isVolatile || v->flags.bits.isVolatile) return FALSE;
+
+  switch (typeToId(type)) {
+  case T_S4:
+  case T_U4:
+  case T_S8:
+  case T_U8:
+      return TRUE;
+  default:
+      return FALSE;
+  }
+}
+
+static void pickPromoted(GeneratedVariable **picked, unsigned *count, GeneratedVariable *gv) {
+  unsigned i = *count;
+
+  if (i == R_CALLEE_SAVED_COUNT) {
+      if (picked[i - 1]->useWeight >= gv->useWeight) return;
+      --i;
+  } else {
+      ++*count;
+  }
+
+  // keep candidates sorted by weight
+  while (i > 0 && picked[i - 1]->useWeight < gv->useWeight) {
+      picked[i] = picked[i - 1];
+      --i;
+  }
+  picked[i] = gv;
+}
+
+// Keeps the most used scalar locals which address is never taken in callee-saved registers
+static void promoteLocals(GeneratedFunction *g, AstFunctionDefinition *f) {
+  GeneratedVariable *picked[R_CALLEE_SAVED_COUNT];
+  unsigned count = 0, i;
+  AstValueDeclaration *v;
+
+  for (v = f->declaration->parameters; v; v = v->next) {
+      allocateGenVarialbe(g->context, v);
+  }
+
+  for (v = f->locals; v; v = v->next) {
+      allocateGenVarialbe(g->context, v);
+  }
+
+  collectStatementUses(f->body, 0);
+
+  for (v = f->declaration->parameters; v; v = v->next) {
+      if (isPromotable(v)) pickPromoted(picked, &count, v->gen);
+  }
+
+  for (v = f->locals; v; v = v->next) {
+      if (isPromotable(v)) pickPromoted(picked, &count, v->gen);
+  }
+
+  for (i = 0; i < count; ++i) {
+      picked[i]->isPromoted = 1;
+      picked[i]->reg = calleeSavedRegs[i];
+  }
+
+  g->savedRegCount = count;
+}
+
+// =========== Register promotion ===============================//
+
 static size_t allocateLocalSlots(GeneratedFunction *g, AstFunctionDefinition *f) {
   AstValueDeclaration *param = f->declaration->parameters;
   AstValueDeclaration *local = f->locals;
@@ -2939,7 +3425,7 @@ static size_t allocateLocalSlots(GeneratedFunction *g, AstFunctionDefinition *f)
   unsigned intRegParams = 0;
   unsigned fpRegParams = 0;
 
-  int32_t baseOffset = 0; // from rbp;
+  int32_t baseOffset = g->savedRegCount * sizeof(intptr_t); // from rbp;
   int32_t stackParamOffset = sizeof(intptr_t) + sizeof(intptr_t); // rbp itself + return pc
 
   int32_t structBufferOffset = 0;
@@ -2961,7 +3447,7 @@ static size_t allocateLocalSlots(GeneratedFunction *g, AstFunctionDefinition *f)
 
   for (; param; param = param->next) {
     TypeRef *paramType = param->type;
-    GeneratedVariable *gp = allocateGenVarialbe(g->context, param);
+    GeneratedVariable *gp = param->gen;
     size_t size = max(computeTypeSize(paramType), sizeof(intptr_t));
     size_t align = max(typeAlignment(paramType), sizeof(intptr_t));
 
@@ -2980,6 +3466,15 @@ static size_t allocateLocalSlots(GeneratedFunction *g, AstFunctionDefinition *f)
             gp->baseOffset = alignedOffset;
             stackParamOffset = alignedOffset + size;
         }
+    } else if (gp->isPromoted) {
+        if (intRegParams < R_PARAM_COUNT) {
+            emitMoveRR(g, intArgumentRegs[intRegParams++], (enum Registers)gp->reg, computeTypeSize(paramType));
+        } else {
+            int32_t alignedOffset = ALIGN_SIZE(stackParamOffset, align);
+            addr.imm = alignedOffset;
+            emitMoveAR(g, &addr, (enum Registers)gp->reg, computeTypeSize(paramType));
+            stackParamOffset = alignedOffset + size;
+        }
     } else {
         if (intRegParams < R_PARAM_COUNT) {
             baseOffset += size;
@@ -2996,7 +3491,9 @@ static size_t allocateLocalSlots(GeneratedFunction *g, AstFunctionDefinition *f)
 
   for (; local; local = local->next) {
       TypeRef *localType = local->type;
-      GeneratedVariable *gp = allocateGenVarialbe(g->context, local);
+      GeneratedVariable *gp = local->gen;
+      if (gp->isPromoted) continue;
+
       size_t size = computeTypeSize(localType);
       size_t align = typeAlignment(localType);
 
@@ -3097,7 +3594,7 @@ static size_t allocateLocalSlots(GeneratedFunction *g, AstFunctionDefinition *f)
 }
 
 static GeneratedFunction *generateFunction_x86_64(GenerationContext *ctx, AstFunctionDefinition *f) {
-  HashMap *labelMap = createHashMap(DEFAULT_MAP_CAPACITY, &stringHashCode, &stringCmp);
+  HashMap *labelMap = createHashMap(DEFAULT_MAP_CAPACITY, &atomHashCode, &atomCmp);
   ctx->labelMap = labelMap;
 
   assert(f->body->statementKind == SK_BLOCK);
@@ -3107,8 +3604,13 @@ static GeneratedFunction *generateFunction_x86_64(GenerationContext *ctx, AstFun
   gen->symbol = f->declaration->symbol;
   gen->name = f->declaration->name;
 
+  Relocation *relocMark = gen->section->reloc;
+
   pushFrame(gen);
 
+  promoteLocals(gen, f);
+  saveCalleeSaved(gen);
+
   size_t frameSize = allocateLocalSlots(gen, f);
 
   size_t delta = frameSize;
@@ -3131,10 +3633,13 @@ static GeneratedFunction *generateFunction_x86_64(GenerationContext *ctx, AstFun
         emitMoveAR(gen, &addr, R_EAX, sizeof(intptr_t));
     }
 
+    restoreCalleeSaved(gen);
     popFrame(gen);
     emitReturn(gen);
   }
 
+  relaxJumps(gen, relocMark);
+
   gen->bodySize = (gen->section->pc - gen->section->start) - gen->sectionOffset;
 
   ctx->labelMap = NULL;
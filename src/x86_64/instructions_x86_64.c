@@ -101,23 +101,160 @@ static void emitRex(GeneratedFunction *f, enum Registers rReg, enum Registers bR
 
 }
 
+// =========== Peephole ===============================//
+
+static ptrdiff_t currentOffset(GeneratedFunction *f) {
+  return f->section->pc - f->section->start;
+}
+
+// instruction `depth` steps back from pc, NULL if something untracked was emitted in between
+static struct PeepholeInstr *previousInstr(GeneratedFunction *f, unsigned depth) {
+  ptrdiff_t end_cp = currentOffset(f);
+
+  for (unsigned i = 0; i <= depth; ++i) {
+    struct PeepholeInstr *instr = &f->peephole[i];
+    if (instr->kind == PH_NONE || instr->end_cp != end_cp) return NULL;
+    end_cp = instr->start_cp;
+  }
+
+  return &f->peephole[depth];
+}
+
+static void dropLastInstr(GeneratedFunction *f) {
+  f->section->pc = f->section->start + f->peephole[0].start_cp;
+  f->peephole[0] = f->peephole[1];
+  f->peephole[1].kind = PH_NONE;
+}
+
+static void rememberInstr(GeneratedFunction *f, struct PeepholeInstr *instr, ptrdiff_t start_cp) {
+  instr->start_cp = start_cp;
+  instr->end_cp = currentOffset(f);
+  f->peephole[1] = f->peephole[0];
+  f->peephole[0] = *instr;
+}
+
+static Boolean isFrameSlot(const Address *addr) {
+  return addr->base == R_EBP && addr->index == R_BAD && addr->reloc == NULL && addr->label == NULL;
+}
+
+void peepholeBarrier(GeneratedFunction *f) {
+  f->peephole[0].kind = PH_NONE;
+  f->peephole[1].kind = PH_NONE;
+}
+
+// push r; pop q  ->  mov q, r
+static Boolean foldPushPop(GeneratedFunction *f, const struct PeepholeInstr *pop) {
+  enum Registers from = previousInstr(f, 0)->src;
+  dropLastInstr(f);
+  if (from != pop->dst) {
+    emitMoveRR(f, from, pop->dst, sizeof(intptr_t));
+  }
+  return TRUE;
+}
+
+// mov [rbp + d], r; mov q, [rbp + d]  ->  mov q, r
+static Boolean foldStoreLoad(GeneratedFunction *f, const struct PeepholeInstr *load) {
+  struct PeepholeInstr *store = previousInstr(f, 0);
+  if (store->imm != load->imm || store->size != load->size) return FALSE;
+  // 32-bit load zero-extends the register so keep that effect
+  if (store->src != load->dst || load->size == sizeof(int32_t)) {
+    emitMoveRR(f, store->src, load->dst, load->size);
+  }
+  return TRUE;
+}
+
+// mov b, a; mov a, b  ->  mov b, a
+static Boolean foldMoveBack(GeneratedFunction *f, const struct PeepholeInstr *move) {
+  struct PeepholeInstr *prev = previousInstr(f, 0);
+  return prev->size == sizeof(intptr_t) && move->size == sizeof(intptr_t) && prev->src == move->dst && prev->dst == move->src;
+}
+
+// and/or/xor have already set the flags exactly as test r, r would
+static Boolean foldLogicTest(GeneratedFunction *f, const struct PeepholeInstr *test) {
+  struct PeepholeInstr *logic = previousInstr(f, 0);
+  return test->src == test->dst && logic->dst == test->src && logic->size == test->size;
+}
+
+// mov a, [rbp + d]; mov b, a; pop a  ->  mov b, [rbp + d]; pop a
+static Boolean foldLoadMovePop(GeneratedFunction *f, const struct PeepholeInstr *pop) {
+  struct PeepholeInstr *move = previousInstr(f, 0);
+  struct PeepholeInstr *load = previousInstr(f, 1);
+  if (load == NULL || load->kind != PH_LOAD) return FALSE;
+  if (load->dst != move->src || move->src != pop->dst || load->size != move->size) return FALSE;
+
+  Address addr = { R_EBP, R_BAD, 0, load->imm, NULL, NULL };
+  enum Registers to = move->dst;
+  size_t size = load->size;
+
+  dropLastInstr(f);
+  dropLastInstr(f);
+  emitMoveAR(f, &addr, to, size);
+
+  return FALSE; // pop is still needed
+}
+
+static const struct {
+  enum PeepholeKind prev;
+  enum PeepholeKind cur;
+  Boolean (*apply)(GeneratedFunction *f, const struct PeepholeInstr *cur);
+} peepholeRules[] = {
+  { PH_PUSH, PH_POP, &foldPushPop },
+  { PH_STORE, PH_LOAD, &foldStoreLoad },
+  { PH_MOVE_RR, PH_MOVE_RR, &foldMoveBack },
+  { PH_LOGIC, PH_TEST, &foldLogicTest },
+  { PH_MOVE_RR, PH_POP, &foldLoadMovePop }
+};
+
+// returns TRUE if `cur` is folded into the preceding code and must not be emitted
+static Boolean applyPeephole(GeneratedFunction *f, const struct PeepholeInstr *cur) {
+  unsigned count = sizeof(peepholeRules) / sizeof(peepholeRules[0]);
+
+  for (unsigned i = 0; i < count; ++i) {
+    struct PeepholeInstr *prev = previousInstr(f, 0);
+    if (prev == NULL) return FALSE;
+
+    if (prev->kind == peepholeRules[i].prev && cur->kind == peepholeRules[i].cur) {
+      if (peepholeRules[i].apply(f, cur)) return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+// =========== Peephole ===============================//
+
 void emitPushReg(GeneratedFunction *f, enum Registers reg) {
 
   f->stackOffset += sizeof(intptr_t);
 
+  struct PeepholeInstr instr = { PH_PUSH, 0, 0, reg, R_BAD, 0, sizeof(intptr_t) };
+  ptrdiff_t start_cp = currentOffset(f);
+
   emitRex(f, R_BAD, reg, R_BAD, FALSE);
   emitByte(f, 0x50 + register_encodings[reg]);
+
+  rememberInstr(f, &instr, start_cp);
 }
 
 void emitPopReg(GeneratedFunction *f, enum Registers reg) {
   f->stackOffset -= sizeof(intptr_t);
 
+  struct PeepholeInstr instr = { PH_POP, 0, 0, R_BAD, reg, 0, sizeof(intptr_t) };
+  if (applyPeephole(f, &instr)) return;
+  ptrdiff_t start_cp = currentOffset(f);
+
   emitRex(f, R_BAD, reg, R_BAD, FALSE);
   emitByte(f, 0x58 + register_encodings[reg]);
+
+  rememberInstr(f, &instr, start_cp);
 }
 
 void emitMoveRR(GeneratedFunction *f, enum Registers from, enum Registers to, size_t size) {
 
+  struct PeepholeInstr instr = { PH_MOVE_RR, 0, 0, from, to, 0, size };
+  if (applyPeephole(f, &instr)) return;
+  ptrdiff_t start_cp = currentOffset(f);
+
   if (size == 2) emitByte(f, 0x66);
 
   emitRex(f, from, to, R_BAD, size == 8);
@@ -131,8 +268,49 @@ void emitMoveRR(GeneratedFunction *f, enum Registers from, enum Registers to, si
   modrm.bits.rm = register_encodings[to];
 
   emitByte(f, modrm.v);
+
+  rememberInstr(f, &instr, start_cp);
+}
+
+
+// every jump and label reference is kept on the function so relaxJumps can move code around
+static struct LabelJump *recordJump(GeneratedFunction *f, struct Label *l, ptrdiff_t instruction_cp, size_t instSize) {
+  struct LabelJump *lj = areanAllocate(f->arena, sizeof (struct LabelJump));
+  lj->instruction_cp = instruction_cp;
+  lj->instSize = instSize;
+  lj->target_cp = -1;
+  lj->next = NULL;
+  lj->nextInFunction = f->jumps;
+  f->jumps = lj;
+
+  if (l->binded) {
+    lj->target_cp = l->label_cp;
+  } else {
+    lj->next = l->jumps;
+    l->jumps = lj;
+  }
+
+  return lj;
 }
 
+static struct LabelRef *recordLabelRef(GeneratedFunction *f, struct Label *l, ptrdiff_t offset_cp, ptrdiff_t origin_cp) {
+  struct LabelRef *lr = areanAllocate(f->arena, sizeof (struct LabelRef));
+  lr->offset_cp = offset_cp;
+  lr->origin_cp = origin_cp;
+  lr->target_cp = -1;
+  lr->next = NULL;
+  lr->nextInFunction = f->labelRefs;
+  f->labelRefs = lr;
+
+  if (l->binded) {
+    lr->target_cp = l->label_cp;
+  } else {
+    lr->next = l->refs;
+    l->refs = lr;
+  }
+
+  return lr;
+}
 
 static void encodeAR(GeneratedFunction *f, Address *from, uint8_t regOp) {
   ModRM modrm = { 0 };
@@ -165,6 +343,8 @@ static void encodeAR(GeneratedFunction *f, Address *from, uint8_t regOp) {
 
       ptrdiff_t literalOffset = f->section->pc - f->section->start;
 
+      recordLabelRef(f, l, literalOffset, literalOffset + sizeof(int32_t));
+
       if (l->binded) {
         ptrdiff_t fromOffset = literalOffset + sizeof(int32_t);
         ptrdiff_t toOffset = l->label_cp;
@@ -176,16 +356,10 @@ static void encodeAR(GeneratedFunction *f, Address *from, uint8_t regOp) {
         emitByte(f, (uint8_t) (delta >> 16));
         emitByte(f, (uint8_t) (delta >> 24));
       } else {
-        struct LabelRef *lr = areanAllocate(f->arena, sizeof (struct LabelRef));
-
         emitByte(f, 0xFF);
         emitByte(f, 0xBE);
         emitByte(f, 0xAD);
         emitByte(f, 0x7E);
-
-        lr->offset_cp = literalOffset;
-        lr->next = l->refs;
-        l->refs = lr;
       }
     }
 
@@ -274,6 +448,11 @@ void emitLea(GeneratedFunction *f, Address *from, enum Registers to) {
 
 void emitMoveAR(GeneratedFunction *f, Address* addr, enum Registers to, size_t size) {
 
+  Boolean tracked = isFrameSlot(addr) && size >= sizeof(int32_t);
+  struct PeepholeInstr instr = { PH_LOAD, 0, 0, R_BAD, to, addr->imm, size };
+  if (tracked && applyPeephole(f, &instr)) return;
+  ptrdiff_t start_cp = currentOffset(f);
+
   if (size == 2) emitByte(f, 0x66);
 
   emitRex(f, to, addr->base, addr->index, size > 4);
@@ -282,9 +461,15 @@ void emitMoveAR(GeneratedFunction *f, Address* addr, enum Registers to, size_t s
   emitByte(f, code);
 
   encodeAR(f, addr, register_encodings[to]);
+
+  if (tracked) rememberInstr(f, &instr, start_cp);
 }
 
 void emitMoveRA(GeneratedFunction *f, enum Registers from, Address* addr, size_t size) {
+  Boolean tracked = isFrameSlot(addr) && size >= sizeof(int32_t);
+  struct PeepholeInstr instr = { PH_STORE, 0, 0, from, R_BAD, addr->imm, size };
+  ptrdiff_t start_cp = currentOffset(f);
+
   if (size == 2) emitByte(f, 0x66);
 
   emitRex(f, from, addr->base, addr->index, size > 4);
@@ -293,6 +478,8 @@ void emitMoveRA(GeneratedFunction *f, enum Registers from, Address* addr, size_t
   emitByte(f, code);
 
   encodeAR(f, addr, register_encodings[from]);
+
+  if (tracked) rememberInstr(f, &instr, start_cp);
 }
 
 void emitMoveCR_Reloc(GeneratedFunction *f, Relocation *reloc, enum Registers reg) {
@@ -307,7 +494,8 @@ void emitMoveCR(GeneratedFunction *f, intptr_t c, enum Registers to, int _tid) {
 
   emitRex(f, R_BAD, to, R_BAD, size > 4);
 
-  if (_tid == T_S8 && c == (int64_t)(c & 0xFFFFFFFFUL)) {
+  if (_tid == T_S8 && c == (int64_t)(int32_t)c) {
+      // mov r64, imm32 sign-extends the immediate
       emitByte(f, 0xC7);
       ModRM modrm = { 0 };
       modrm.bits.mod = 0b11;
@@ -415,6 +603,20 @@ void emitSimpleArithRR(GeneratedFunction *f, uint8_t code, enum Registers l, enu
   emitByte(f, modrm.v);
 }
 
+static void emitLogicRR(GeneratedFunction *f, uint8_t code, enum Registers l, enum Registers r, size_t size) {
+  struct PeepholeInstr instr = { PH_LOGIC, 0, 0, r, l, 0, size };
+  ptrdiff_t start_cp = currentOffset(f);
+  emitSimpleArithRR(f, code, l, r, size);
+  rememberInstr(f, &instr, start_cp);
+}
+
+static void emitLogicRC(GeneratedFunction *f, uint8_t digit, enum Registers r, int64_t c, size_t size) {
+  struct PeepholeInstr instr = { PH_LOGIC, 0, 0, R_BAD, r, 0, size };
+  ptrdiff_t start_cp = currentOffset(f);
+  emitSimpleArithRC(f, 0x81, 0x83, digit, r, c, size);
+  rememberInstr(f, &instr, start_cp);
+}
+
 void emitSimpleArithR(GeneratedFunction *f, uint8_t code, uint8_t digit, enum Registers r, size_t size) {
   if (size == 2) emitByte(f, 0x66);
   emitRex(f, R_BAD, r, R_BAD, size == 8);
@@ -565,13 +767,20 @@ static void emitSimpleFPArithAR(GeneratedFunction *f, int16_t prefix, uint8_t op
   encodeAR(f, addr, register_encodings[r]);
 }
 
+static void emitLogicAR(GeneratedFunction *f, uint8_t code, enum Registers r, Address *addr, size_t size) {
+  struct PeepholeInstr instr = { PH_LOGIC, 0, 0, R_BAD, r, 0, size };
+  ptrdiff_t start_cp = currentOffset(f);
+  emitSimpleArithAR(f, code, -1, r, addr, size);
+  rememberInstr(f, &instr, start_cp);
+}
+
 void emitArithAR(GeneratedFunction *f, enum Opcodes opcode, enum Registers r, Address *addr, size_t size) {
   switch (opcode) {
     case OP_ADD: return emitSimpleArithAR(f, 0x03, -1, r, addr, size);
     case OP_SUB: return emitSimpleArithAR(f, 0x2B, -1, r, addr, size);
-    case OP_AND: return emitSimpleArithAR(f, 0x23, -1, r, addr, size);
-    case OP_OR:  return emitSimpleArithAR(f, 0x0B, -1, r, addr, size);
-    case OP_XOR: return emitSimpleArithAR(f, 0x33, -1, r, addr, size);
+    case OP_AND: return emitLogicAR(f, 0x23, r, addr, size);
+    case OP_OR:  return emitLogicAR(f, 0x0B, r, addr, size);
+    case OP_XOR: return emitLogicAR(f, 0x33, r, addr, size);
     case OP_CMP:  return emitSimpleArithAR(f, 0x3B, -1, r, addr, size);
     case OP_SMUL: return emitSimpleArithAR(f, 0x0F, 0xAF, r, addr, size);
     case OP_UMUL: assert(r == R_EAX); return emitSimpleArithA(f, 0xF7, 4, addr, size);
@@ -601,9 +810,9 @@ void emitArithRR(GeneratedFunction *f, enum Opcodes opcode, enum Registers l, en
   switch (opcode) {
   case OP_ADD: return emitSimpleArithRR(f, 0x01, l, r, size);
   case OP_SUB: return emitSimpleArithRR(f, 0x29, l, r, size);
-  case OP_AND: return emitSimpleArithRR(f, 0x21, l, r, size);
-  case OP_OR:  return emitSimpleArithRR(f, 0x09, l, r, size);
-  case OP_XOR: return emitSimpleArithRR(f, 0x31, l, r, size);
+  case OP_AND: return emitLogicRR(f, 0x21, l, r, size);
+  case OP_OR:  return emitLogicRR(f, 0x09, l, r, size);
+  case OP_XOR: return emitLogicRR(f, 0x31, l, r, size);
   case OP_CMP: return emitSimpleArithRR(f, 0x39, l, r, size);
 
   case OP_SMUL: return emitSMulR(f, l, r, size);
@@ -633,16 +842,16 @@ void emitArithConst(GeneratedFunction *f, enum Opcodes opcode, enum Registers r,
 
   size_t size = typeIdSize(_tid);
 
-  if (_tid == T_U8 && (int64_t)(int32_t)c != c) {
+  if ((_tid == T_U8 || _tid == T_S8) && (int64_t)(int32_t)c != c) {
     emitMoveCR(f, c, R_R8, _tid);
     emitArithRR(f, opcode, r, R_R8, size);
   } else {
       switch (opcode) {
       case OP_ADD: return emitSimpleArithRC(f, 0x81, 0x83, 0, r, c, size);
       case OP_SUB: return emitSimpleArithRC(f, 0x81, 0x83, 5, r, c, size);
-      case OP_AND: return emitSimpleArithRC(f, 0x81, 0x83, 4, r, c, size);
-      case OP_OR:  return emitSimpleArithRC(f, 0x81, 0x83, 1, r, c, size);
-      case OP_XOR: return emitSimpleArithRC(f, 0x81, 0x83, 6, r, c, size);
+      case OP_AND: return emitLogicRC(f, 4, r, c, size);
+      case OP_OR:  return emitLogicRC(f, 1, r, c, size);
+      case OP_XOR: return emitLogicRC(f, 6, r, c, size);
       case OP_SHR: return emitShiftRC(f, 0xC1, 5, r, c, size);
       case OP_SAR: return emitShiftRC(f, 0xC1, 7, r, c, size);
       case OP_SHL: return emitShiftRC(f, 0xC1, 4, r, c, size);
@@ -762,6 +971,10 @@ static void emitShift(GeneratedFunction *f, uint8_t op1, uint8_t opImm, uint8_t
 
 void emitTestRR(GeneratedFunction *f, enum Registers l, enum Registers r, size_t s) {
 
+  struct PeepholeInstr instr = { PH_TEST, 0, 0, r, l, 0, s };
+  if (applyPeephole(f, &instr)) return;
+  ptrdiff_t start_cp = currentOffset(f);
+
   if (s == 2) emitByte(f, 0x66);
 
   emitRex(f, r, l, R_BAD, s > sizeof(int32_t));
@@ -775,6 +988,8 @@ void emitTestRR(GeneratedFunction *f, enum Registers l, enum Registers r, size_t
   rm.bits.regOp = register_encodings[r];
 
   emitByte(f, rm.v);
+
+  rememberInstr(f, &instr, start_cp);
 }
 
 void emitSar(GeneratedFunction *f, enum Registers r, int s) {
@@ -805,6 +1020,22 @@ void emitMovfpRA(GeneratedFunction *f, enum Registers from, Address *to, size_t
   emitSimpleFPArightRA(f, size == 8 ? 0xF2 : 0xF3, 0x0F, 0x11, from, to);
 }
 
+void emitMovupsAR(GeneratedFunction *f, Address *from, enum Registers to) {
+  // movups xmm, m128
+  emitRex(f, to, from->base, from->index, FALSE);
+  emitByte(f, 0x0F);
+  emitByte(f, 0x10);
+  encodeAR(f, from, register_encodings[to]);
+}
+
+void emitMovupsRA(GeneratedFunction *f, enum Registers from, Address *to) {
+  // movups m128, xmm
+  emitRex(f, from, to->base, to->index, FALSE);
+  emitByte(f, 0x0F);
+  emitByte(f, 0x11);
+  encodeAR(f, to, register_encodings[from]);
+}
+
 void emitMovfpAR(GeneratedFunction *f, Address *from, enum Registers to, size_t size) {
   emitSimpleFPArightRA(f, size == 8 ? 0xF2 : 0xF3, 0x0F, 0x10, to, from);
 }
@@ -946,25 +1177,23 @@ void emitCondJump(GeneratedFunction *f, struct Label *l, enum JumpCondition cond
       address l_pc = s->start + l->label_cp;
       ptrdiff_t d = l_pc - pc - 2;
       if ((ptrdiff_t)(int8_t)d == d) {
+          recordJump(f, l, instrOff, 2);
           emitByte(f, 0x70 | cond);
           emitByte(f, d);
       } else {
+          recordJump(f, l, instrOff, 6);
           emitByte(f, 0x0F);
           emitByte(f, 0x80 | cond);
           emitDisp32(f, d - 4);
       }
   } else {
-    struct LabelJump *lj = areanAllocate(f->arena, sizeof (struct LabelJump));
-    lj->instruction_cp = instrOff;
-    lj->next = l->jumps;
-    l->jumps = lj;
-
     if (isNear) {
+      recordJump(f, l, instrOff, 2);
       emitByte(f, 0x70 | cond);
       emitByte(f, 0xFF);
-      lj->instSize = 2;
     } else {
-      lj->instSize = 6;
+      // relaxJumps shrinks it later if the label turns out to be close
+      recordJump(f, l, instrOff, 6);
       emitByte(f, 0x0F);
       emitByte(f, 0x80 | cond);
       emitDisp32(f, 0xDEADBEEF);
@@ -982,25 +1211,21 @@ void emitJumpTo(GeneratedFunction *f, struct Label *l, Boolean isNear) {
       address l_pc = s->start + l->label_cp;
       ptrdiff_t d = l_pc - pc - 2;
       if ((ptrdiff_t)(int8_t)d == d) {
+          recordJump(f, l, pc - start, 2);
           emitByte(f, 0xEB);
           emitByte(f, d);
       } else {
+          recordJump(f, l, pc - start, 5);
           emitByte(f, 0xE9);
           emitDisp32(f, d - 3);
       }
   } else {
-
-    struct LabelJump *lj = areanAllocate(f->arena, sizeof (struct LabelJump));
-    lj->instruction_cp = pc - start;
-    lj->next = l->jumps;
-    l->jumps = lj;
-
     if (isNear) {
-      lj->instSize = 2;
+      recordJump(f, l, pc - start, 2);
       emitByte(f, 0xEB);
       emitByte(f, 0xFF);
     } else {
-      lj->instSize = 5;
+      recordJump(f, l, pc - start, 5);
       emitByte(f, 0xE9);
       emitDisp32(f, 0xDEADBEEF);
     }
@@ -1023,62 +1248,170 @@ void emitJumpByReg(GeneratedFunction *f, enum Registers reg) {
   emitByte(f, modrm.v);
 }
 
-void patchRefTo(GeneratedFunction *f, ptrdiff_t literal_cp, ptrdiff_t label_cp) {
-  ptrdiff_t fromOffset = literal_cp + sizeof(int32_t);
-  ptrdiff_t toOffset = label_cp;
+void emitJumpTableEntry(GeneratedFunction *f, struct Label *l, ptrdiff_t table_cp) {
+  ptrdiff_t entryOffset = f->section->pc - f->section->start;
 
-  int32_t delta = toOffset - fromOffset;
-  address literalAddress = f->section->start + literal_cp;
+  recordLabelRef(f, l, entryOffset, table_cp);
 
-  emitByte_pc(literalAddress++, (uint8_t) (delta >> 0));
-  emitByte_pc(literalAddress++, (uint8_t) (delta >> 8));
-  emitByte_pc(literalAddress++, (uint8_t) (delta >> 16));
-  emitByte_pc(literalAddress++, (uint8_t) (delta >> 24));
+  if (l->binded) {
+    emitDisp32(f, l->label_cp - table_cp);
+  } else {
+    emitDisp32(f, 0xDEADBEEF);
+  }
+}
+
+void patchRefTo(GeneratedFunction *f, ptrdiff_t literal_cp, ptrdiff_t origin_cp, ptrdiff_t label_cp) {
+  emitDisp32_pc(f->section->start + literal_cp, label_cp - origin_cp);
 }
 
 void patchJumpTo(GeneratedFunction *f, ptrdiff_t inst_cp, size_t instSize, ptrdiff_t label_cp) {
-  Section *s = f->section;
-  ptrdiff_t d = label_cp - inst_cp - 2;
-  address instpc = s->start + inst_cp;
-  void * instpc_d = instpc;
-  uint8_t opc = *instpc;
+  address instpc = f->section->start + inst_cp;
+  ptrdiff_t d = label_cp - inst_cp - instSize;
 
   if (instSize == 2) {
       assert((ptrdiff_t)(int8_t)d == d);
       emitByte_pc(instpc + 1, d);
-      return;
+  } else {
+      // long forms stay long here, relaxJumps decides on them once the whole body is known
+      emitDisp32_pc(instpc + instSize - sizeof(int32_t), d);
   }
+}
 
-  if ((ptrdiff_t)(int8_t)d == d) {
-      if (opc == 0xE9) {
-        // jmp
-        assert(instSize == 5);
-        emitByte_pc(instpc++, 0xEB);
-        emitByte_pc(instpc++, d);
-      } else {
-        // jcc
-        assert(*instpc == 0x0F);
-        assert(instSize == 6);
-        uint8_t opc2 = *(instpc + 1);
-        uint8_t cc = opc2 & 0x0F;
-        emitByte_pc(instpc++, 0x70 | cc);
-        emitByte_pc(instpc++, d);
-        emitByte_pc(instpc++, 0x90);
+// =========== Branch relaxation ===============================//
+
+// where `cp` ends up once every jump in `saved` has been shortened
+static ptrdiff_t relaxedOffset(struct LabelJump **jumps, const ptrdiff_t *saved, unsigned count, ptrdiff_t cp) {
+  unsigned lo = 0, hi = count;
+
+  // number of jumps which start before cp
+  while (lo < hi) {
+    unsigned mid = (lo + hi) / 2;
+    if (jumps[mid]->instruction_cp < cp) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return cp - saved[lo];
+}
+
+static void computeSavings(struct LabelJump **jumps, const size_t *sizes, ptrdiff_t *saved, unsigned count) {
+  saved[0] = 0;
+  for (unsigned i = 0; i < count; ++i) {
+    saved[i + 1] = saved[i] + (jumps[i]->instSize - sizes[i]);
+  }
+}
+
+void relaxJumps(GeneratedFunction *f, Relocation *relocMark) {
+  Section *s = f->section;
+  address base = s->start;
+  unsigned count = 0;
+
+  struct LabelJump *lj = f->jumps;
+  for (; lj; lj = lj->nextInFunction) {
+    if (lj->target_cp < 0) return; // dangling label, leave the code as is
+    ++count;
+  }
+
+  struct LabelRef *lr = f->labelRefs;
+  for (; lr; lr = lr->nextInFunction) {
+    if (lr->target_cp < 0) return;
+  }
+
+  if (count == 0) return;
+
+  struct LabelJump **jumps = areanAllocate(f->arena, count * sizeof (struct LabelJump *));
+  size_t *sizes = areanAllocate(f->arena, count * sizeof (size_t));
+  ptrdiff_t *saved = areanAllocate(f->arena, (count + 1) * sizeof (ptrdiff_t));
+
+  unsigned idx = count;
+  for (lj = f->jumps; lj; lj = lj->nextInFunction) {
+    jumps[--idx] = lj;
+    sizes[idx] = lj->instSize;
+  }
+
+  // shortening a jump never makes another one longer, so iterate until nothing changes
+  Boolean changed;
+  do {
+    changed = FALSE;
+    computeSavings(jumps, sizes, saved, count);
+
+    for (unsigned i = 0; i < count; ++i) {
+      if (sizes[i] == 2) continue;
+
+      ptrdiff_t inst_cp = jumps[i]->instruction_cp;
+      ptrdiff_t target_cp = jumps[i]->target_cp;
+      ptrdiff_t from = relaxedOffset(jumps, saved, count, inst_cp) + 2;
+      ptrdiff_t to = relaxedOffset(jumps, saved, count, target_cp);
+      if (target_cp > inst_cp) to -= sizes[i] - 2;
+
+      ptrdiff_t d = to - from;
+      if ((ptrdiff_t)(int8_t)d == d) {
+        sizes[i] = 2;
+        changed = TRUE;
       }
+    }
+  } while (changed);
 
-      emitByte_pc(instpc++, 0x90);
-      emitByte_pc(instpc++, 0x90);
-      emitByte_pc(instpc++, 0x90);
-  } else {
-     if (opc == 0xE9) {
-        emitDisp32_pc(instpc + 1, d - 3);
-     } else {
-        assert(opc == 0x0F);
-        emitDisp32_pc(instpc + 2, d - 4);
-     }
+  computeSavings(jumps, sizes, saved, count);
+
+  if (saved[count] == 0) return;
+
+  ptrdiff_t end = s->pc - base;
+  ptrdiff_t src = jumps[0]->instruction_cp;
+  ptrdiff_t dst = src;
+
+  for (unsigned i = 0; i < count; ++i) {
+    ptrdiff_t inst_cp = jumps[i]->instruction_cp;
+    memmove(base + dst, base + src, inst_cp - src);
+    dst += inst_cp - src;
+
+    uint8_t opc = base[inst_cp];
+    uint8_t opc2 = base[inst_cp + 1];
+    Boolean isJmp = opc == 0xEB || opc == 0xE9;
+    uint8_t cc = (opc == 0x0F ? opc2 : opc) & 0x0F;
+
+    ptrdiff_t target = relaxedOffset(jumps, saved, count, jumps[i]->target_cp);
+    ptrdiff_t d = target - (dst + sizes[i]);
+    address p = base + dst;
+
+    if (sizes[i] == 2) {
+      emitByte_pc(p, isJmp ? 0xEB : 0x70 | cc);
+      emitByte_pc(p + 1, (uint8_t)d);
+    } else if (isJmp) {
+      emitByte_pc(p, 0xE9);
+      emitDisp32_pc(p + 1, d);
+    } else {
+      emitByte_pc(p, 0x0F);
+      emitByte_pc(p + 1, 0x80 | cc);
+      emitDisp32_pc(p + 2, d);
+    }
+
+    src = inst_cp + jumps[i]->instSize;
+    dst += sizes[i];
+  }
+
+  memmove(base + dst, base + src, end - src);
+  s->pc = base + dst + (end - src);
+
+  for (lr = f->labelRefs; lr; lr = lr->nextInFunction) {
+    ptrdiff_t offset_cp = relaxedOffset(jumps, saved, count, lr->offset_cp);
+    ptrdiff_t origin_cp = relaxedOffset(jumps, saved, count, lr->origin_cp);
+    ptrdiff_t target_cp = relaxedOffset(jumps, saved, count, lr->target_cp);
+    emitDisp32_pc(base + offset_cp, target_cp - origin_cp);
+  }
+
+  Relocation *reloc = s->reloc;
+  for (; reloc != relocMark; reloc = reloc->next) {
+    if (reloc->applySection == s && reloc->applySectionOffset >= f->sectionOffset) {
+      reloc->applySectionOffset = relaxedOffset(jumps, saved, count, reloc->applySectionOffset);
+    }
   }
 }
 
+// =========== Branch relaxation ===============================//
+
 void emitCall(GeneratedFunction *f, enum Registers reg) {
   // call %reg
   emitRex(f, R_BAD, reg, R_BAD, FALSE);
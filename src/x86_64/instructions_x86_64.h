@@ -84,6 +84,7 @@ enum Registers {
   R_FACC = R_XMM0,
   R_FTMP = R_XMM1,
   R_FTMP2 = R_XMM2,
+  R_FBLOCK = R_XMM15, // scratch of inline block moves, never holds a value across expressions
 
   R_ARG_0 = R_EDI,
   R_ARG_1 = R_ESI,
@@ -95,6 +96,7 @@ enum Registers {
   R_RIP = -2,
 
   R_PARAM_COUNT = 6,
+  R_CALLEE_SAVED_COUNT = 5,
   R_FP_PARAM_COUNT = R_XMM7 - R_XMM0 + 1
 };
 
@@ -183,6 +185,7 @@ void emitBitwiseNotA(struct _GeneratedFunction *f, Address *addr, size_t size);
 
 void emitJumpTo(struct _GeneratedFunction *f, struct Label *l, Boolean isNear);
 void emitJumpByReg(struct _GeneratedFunction *f, enum Registers reg);
+void emitJumpTableEntry(struct _GeneratedFunction *f, struct Label *l, ptrdiff_t table_cp);
 void emitCall(struct _GeneratedFunction *f, enum Registers reg);
 void emitCallLiteral(struct _GeneratedFunction *f, Relocation *reloc);
 
@@ -191,7 +194,9 @@ void emitRet(struct _GeneratedFunction *f, uint16_t s);
 void emitLeave(struct _GeneratedFunction *f);
 
 void patchJumpTo(struct _GeneratedFunction *f, ptrdiff_t inst_cp, size_t instSize, ptrdiff_t label_cp);
-void patchRefTo(struct _GeneratedFunction *f, ptrdiff_t literal_cp, ptrdiff_t label_cp);
+void patchRefTo(struct _GeneratedFunction *f, ptrdiff_t literal_cp, ptrdiff_t origin_cp, ptrdiff_t label_cp);
+void relaxJumps(struct _GeneratedFunction *f, Relocation *relocMark);
+void peepholeBarrier(struct _GeneratedFunction *f);
 
 void emitMovsxdRR(struct _GeneratedFunction *f, enum Registers from, enum Registers to, size_t s);
 void emitMovxxRR(struct _GeneratedFunction *f, uint8_t opcode, enum Registers from, enum Registers to);
@@ -200,6 +205,8 @@ void emitConvertWDQ(struct _GeneratedFunction *f, uint8_t opcode, uint8_t opSize
 void emitConvertFP(struct _GeneratedFunction *f, uint8_t prefix, uint8_t opcode, enum Registers from, enum Registers to, Boolean isW);
 
 void emitMovfpRR(struct _GeneratedFunction *f, enum Registers from, enum Registers to, size_t size);
+void emitMovupsAR(struct _GeneratedFunction *f, Address *from, enum Registers to);
+void emitMovupsRA(struct _GeneratedFunction *f, enum Registers from, Address *to);
 void emitMovfpRA(struct _GeneratedFunction *f, enum Registers from, Address *to, size_t size);
 void emitMovfpAR(struct _GeneratedFunction *f, Address *from, enum Registers to, size_t size);
 
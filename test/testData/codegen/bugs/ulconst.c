@@ -12,7 +12,7 @@ unsigned long test2() {
 
 int main() {
 
-  if (test1() != s) return 1;
+  if (test1() != 0x456) return 1;
 
   if (test2() != 0xabc) return 2;
 
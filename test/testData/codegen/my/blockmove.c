@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <alloca.h>
+
+struct S1 { char a; };
+struct S3 { char a[3]; };
+struct S7 { char a[7]; };
+struct S12 { int a, b, c; };
+struct S24 { long a; char b[16]; };
+struct S33 { char a[33]; };
+struct S64 { char a[64]; };
+struct S200 { int a[50]; };
+
+static struct S33 g33 = { "global struct with 33 chars....." };
+
+static int checkBytes(const char *p, int n, int seed) {
+  int i;
+  for (i = 0; i < n; ++i) {
+    if (p[i] != (char)(seed + i)) return 0;
+  }
+  return 1;
+}
+
+static void fillBytes(char *p, int n, int seed) {
+  int i;
+  for (i = 0; i < n; ++i) p[i] = (char)(seed + i);
+}
+
+int testCopy() {
+  struct S1 a1, b1;
+  struct S3 a3, b3;
+  struct S7 a7, b7;
+  struct S33 a33, b33;
+  struct S64 a64, b64;
+  fillBytes((char *)&a1, sizeof a1, 1);
+  fillBytes((char *)&a3, sizeof a3, 2);
+  fillBytes((char *)&a7, sizeof a7, 3);
+  fillBytes((char *)&a33, sizeof a33, 4);
+  fillBytes((char *)&a64, sizeof a64, 5);
+  b1 = a1;
+  b3 = a3;
+  b7 = a7;
+  b33 = a33;
+  b64 = a64;
+  if (!checkBytes((char *)&b1, sizeof b1, 1)) return 1;
+  if (!checkBytes((char *)&b3, sizeof b3, 2)) return 2;
+  if (!checkBytes((char *)&b7, sizeof b7, 3)) return 3;
+  if (!checkBytes((char *)&b33, sizeof b33, 4)) return 4;
+  if (!checkBytes((char *)&b64, sizeof b64, 5)) return 5;
+  b33 = g33;
+  if (b33.a[31] != '.' || b33.a[32] != 0) return 6;
+  return 0;
+}
+
+static struct S200 make200(int seed) {
+  struct S200 r;
+  int i;
+  for (i = 0; i < 50; ++i) r.a[i] = seed + i;
+  return r;
+}
+
+static struct S24 make24(long a) {
+  struct S24 r = { a, "fifteen chars.." };
+  return r;
+}
+
+static int sum(struct S12 s, struct S200 big, struct S24 m, int last) {
+  return s.a + s.b + s.c + big.a[0] + big.a[49] + (int)m.a + m.b[14] + last;
+}
+
+int testArgsAndReturns() {
+  struct S12 s = { 1, 2, 3 };
+  struct S200 big = make200(10);
+  struct S24 m = make24(100);
+  if (big.a[25] != 35) return 1;
+  if (m.b[0] != 'f' || m.b[15] != 0) return 2;
+  if (sum(s, big, m, 4) != 1 + 2 + 3 + 10 + 59 + 100 + '.' + 4) return 3;
+  big = make200(0);
+  m = make24(7);
+  if (sum(s, big, m, 0) != 6 + 0 + 49 + 7 + '.') return 4;
+  return 0;
+}
+
+int testZeroInit() {
+  struct S12 s = { .b = 5 };
+  struct S33 a = { { 1, 2 } };
+  struct S200 big = { { [10] = 7 } };
+  char str[40] = "short";
+  int arr[1000] = { 1, 2 };
+  struct S12 sarr[20] = { [3] = { 4, 5, 6 } };
+  int i;
+  if (s.a != 0 || s.b != 5 || s.c != 0) return 1;
+  for (i = 2; i < 33; ++i) {
+    if (a.a[i]) return 2;
+  }
+  for (i = 0; i < 50; ++i) {
+    if (big.a[i] != (i == 10 ? 7 : 0)) return 3;
+  }
+  for (i = 5; i < 40; ++i) {
+    if (str[i]) return 4;
+  }
+  if (arr[0] != 1 || arr[1] != 2) return 5;
+  for (i = 2; i < 1000; ++i) {
+    if (arr[i]) return 6;
+  }
+  for (i = 0; i < 20; ++i) {
+    if (sarr[i].a != (i == 3 ? 4 : 0) || sarr[i].c != (i == 3 ? 6 : 0)) return 7;
+  }
+  return 0;
+}
+
+static int sumAlloca(int n, int k) {
+  int *p = alloca(n * sizeof(int));
+  int i, s = 0;
+  for (i = 0; i < n; ++i) p[i] = i * k;
+  for (i = 0; i < n; ++i) s += p[i];
+  return s;
+}
+
+static int add3(int a, int b, int c) { return a + b + c; }
+
+static int *storeInt(void *p, int v) {
+  int *ip = (int *)p;
+  *ip = v;
+  return ip;
+}
+
+int testAlloca() {
+  int i;
+  for (i = 1; i < 20; ++i) {
+    if (sumAlloca(i, 2) != i * (i - 1)) return 1;
+  }
+  // alloca while arguments are pushed on the stack
+  if (add3(1, *storeInt(alloca(sizeof(int)), 5), 3) != 9) return 2;
+  return 0;
+}
+
+int main() {
+
+  printf("test copy\n");
+  int r = testCopy();
+  if (r != 0) return r;
+
+  printf("test args and returns\n");
+  r = testArgsAndReturns();
+  if (r != 0) return r;
+
+  printf("test zero init\n");
+  r = testZeroInit();
+  if (r != 0) return r;
+
+  printf("test alloca\n");
+  r = testAlloca();
+  if (r != 0) return r;
+
+  printf("OK\n");
+  return 0;
+}
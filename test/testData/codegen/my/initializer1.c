@@ -235,6 +235,27 @@ int testSeverities() {
   return 0;
 }
 
+typedef int IncompleteInts[];
+typedef char IncompleteChars[];
+
+static IncompleteInts shortInts = { 1, 2 };
+static IncompleteInts longInts = { 1, 2, 3, [5] = 6 };
+static IncompleteChars shortChars = "ab";
+static IncompleteChars longChars = "abcdef";
+
+int testSharedIncompleteArray() {
+  // every declaration completes the typedef on its own
+  IncompleteInts local = { [3] = 1 };
+  if (sizeof shortInts != 2 * sizeof(int)) return 1;
+  if (sizeof longInts != 6 * sizeof(int)) return 2;
+  if (sizeof shortChars != 3) return 3;
+  if (sizeof longChars != 7) return 4;
+  if (sizeof local != 4 * sizeof(int)) return 5;
+  if (longInts[5] != 6 || local[3] != 1 || local[0] != 0) return 6;
+  if (sizeof ((IncompleteInts) { 1, 2, 3 }) != 3 * sizeof(int)) return 7;
+  return 0;
+}
+
 int main() {
   int r = testStatic();
 
@@ -251,6 +272,8 @@ int main() {
   r = testSeverities();
   if (r) return r + 3000;
 
+  r = testSharedIncompleteArray();
+  if (r) return r + 4000;
 
 
   return 0;
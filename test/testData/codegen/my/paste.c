@@ -0,0 +1,26 @@
+#define CAT(a, b) a ## b
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define OBJ paste ## d
+
+static int same(const char *a, const char *b) {
+  while (*a && *a == *b) {
+      ++a; ++b;
+  }
+  return *a == *b;
+}
+
+int CAT(var, 1) = CAT(1, 2);
+int OBJ = 7;
+
+int main() {
+  if (var1 != 12) return 1;
+  if (pasted != 7) return 2;
+  if (!same(STR(a  +   b), "a + b")) return 3;
+  if (!same(STR("q" '\'' "\\"), "\"q\" '\\'' \"\\\\\"")) return 4;
+  if (!same(STR(), "")) return 5;
+  if (!same(XSTR(CAT(in, t)), "int")) return 6;
+  CAT(i, nt) CAT(lo, cal) = CAT(var, 1);
+  if (local != 12) return 7;
+  return 0;
+}
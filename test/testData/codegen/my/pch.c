@@ -0,0 +1,34 @@
+#include <string.h>
+#include <stdarg.h>
+
+int counter = 4;
+
+static int mul(int a, int b) { return a * b; }
+
+int apply(binop_t op, int a, int b) { return op(a, b); }
+
+int sum(int n, ...) {
+  va_list ap;
+  int s = 0;
+  va_start(ap, n);
+  while (n--) s += va_arg(ap, int);
+  va_end(ap);
+  return s;
+}
+
+int main() {
+  Packed p = { -2, 17, { "abc", 40 } };
+  double half = HALF;
+
+  if (SQUARE(counter) != 16) return 1;
+  if (FIRST(3, 4, 5) != 3) return 2;
+  if (strcmp(NAME(x + 1), "x + 1") != 0) return 3;
+  if (half * 4 != 2) return 4;
+  if (p.a != -2 || p.b != 17) return 5;
+  if (strlen(p.inner.tag) != 3 || p.inner.value != 40) return 6;
+  if (LIGHT != 8 || sizeof(enum Shade) != sizeof(int)) return 7;
+  if (apply(mul, 6, 7) != 42) return 8;
+  if (sum(3, 1, 2, 3) != 6) return 9;
+
+  return 0;
+}
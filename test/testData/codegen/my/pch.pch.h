@@ -0,0 +1,23 @@
+#include <string.h>
+
+#define SQUARE(x) ((x) * (x))
+#define FIRST(a, ...) a
+#define NAME(x) #x
+#define HALF 0.5
+
+typedef struct Packed {
+  int a : 3;
+  unsigned b : 5;
+  struct {
+    char tag[4];
+    long value;
+  } inner;
+} Packed;
+
+enum Shade { DARK = 2, LIGHT = DARK * 4 };
+
+typedef int (*binop_t)(int, int);
+
+extern int counter;
+int apply(binop_t op, int a, int b);
+int sum(int n, ...);
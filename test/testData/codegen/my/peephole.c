@@ -0,0 +1,76 @@
+#include <stdio.h>
+
+static long values[4] = { 3, -5, 7, 11 };
+
+int testStoreReload(int n) {
+  int a, b, c;
+  long l, m;
+  unsigned u;
+  int *p = &a;
+  a = n * 3;
+  b = a;
+  c = b + a;
+  l = c;
+  m = l;
+  u = (unsigned)-n;
+  l = u;
+  if (*p != 21 || b != 21 || c != 42) return 1;
+  if (m != 42) return 2;
+  if (l != 4294967289L) return 3;
+  return 0;
+}
+
+int testLogicFlags(int a, int b) {
+  int r = 0;
+  int *pa = &a;
+  if (a & b) r |= 1;
+  if (a & 8) r |= 2;
+  if (!(a ^ a)) r |= 4;
+  if (a | 0) r |= 8;
+  if (*pa & 16) r |= 16;
+  if ((a & b) == 0) r |= 32;
+  if ((a & b) > 0) r |= 64;
+  if ((a & -1) < 0) r |= 128;
+  if (77 != r) return 1;
+  return 0;
+}
+
+int testNested(long x, long y) {
+  long *px = &x, *py = &y;
+  long r = (*px + *py) * (*px - *py) - (*px * (*py + 1)) / (*py - *px + values[1]);
+  long s = values[0] * (values[1] - values[2] * (values[3] + *px));
+  if (-15 != r) return 1;
+  if (-288 != s) return 2;
+  return 0;
+}
+
+int testVolatile() {
+  volatile int v = 1;
+  int a = v;
+  v = a + 1;
+  a = v;
+  if (2 != a) return 1;
+  return 0;
+}
+
+int main() {
+
+  printf("test store reload\n");
+  int r = testStoreReload(7);
+  if (r != 0) return r;
+
+  printf("test logic flags\n");
+  r = testLogicFlags(5, 3);
+  if (r != 0) return r;
+
+  printf("test nested\n");
+  r = testNested(2, 5);
+  if (r != 0) return r;
+
+  printf("test volatile\n");
+  r = testVolatile();
+  if (r != 0) return r;
+
+  printf("OK\n");
+  return 0;
+}
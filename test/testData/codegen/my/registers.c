@@ -0,0 +1,151 @@
+#include <stdio.h>
+
+static int ten = 10;
+
+static int id(int x) { return x; }
+
+int testCalls() {
+  int i, s = 0, k = 3;
+  long l = 100;
+  for (i = 0; i < ten; ++i) {
+    s += id(i) * k;
+    l -= id(s);
+  }
+  if (135 != s) return 1;
+  if (-395 != l) return 2;
+  return 0;
+}
+
+int testCompound() {
+  int i, a = 1000, b = 7;
+  unsigned u = 4000000000u;
+  for (i = 0; i < 4; ++i) {
+    a -= b;
+    a *= 3;
+    a /= 2;
+    a %= 10000;
+    b <<= 1;
+    b >>= 1;
+    b |= 8;
+    b &= 13;
+    b ^= 2;
+    u /= 3;
+    u %= 1000000;
+  }
+  if (4918 != a) return 1;
+  if (15 != b) return 2;
+  if (12345 != u) return 3;
+  return 0;
+}
+
+int testShifts(int v, int s) {
+  int r = 0, k;
+  for (k = 0; k < 8; ++k) {
+    r += v << k;
+    r ^= v >> s;
+    v = v / s + k % s;
+  }
+  if (350658 != r) return 1;
+  return 0;
+}
+
+int testStackParams(int a, int b, int c, int d, int e, int f, int g, int h) {
+  int i, r = 0;
+  for (i = 0; i < 4; ++i) r += a * i + b - c + d / (i + 1) + e % (i + 2) + f + g * h;
+  if (262 != r) return 1;
+  return 0;
+}
+
+int testUnsigned(unsigned a, unsigned b) {
+  unsigned c = 0;
+  int i;
+  for (i = 0; i < 10; ++i) {
+    if (a < b) c += 1;
+    if (b <= a) c += 2;
+    if (a > b) c += 4;
+    c += b / a + b % a;
+    a += 1;
+  }
+  if (72 != c) return 1;
+  return 0;
+}
+
+int testEscaped(int n) {
+  int x = 0, i;
+  int *p = &x;
+  for (i = 0; i < n; ++i) {
+    *p += i;
+    x++;
+  }
+  if (55 != x) return 1;
+  return 0;
+}
+
+static int fib(int n) {
+  int a, b;
+  if (n < 2) return n;
+  a = fib(n - 1);
+  b = fib(n - 2);
+  return a + b;
+}
+
+int testRecursion() {
+  int i, s = 0;
+  for (i = 0; i < 15; ++i) s += fib(i);
+  if (986 != s) return 1;
+  return 0;
+}
+
+static const char *find(const char *s, int c) {
+  const char *p;
+  for (p = s; *p; ++p) {
+    if (*p == c) return p;
+  }
+  return 0;
+}
+
+int testPointers() {
+  const char *str = "hello world";
+  const char *w = find(str, 'w');
+  if (w - str != 6) return 1;
+  if (find(str, 'z')) return 2;
+  return 0;
+}
+
+int main() {
+
+  printf("test calls\n");
+  int r = testCalls();
+  if (r != 0) return r;
+
+  printf("test compound\n");
+  r = testCompound();
+  if (r != 0) return r;
+
+  printf("test shifts\n");
+  r = testShifts(123456, 3);
+  if (r != 0) return r;
+
+  printf("test stack params\n");
+  r = testStackParams(1, 2, 3, 4, 5, 6, 7, 8);
+  if (r != 0) return r;
+
+  printf("test unsigned\n");
+  r = testUnsigned(3, 17);
+  if (r != 0) return r;
+
+  printf("test escaped\n");
+  r = testEscaped(10);
+  if (r != 0) return r;
+
+  printf("test recursion\n");
+  r = testRecursion();
+  if (r != 0) return r;
+
+  printf("test pointers\n");
+  r = testPointers();
+  if (r != 0) return r;
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+
+static int dense(int v) {
+  switch (v) {
+    case 0: return 10;
+    case 1: return 11;
+    case 2: return 12;
+    case 3: return 13;
+    case 4:
+    case 5: return 15;
+    case 7: return 17;
+    case 8: return 18;
+    default: return -1;
+  }
+}
+
+static int negative(int v) {
+  int r = 0;
+  switch (v) {
+    case -3: r += 1;
+    case -2: r += 2; break;
+    case -1: r += 4; break;
+    case 0: r += 8; break;
+    case 1: r += 16; break;
+    case 2: r += 32; break;
+  }
+  return r;
+}
+
+static int sparse(int v) {
+  switch (v) {
+    case -100000: return 1;
+    case -7: return 2;
+    case 3: return 3;
+    case 90: return 4;
+    case 1000: return 5;
+    case 4242: return 6;
+    case 70000: return 7;
+    case 2000000000: return 8;
+  }
+  return 0;
+}
+
+static int clustered(unsigned v) {
+  switch (v) {
+    case 1: case 2: case 3: case 4: case 5: case 6: return 1;
+    case 100: case 101: case 102: case 103: case 104: return 2;
+    case 5000: return 3;
+    case 10000: case 10001: case 10002: case 10003: case 10005: return 4;
+    case 4000000000u: return 5;
+    case 4294967295u: return 6;
+    default: return 0;
+  }
+}
+
+static int wide(long v) {
+  switch (v) {
+    case -5000000000L: return 1;
+    case -1: return 2;
+    case 0: return 3;
+    case 1: return 4;
+    case 2: return 5;
+    case 3: return 6;
+    case 5000000000L: return 7;
+    default: return 0;
+  }
+}
+
+static int extremes(long v) {
+  // the low 32 bits of these constants are equal
+  switch (v) {
+    case -9223372036854775807L-1: return 1;
+    case 4294967296L: return 2;
+    case 0: return 3;
+    default: return 0;
+  }
+}
+
+static int chars(char c) {
+  switch (c) {
+    case 'a': case 'e': case 'i': case 'o': case 'u': return 1;
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9': return 2;
+    case -1: return 3;
+    default: return 0;
+  }
+}
+
+static int nested(int a, int b) {
+  switch (a) {
+    case 0: case 1: case 2: case 3:
+      switch (b) {
+        case 10: case 11: case 12: case 13: return a * 100 + b;
+        default: break;
+      }
+      return -a;
+    case 4: case 5: case 6: case 7: return a;
+  }
+  return -100;
+}
+
+int testDense() {
+  static const int expected[] = { -1, 10, 11, 12, 13, 15, 15, -1, 17, 18, -1 };
+  int i;
+  for (i = -1; i < 10; ++i) {
+    if (dense(i) != expected[i + 1]) return i + 10;
+  }
+  if (dense(-2147483647 - 1) != -1) return 1;
+  if (dense(2147483647) != -1) return 2;
+  return 0;
+}
+
+int testNegative() {
+  if (negative(-3) != 3) return 1;
+  if (negative(-2) != 2) return 2;
+  if (negative(-1) != 4) return 3;
+  if (negative(2) != 32) return 4;
+  if (negative(3) != 0) return 5;
+  if (negative(-4) != 0) return 6;
+  return 0;
+}
+
+int testSparse() {
+  if (sparse(-100000) != 1) return 1;
+  if (sparse(-7) != 2) return 2;
+  if (sparse(3) != 3) return 3;
+  if (sparse(90) != 4) return 4;
+  if (sparse(1000) != 5) return 5;
+  if (sparse(4242) != 6) return 6;
+  if (sparse(70000) != 7) return 7;
+  if (sparse(2000000000) != 8) return 8;
+  if (sparse(4) != 0) return 9;
+  if (sparse(-8) != 0) return 10;
+  return 0;
+}
+
+int testClustered() {
+  if (clustered(0) != 0) return 1;
+  if (clustered(6) != 1) return 2;
+  if (clustered(7) != 0) return 3;
+  if (clustered(102) != 2) return 4;
+  if (clustered(5000) != 3) return 5;
+  if (clustered(10004) != 0) return 6;
+  if (clustered(10005) != 4) return 7;
+  if (clustered(4000000000u) != 5) return 8;
+  if (clustered(4294967295u) != 6) return 9;
+  if (clustered(2147483648u) != 0) return 10;
+  return 0;
+}
+
+int testWide() {
+  if (wide(-5000000000L) != 1) return 1;
+  if (wide(-1) != 2) return 2;
+  if (wide(3) != 6) return 3;
+  if (wide(4) != 0) return 4;
+  if (wide(5000000000L) != 7) return 5;
+  if (wide(705032704L) != 0) return 6;
+  if (extremes(-9223372036854775807L-1) != 1) return 7;
+  if (extremes(4294967296L) != 2) return 8;
+  if (extremes(0) != 3) return 9;
+  if (extremes(-1) != 0) return 10;
+  return 0;
+}
+
+int testChars() {
+  if (chars('e') != 1) return 1;
+  if (chars('7') != 2) return 2;
+  if (chars(-1) != 3) return 3;
+  if (chars('z') != 0) return 4;
+  return 0;
+}
+
+int testNested() {
+  if (nested(2, 12) != 212) return 1;
+  if (nested(3, 9) != -3) return 2;
+  if (nested(6, 0) != 6) return 3;
+  if (nested(8, 10) != -100) return 4;
+  return 0;
+}
+
+int main() {
+
+  printf("test dense\n");
+  int r = testDense();
+  if (r != 0) return r;
+
+  printf("test negative\n");
+  r = testNegative();
+  if (r != 0) return r;
+
+  printf("test sparse\n");
+  r = testSparse();
+  if (r != 0) return r;
+
+  printf("test clustered\n");
+  r = testClustered();
+  if (r != 0) return r;
+
+  printf("test wide\n");
+  r = testWide();
+  if (r != 0) return r;
+
+  printf("test chars\n");
+  r = testChars();
+  if (r != 0) return r;
+
+  printf("test nested\n");
+  r = testNested();
+  if (r != 0) return r;
+
+  printf("OK\n");
+  return 0;
+}
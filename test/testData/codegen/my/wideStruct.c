@@ -0,0 +1,44 @@
+struct Wide {
+  int f0, f1, f2, f3, f4, f5, f6, f7, f8, f9;
+  struct {
+    int inner;
+    union {
+      long deep;
+      char bytes[8];
+    };
+  };
+  int last;
+};
+
+union WideUnion {
+  char c0, c1, c2, c3, c4, c5, c6, c7;
+  struct {
+    short lo;
+    short hi;
+  };
+};
+
+static int sum(struct Wide *w) {
+  return w->f0 + w->f1 + w->f2 + w->f3 + w->f4 + w->f5 + w->f6 + w->f7 + w->f8 + w->f9;
+}
+
+int main() {
+  struct Wide w = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+  union WideUnion u;
+
+  w.inner = 10;
+  w.deep = 0x0102;
+  w.last = 11;
+
+  if (sum(&w) != 45) return 1;
+  if (w.inner != 10 || w.last != 11) return 2;
+  if (w.bytes[0] != 2 || w.bytes[1] != 1) return 3;
+  if ((char *)&w.last - (char *)&w != 10 * sizeof(int) + 16) return 4;
+
+  u.lo = 0x0304;
+  u.hi = 0x0506;
+  if (u.c0 != 4 || u.c7 != 4) return 5;
+  if (sizeof(union WideUnion) != 4) return 6;
+
+  return 0;
+}
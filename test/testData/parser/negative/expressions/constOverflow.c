@@ -0,0 +1,16 @@
+int arr[2147483647 + 1 ? 2 : 1];
+
+long l = -(-9223372036854775807L - 1);
+
+unsigned u = 4294967295u + 1;
+
+int noWarn(int x) {
+  return x + 2147483647 + 1;
+}
+
+int main() {
+  switch (noWarn(0)) {
+    case 65536 * 65536: return 1;
+  }
+  return sizeof arr;
+}
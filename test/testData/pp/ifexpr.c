@@ -0,0 +1,26 @@
+#define X 5
+#define EMPTY
+
+#if defined(X) && X > 3
+OK
+#endif
+
+#if !defined Y && (X << 2) == 20 && -7 / 2 == -3 && -7 % 2 == -1
+OK
+#endif
+
+#if Y || EMPTY 0
+NOT OK
+#elif (X ? X - 5 : 1) == 0 && ~0 == -1 && 0x7fffffff + 1 > 0
+OK
+#endif
+
+#if 0x100000000
+OK
+#endif
+
+#if -1 < 0u
+NOT OK
+#else
+OK
+#endif
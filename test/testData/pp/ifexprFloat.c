@@ -0,0 +1,13 @@
+
+#if 1 / 2.0
+NOT OK
+#else
+OK
+#endif
+
+#if 0
+#elif 1.5 + 1
+NOT OK
+#else
+OK
+#endif
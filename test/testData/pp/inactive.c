@@ -0,0 +1,28 @@
+#if 0
+don't stop at apostrophes
+"#endif" /* #endif
+#endif */ '#'
+  # if 1
+  #endif
+a = "str \
+#endif"; // comment
+  /* multi
+  line */ NOT OK
+#else
+OK __LINE__
+#endif
+
+#ifdef NOPE
+#  if 1
+#  else
+#  endif
+#elif 1 // comment
+OK __LINE__
+#endif
+
+#if 0
+x \
+#endif
+NOT OK
+#endif
+OK __LINE__
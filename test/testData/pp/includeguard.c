@@ -0,0 +1,10 @@
+#include "includeguard.h1"
+#include "includeguard.h1"
+GUARDED
+#undef INCLUDEGUARD_H
+#include "includeguard.h1"
+GUARDED
+#include "includeguard.h1"
+#define NOT_GUARDED_H
+#include "includeguard.h2"
+#include "includeguard.h2"
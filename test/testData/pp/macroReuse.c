@@ -0,0 +1,23 @@
+#define PASTE a ## b ## c
+#define TWICE PASTE PASTE
+#define NOARGS() x y
+#define CALL(f) f()
+#define EMPTY
+#define ID NOARGS
+
+TWICE;
+PASTE+PASTE;
+NOARGS() NOARGS()+NOARGS();
+CALL(NOARGS) CALL(ID);
+EMPTY TWICE EMPTY;
+
+#define PASTE2(x, y) x ## y
+#define STR(x) #x
+#define TWICE2(x) x STR(x) x
+#define CAT3(x, y, z) x ## y ## z
+#define LOG(fmt, ...) log(fmt, ##__VA_ARGS__)
+
+PASTE2(a b, c) PASTE2(a##b, c) PASTE2(, c) PASTE2(,);
+TWICE2(PASTE) TWICE2(NOARGS());
+CAT3(a, b, c) CAT3(1, , 2) CAT3(, b, );
+LOG("x") LOG("x", TWICE, 1);
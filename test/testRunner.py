@@ -96,10 +96,11 @@ def runParserTest(compiler, workingDir, dirname, name):
             updateExpectedFromActualIfNeed("AstCanonDump", actualAstCanonFilePath, expectedAstCanonFilePath)
 
 
-def runCodegenTest(compiler, workingDir, dirname, name):
+def runCodegenTest(compiler, workingDir, dirname, name, flags):
     global numOfFailedTests
     testFilePath = dirname + '/' + name + '.c'
     argsFilePath = dirname + '/' + name + '.args'
+    pchHeaderPath = dirname + '/' + name + '.pch.h'
 
     outputDir = workingDir + '/' + dirname
 
@@ -123,6 +124,14 @@ def runCodegenTest(compiler, workingDir, dirname, name):
 
     err = open(errFilePath, 'w+')
     compialtionCommand = [compiler, "-oneline" , "-o", binFileName, testFilePath, "-lm"]
+    compialtionCommand.extend(flags)
+
+    # header prefix is precompiled first and included into the test as an image
+    if path.exists(pchHeaderPath):
+        pchFilePath = outputDir + '/' + name + '.pch'
+        pchCommand = [compiler, "-oneline", "-emit-pch", pchFilePath, pchHeaderPath]
+        Popen(pchCommand, stdout=sys.stdout, stderr=err).wait()
+        compialtionCommand.extend(["-include-pch", pchFilePath])
 #    print(compialtionCommand)
     compilation = Popen(compialtionCommand, stdout=sys.stdout, stderr=err)
     exit_code = compilation.wait()
@@ -158,6 +167,7 @@ def runPPTest(compiler, workingDir, dirname, name):
     global numOfFailedTests
     testFilePath = dirname + '/' + name + '.c'
     expectFilePath = dirname + '/' + name + '.expect'
+    expectedErrFilePath = dirname + '/' + name + '.err'
 
     outputDir = workingDir + '/' + dirname
 
@@ -172,8 +182,15 @@ def runPPTest(compiler, workingDir, dirname, name):
     out = open(actualFilePath, 'w+')
 
     compialtionCommand = [compiler, "-E", testFilePath]
+    err = sys.stderr
+
+    # tests with expected diagnostics keep them in .err next to .expect
+    if path.exists(expectedErrFilePath):
+        actualErrFilePath = outputDir + '/' + name + '.err'
+        err = open(actualErrFilePath, 'w+')
+        compialtionCommand = [compiler, "-E", "-oneline", testFilePath]
 #    print(compialtionCommand)
-    compilation = Popen(compialtionCommand, stdout=out, stderr=sys.stderr)
+    compilation = Popen(compialtionCommand, stdout=out, stderr=err)
     exit_code = compilation.wait()
 
     if exit_code != 0:
@@ -185,6 +202,9 @@ def runPPTest(compiler, workingDir, dirname, name):
         if (path.exists(expectFilePath)):
             testOk = compareFilesLineByLine("preprocessed", testFilePath, actualFilePath, expectFilePath)
 
+        if (testOk and path.exists(expectedErrFilePath)):
+            testOk = compareFilesLineByLine("Stderr", testFilePath, actualErrFilePath, expectedErrFilePath)
+
         if (testOk):
             print(CBOLD + CGREEN + f"Test {testFilePath} -- OK" + RESET)
 
@@ -206,7 +226,10 @@ def runTestForData(filePath, compiler, workingDir, testMode):
         elif testMode == 'preprocessor':
             runPPTest(compiler, workingDir, dirname, name)
         elif testMode == 'codegen':
-            runCodegenTest(compiler, workingDir, dirname, name)
+            runCodegenTest(compiler, workingDir, dirname, name, [])
+        elif testMode == 'pipeline':
+            # the same codegen tests, each function is generated right after it is parsed
+            runCodegenTest(compiler, workingDir, dirname, name, ["-pipeline"])
         else:
             raise Exception(f"Unknown test mode {testMode}")
 
@@ -226,7 +249,7 @@ def parseArguments():
     parser.add_argument('-c', '--compiler', type=str, required=True, help="specify path to compiler")
     parser.add_argument('-wd', '--working-dir', type=str, required=True, help="specify working dir for tests")
     parser.add_argument('-p', '--test-path', type=str, required=True, action='append', help='path to test')
-    parser.add_argument('-m', '--mode', choices=['parser', 'preprocessor', 'codegen'], default='parser', help='Which substystem to be tested')
+    parser.add_argument('-m', '--mode', choices=['parser', 'preprocessor', 'codegen', 'pipeline'], default='parser', help='Which substystem to be tested')
 
     return parser.parse_args()
 